@@ -2,11 +2,31 @@
 #include <string.h>
 #include <stdbool.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AES_HAVE_X86 1
+#endif
+
 #include "aes.h"
 #include "../utils/general.h"
 #include "../utils/pkcs7.h"
+#include "../utils/rsp.h"
+#include "../utils/cpu_features.h"
+#include "../utils/stats.h"
+#include "../utils/endian.h"
+#include "../utils/threadpool.h"
+
+// The number of independent blocks the AES-NI CBC decryption keeps in flight;
+#define AES_NI_LANES 4
 
-#define AES_MAX_TEST_MSG_LENGTH 350
+typedef struct {
+    // Turns the expanded key (FIPS 197 byte order) into the round keys of the context;
+    void (*setup)(aes_ctx* ctx, const uint8_t* expanded_key);
+    void (*encrypt_block)(const aes_ctx* ctx, const uint8_t* plain_block, uint8_t* cipher_block);
+    void (*decrypt_block)(const aes_ctx* ctx, const uint8_t* cipher_block, uint8_t* plain_block);
+    void (*cbc_encrypt)(const aes_ctx* ctx, uint8_t* iv, const uint8_t* plain, uint8_t* cipher, size_t len);
+    void (*cbc_decrypt)(const aes_ctx* ctx, uint8_t* iv, const uint8_t* cipher, uint8_t* plain, size_t len);
+} aes_ops;
 
 static const uint8_t s_box[256] = {
     0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
@@ -65,7 +85,7 @@ static const uint8_t rcon[255] = {
     0x61, 0xc2, 0x9f, 0x25, 0x4a, 0x94, 0x33, 0x66, 0xcc, 0x83, 0x1d, 0x3a, 0x74, 0xe8, 0xcb
 };
 
-static void row_col_map(uint8_t* dest, uint8_t* src) {
+static void row_col_map(uint8_t* dest, const uint8_t* src) {
     for (uint8_t i = 0; i < AES_WORD_SIZE; i++) {
         for (uint8_t j = 0; j < AES_WORD_SIZE; j++) {
             dest[i + AES_WORD_SIZE * j] = src[i * AES_WORD_SIZE + j];
@@ -86,11 +106,9 @@ static uint8_t get_rcon_value(uint8_t iteration) {
 }
 
 static void rotate_word(uint8_t* word) {
-    uint8_t byte = word[0];
-    for (uint8_t i = 0; i < AES_WORD_SIZE - 1; i++) {
-        word[i] = word[i + 1];
-    }
-    word[AES_WORD_SIZE - 1] = byte;
+    // Read as little-endian the first byte is the lowest one => moving it to the end is a right rotation by 8;
+    uint32_t value = endian_load_le32(word);
+    endian_store_le32(word, (value >> 8) | (value << 24));
 }
 
 static void key_schedule(uint8_t* word, size_t iteration) {
@@ -101,7 +119,7 @@ static void key_schedule(uint8_t* word, size_t iteration) {
     word[0] ^= get_rcon_value(iteration);
 }
 
-static void key_expansion(uint8_t* key, uint8_t key_size, uint8_t* expanded_key, size_t expanded_key_size) {
+static void key_expansion(const uint8_t* key, uint8_t key_size, uint8_t* expanded_key, size_t expanded_key_size) {
     size_t current_size = 0;
     size_t rcon_iteration = 1;
     uint8_t temp_word[AES_WORD_SIZE] = { 0 };
@@ -166,7 +184,7 @@ static void shift_rows(uint8_t* state, bool decrypt) {
     }
 }
 
-static void add_round_key(uint8_t* state, uint8_t* round_key) {
+static void add_round_key(uint8_t* state, const uint8_t* round_key) {
     for (uint8_t i = 0; i < AES_BLOCK_SIZE; i++) {
         state[i] ^= round_key[i];
     }
@@ -223,7 +241,7 @@ static void mix_columns(uint8_t* state, bool decrypt) {
     }
 }
 
-static void aes_round(uint8_t* state, uint8_t* round_key, bool decrypt) {
+static void aes_round(uint8_t* state, const uint8_t* round_key, bool decrypt) {
     if (decrypt) {
         shift_rows(state, true);
         sub_bytes(state, true);
@@ -237,206 +255,425 @@ static void aes_round(uint8_t* state, uint8_t* round_key, bool decrypt) {
     }
 }
 
-static void generate_round_key(uint8_t* expanded_key, uint8_t* round_key) {
+static void generate_round_key(const uint8_t* expanded_key, uint8_t* round_key) {
     row_col_map(round_key, expanded_key);
 }
 
-static void aes_main(uint8_t* state, uint8_t* expanded_key, uint8_t nr_rounds, bool decrypt) {
-    uint8_t round_key[AES_BLOCK_SIZE] = { 0 };
+static void aes_main(uint8_t* state, const uint8_t* round_keys, uint8_t nr_rounds, bool decrypt) {
     if (decrypt) {
         // Single block decryption flow;
-        generate_round_key(expanded_key + AES_BLOCK_SIZE * nr_rounds, round_key);
-        add_round_key(state, round_key);
+        add_round_key(state, round_keys + AES_BLOCK_SIZE * nr_rounds);
         for (uint8_t i = nr_rounds - 1; i > 0; i--) {
-            generate_round_key(expanded_key + AES_BLOCK_SIZE * i, round_key);
-            aes_round(state, round_key, true);
+            aes_round(state, round_keys + AES_BLOCK_SIZE * i, true);
         }
-        generate_round_key(expanded_key, round_key);
         shift_rows(state, true);
         sub_bytes(state, true);
-        add_round_key(state, round_key);
+        add_round_key(state, round_keys);
     } else {
         // Single block encryption flow;
-        generate_round_key(expanded_key, round_key);
-        add_round_key(state, round_key);
+        add_round_key(state, round_keys);
         for (uint8_t i = 1; i < nr_rounds; i++) {
-            generate_round_key(expanded_key + AES_BLOCK_SIZE * i, round_key);
-            aes_round(state, round_key, false);
+            aes_round(state, round_keys + AES_BLOCK_SIZE * i, false);
         }
-        generate_round_key(expanded_key + AES_BLOCK_SIZE * nr_rounds, round_key);
         sub_bytes(state, false);
         shift_rows(state, false);
-        add_round_key(state, round_key);
+        add_round_key(state, round_keys + AES_BLOCK_SIZE * nr_rounds);
     }
 }
 
-uint8_t aes(uint8_t* data_block, uint8_t* cipher_block, uint8_t* key, uint8_t key_size, bool decrypt) {
-    size_t expanded_key_size = 0;
-    uint8_t nr_rounds = 0;
-    uint8_t* expanded_key = NULL;
-    uint8_t block[AES_BLOCK_SIZE] = { 0 };
+static void aes_generic_setup(aes_ctx* ctx, const uint8_t* expanded_key) {
+    // Map every round key to the layout of the state once, instead of once per round of every block;
+    for (uint8_t i = 0; i <= ctx->nr_rounds; i++) {
+        generate_round_key(expanded_key + AES_BLOCK_SIZE * i, ctx->round_keys + AES_BLOCK_SIZE * i);
+    }
+}
+
+static void aes_generic_encrypt_block(const aes_ctx* ctx, const uint8_t* plain_block, uint8_t* cipher_block) {
+    uint8_t block[AES_BLOCK_SIZE];
+    row_col_map(block, plain_block);
+    aes_main(block, ctx->round_keys, ctx->nr_rounds, false);
+    row_col_map(cipher_block, block);
+}
+
+static void aes_generic_decrypt_block(const aes_ctx* ctx, const uint8_t* cipher_block, uint8_t* plain_block) {
+    uint8_t block[AES_BLOCK_SIZE];
+    row_col_map(block, cipher_block);
+    aes_main(block, ctx->round_keys, ctx->nr_rounds, true);
+    row_col_map(plain_block, block);
+}
+
+static void aes_generic_cbc_encrypt(const aes_ctx* ctx, uint8_t* iv, const uint8_t* plain, uint8_t* cipher, size_t len) {
+    uint8_t block[AES_BLOCK_SIZE];
+    // For each block of the plaintext XOR it with the IV and then encrypt;
+    for (size_t i = 0; i < len; i += AES_BLOCK_SIZE) {
+        // XOR as two 64-bit words, the byte order does not matter for a XOR;
+        endian_store_le64(block, endian_load_le64(plain + i) ^ endian_load_le64(iv));
+        endian_store_le64(block + 8, endian_load_le64(plain + i + 8) ^ endian_load_le64(iv + 8));
+        aes_generic_encrypt_block(ctx, block, cipher + i);
+        // The next IV is the current encrypted block;
+        memcpy(iv, cipher + i, AES_BLOCK_SIZE);
+    }
+}
+
+static void aes_generic_cbc_decrypt(const aes_ctx* ctx, uint8_t* iv, const uint8_t* cipher, uint8_t* plain, size_t len) {
+    uint8_t next_iv[AES_BLOCK_SIZE];
+    // For each block of the ciphertext decrypt it and the XOR it with the IV;
+    for (size_t i = 0; i < len; i += AES_BLOCK_SIZE) {
+        // Save the current cipher block to use as the next IV (plain may overwrite cipher);
+        memcpy(next_iv, cipher + i, AES_BLOCK_SIZE);
+        aes_generic_decrypt_block(ctx, cipher + i, plain + i);
+        endian_store_le64(plain + i, endian_load_le64(plain + i) ^ endian_load_le64(iv));
+        endian_store_le64(plain + i + 8, endian_load_le64(plain + i + 8) ^ endian_load_le64(iv + 8));
+        memcpy(iv, next_iv, AES_BLOCK_SIZE);
+    }
+}
+
+#ifdef AES_HAVE_X86
+
+/*
+ * AES-NI uses the round keys in FIPS 197 byte order. Decryption runs the equivalent inverse
+ * cipher, whose round keys are the encryption ones in reverse order with InvMixColumns
+ * applied to all but the first and the last;
+ */
+__attribute__((target("aes")))
+static void aes_ni_setup(aes_ctx* ctx, const uint8_t* expanded_key) {
+    const __m128i* keys = (const __m128i*)expanded_key;
+    __m128i* decrypt_keys = (__m128i*)ctx->decrypt_keys;
+    uint8_t nr_rounds = ctx->nr_rounds;
+    memcpy(ctx->round_keys, expanded_key, AES_BLOCK_SIZE * (nr_rounds + 1));
+    _mm_storeu_si128(decrypt_keys, _mm_loadu_si128(keys + nr_rounds));
+    for (uint8_t i = 1; i < nr_rounds; i++) {
+        _mm_storeu_si128(decrypt_keys + i, _mm_aesimc_si128(_mm_loadu_si128(keys + nr_rounds - i)));
+    }
+    _mm_storeu_si128(decrypt_keys + nr_rounds, _mm_loadu_si128(keys));
+}
+
+__attribute__((target("aes")))
+static void aes_ni_load_keys(const uint8_t* round_keys, uint8_t nr_rounds, __m128i* keys) {
+    for (uint8_t i = 0; i <= nr_rounds; i++) {
+        keys[i] = _mm_loadu_si128((const __m128i*)round_keys + i);
+    }
+}
+
+__attribute__((target("aes")))
+static __m128i aes_ni_encrypt(const __m128i* keys, uint8_t nr_rounds, __m128i block) {
+    block = _mm_xor_si128(block, keys[0]);
+    for (uint8_t i = 1; i < nr_rounds; i++) {
+        block = _mm_aesenc_si128(block, keys[i]);
+    }
+    return _mm_aesenclast_si128(block, keys[nr_rounds]);
+}
+
+__attribute__((target("aes")))
+static __m128i aes_ni_decrypt(const __m128i* keys, uint8_t nr_rounds, __m128i block) {
+    block = _mm_xor_si128(block, keys[0]);
+    for (uint8_t i = 1; i < nr_rounds; i++) {
+        block = _mm_aesdec_si128(block, keys[i]);
+    }
+    return _mm_aesdeclast_si128(block, keys[nr_rounds]);
+}
+
+__attribute__((target("aes")))
+static void aes_ni_encrypt_block(const aes_ctx* ctx, const uint8_t* plain_block, uint8_t* cipher_block) {
+    __m128i keys[AES_MAX_ROUNDS + 1];
+    aes_ni_load_keys(ctx->round_keys, ctx->nr_rounds, keys);
+    _mm_storeu_si128((__m128i*)cipher_block, aes_ni_encrypt(keys, ctx->nr_rounds, _mm_loadu_si128((const __m128i*)plain_block)));
+}
+
+__attribute__((target("aes")))
+static void aes_ni_decrypt_block(const aes_ctx* ctx, const uint8_t* cipher_block, uint8_t* plain_block) {
+    __m128i keys[AES_MAX_ROUNDS + 1];
+    aes_ni_load_keys(ctx->decrypt_keys, ctx->nr_rounds, keys);
+    _mm_storeu_si128((__m128i*)plain_block, aes_ni_decrypt(keys, ctx->nr_rounds, _mm_loadu_si128((const __m128i*)cipher_block)));
+}
+
+// Every block depends on the previous ciphertext => CBC encryption stays one block at a time;
+__attribute__((target("aes")))
+static void aes_ni_cbc_encrypt(const aes_ctx* ctx, uint8_t* iv, const uint8_t* plain, uint8_t* cipher, size_t len) {
+    __m128i keys[AES_MAX_ROUNDS + 1];
+    __m128i chain = _mm_loadu_si128((const __m128i*)iv);
+    aes_ni_load_keys(ctx->round_keys, ctx->nr_rounds, keys);
+    for (size_t i = 0; i < len; i += AES_BLOCK_SIZE) {
+        chain = aes_ni_encrypt(keys, ctx->nr_rounds, _mm_xor_si128(_mm_loadu_si128((const __m128i*)(plain + i)), chain));
+        _mm_storeu_si128((__m128i*)(cipher + i), chain);
+    }
+    _mm_storeu_si128((__m128i*)iv, chain);
+}
+
+// The blocks of CBC decryption are independent => AES_NI_LANES of them go through the rounds together;
+__attribute__((target("aes")))
+static void aes_ni_cbc_decrypt(const aes_ctx* ctx, uint8_t* iv, const uint8_t* cipher, uint8_t* plain, size_t len) {
+    __m128i keys[AES_MAX_ROUNDS + 1];
+    __m128i chain = _mm_loadu_si128((const __m128i*)iv);
+    __m128i blocks[AES_NI_LANES], previous[AES_NI_LANES];
+    uint8_t nr_rounds = ctx->nr_rounds;
+    size_t i = 0;
+    aes_ni_load_keys(ctx->decrypt_keys, nr_rounds, keys);
+    for (; i + AES_NI_LANES * AES_BLOCK_SIZE <= len; i += AES_NI_LANES * AES_BLOCK_SIZE) {
+        // Read every ciphertext block first, plain may overwrite cipher;
+        for (size_t j = 0; j < AES_NI_LANES; j++) {
+            previous[j] = (j == 0) ? chain : blocks[j - 1];
+            blocks[j] = _mm_loadu_si128((const __m128i*)(cipher + i) + j);
+        }
+        chain = blocks[AES_NI_LANES - 1];
+        for (size_t j = 0; j < AES_NI_LANES; j++) {
+            blocks[j] = _mm_xor_si128(blocks[j], keys[0]);
+        }
+        for (uint8_t r = 1; r < nr_rounds; r++) {
+            for (size_t j = 0; j < AES_NI_LANES; j++) {
+                blocks[j] = _mm_aesdec_si128(blocks[j], keys[r]);
+            }
+        }
+        for (size_t j = 0; j < AES_NI_LANES; j++) {
+            blocks[j] = _mm_aesdeclast_si128(blocks[j], keys[nr_rounds]);
+            _mm_storeu_si128((__m128i*)(plain + i) + j, _mm_xor_si128(blocks[j], previous[j]));
+        }
+    }
+    for (; i < len; i += AES_BLOCK_SIZE) {
+        blocks[0] = _mm_loadu_si128((const __m128i*)(cipher + i));
+        _mm_storeu_si128((__m128i*)(plain + i), _mm_xor_si128(aes_ni_decrypt(keys, nr_rounds, blocks[0]), chain));
+        chain = blocks[0];
+    }
+    _mm_storeu_si128((__m128i*)iv, chain);
+}
+
+#endif
+
+static const aes_ops aes_generic_ops = {
+    aes_generic_setup, aes_generic_encrypt_block, aes_generic_decrypt_block, aes_generic_cbc_encrypt, aes_generic_cbc_decrypt
+};
+#ifdef AES_HAVE_X86
+static const aes_ops aes_ni_ops = {
+    aes_ni_setup, aes_ni_encrypt_block, aes_ni_decrypt_block, aes_ni_cbc_encrypt, aes_ni_cbc_decrypt
+};
+#endif
+
+static const cpu_backend aes_backends[] = {
+#ifdef AES_HAVE_X86
+    { "aesni", CPU_FEATURE_AESNI, &aes_ni_ops },
+#endif
+    { "generic", 0, &aes_generic_ops }
+};
+
+static cpu_dispatch aes_dispatch = { "aes", aes_backends, sizeof aes_backends / sizeof aes_backends[0], NULL };
+
+__attribute__((constructor))
+static void aes_register(void) {
+    cpu_dispatch_register(&aes_dispatch);
+}
+
+int aes_init_backend(aes_ctx* ctx, const uint8_t* key, uint8_t key_size, const char* backend) {
+    uint8_t expanded_key[AES_BLOCK_SIZE * (AES_MAX_ROUNDS + 1)];
+    const cpu_backend* found = (backend != NULL) ? cpu_dispatch_find(&aes_dispatch, backend) : cpu_dispatch_active(&aes_dispatch);
+    if (found == NULL) {
+        return -1;
+    }
     switch (key_size) {
         case AES_KEY_SIZE_128:
-            nr_rounds = 10;
+            ctx->nr_rounds = 10;
             break;
         case AES_KEY_SIZE_192:
-            nr_rounds = 12;
+            ctx->nr_rounds = 12;
             break;
         case AES_KEY_SIZE_256:
-            nr_rounds = 14;
+            ctx->nr_rounds = 14;
             break;
         default:
             return -1;
             break;
     }
-    expanded_key_size = AES_BLOCK_SIZE * (nr_rounds + 1);
-    expanded_key = safe_malloc(expanded_key_size * sizeof *expanded_key);
-    row_col_map(block, data_block);
-    key_expansion(key, key_size, expanded_key, expanded_key_size);
-    aes_main(block, expanded_key, nr_rounds, decrypt);
-    row_col_map(cipher_block, block);
-    free(expanded_key);
+    STATS_PROBE1(aes_key_schedule, key_size);
+    ctx->ops = found->ops;
+    key_expansion(key, key_size, expanded_key, AES_BLOCK_SIZE * (ctx->nr_rounds + 1));
+    ((const aes_ops*)ctx->ops)->setup(ctx, expanded_key);
+    secure_zero(expanded_key, sizeof expanded_key);
+    STATS_ADD(STATS_AES, STATS_KEY_SCHEDULES, 1);
     return 0;
 }
 
-void aes_cbc_encrypt(const uint8_t* plain, size_t plain_len, uint8_t* iv, uint8_t* key, uint8_t key_size, uint8_t** cipher, size_t* cipher_len) {
-    uint8_t* padded = NULL;
-    uint8_t temp_iv[AES_BLOCK_SIZE];
-    memcpy(temp_iv, iv, AES_BLOCK_SIZE);
-    // Pad the plaintext and store it in the padded buffer;
-    pkcs7_pad(plain, plain_len, &padded, cipher_len);
-    *cipher = safe_malloc(*cipher_len * sizeof **cipher);
-    // For each block of the plaintext XOR it with the IV and then encrypt;
-    for (size_t i = 0; i < *cipher_len; i += AES_BLOCK_SIZE) {
-        for (uint8_t j = 0; j < AES_BLOCK_SIZE; j++) {
-            padded[i + j] ^= temp_iv[j];
-        }
-        aes(padded + i, *cipher + i, key, key_size, false);
-        // The next IV is the current encrypted block;
-        memcpy(temp_iv, *cipher + i, AES_BLOCK_SIZE);
+int aes_init(aes_ctx* ctx, const uint8_t* key, uint8_t key_size) {
+    return aes_init_backend(ctx, key, key_size, NULL);
+}
+
+void aes_clear(aes_ctx* ctx) {
+    secure_zero(ctx, sizeof *ctx);
+}
+
+void aes_encrypt_block(const aes_ctx* ctx, const uint8_t* plain_block, uint8_t* cipher_block) {
+    ((const aes_ops*)ctx->ops)->encrypt_block(ctx, plain_block, cipher_block);
+}
+
+void aes_decrypt_block(const aes_ctx* ctx, const uint8_t* cipher_block, uint8_t* plain_block) {
+    ((const aes_ops*)ctx->ops)->decrypt_block(ctx, cipher_block, plain_block);
+}
+
+// The single block functions are left uncounted, timing them would cost more than the block;
+void aes_cbc_encrypt_blocks(const aes_ctx* ctx, uint8_t* iv, const uint8_t* plain, uint8_t* cipher, size_t len) {
+    STATS_PROBE2(aes_cbc_encrypt, plain, len);
+    STATS_BEGIN(scope, len);
+    ((const aes_ops*)ctx->ops)->cbc_encrypt(ctx, iv, plain, cipher, len);
+    STATS_END(scope, STATS_AES, len, len, len / AES_BLOCK_SIZE);
+}
+
+typedef struct {
+    const aes_ctx* ctx;
+    const uint8_t* iv;
+    const uint8_t* cipher;
+    uint8_t* plain;
+} aes_cbc_job;
+
+// A range chains from the ciphertext block before it, which the other ranges only read;
+static void aes_cbc_decrypt_range(void* context, size_t start, size_t end) {
+    aes_cbc_job* job = context;
+    uint8_t iv[AES_BLOCK_SIZE];
+    memcpy(iv, (start == 0) ? job->iv : job->cipher + start - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+    ((const aes_ops*)job->ctx->ops)->cbc_decrypt(job->ctx, iv, job->cipher + start, job->plain + start, end - start);
+}
+
+void aes_cbc_decrypt_blocks(const aes_ctx* ctx, uint8_t* iv, const uint8_t* cipher, uint8_t* plain, size_t len) {
+    aes_cbc_job job = { .ctx = ctx, .iv = iv, .cipher = cipher, .plain = plain };
+    STATS_PROBE2(aes_cbc_decrypt, cipher, len);
+    STATS_BEGIN(scope, len);
+    // Unlike encryption every block decrypts on its own, but in place a range would overwrite the
+    // ciphertext block the next one chains from => only out-of-place calls are split;
+    if ((len > 0) && (((uintptr_t)plain + len <= (uintptr_t)cipher) || ((uintptr_t)cipher + len <= (uintptr_t)plain))) {
+        parallel_for_bytes(len, AES_BLOCK_SIZE, aes_cbc_decrypt_range, &job);
+        memcpy(iv, cipher + len - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+    } else {
+        ((const aes_ops*)ctx->ops)->cbc_decrypt(ctx, iv, cipher, plain, len);
     }
-    free(padded);
+    STATS_END(scope, STATS_AES, len, len, len / AES_BLOCK_SIZE);
 }
 
-void aes_cbc_decrypt(const uint8_t* cipher, size_t cipher_len, uint8_t* iv, uint8_t* key, uint8_t key_size, uint8_t** plain, size_t* plain_len) {
-    uint8_t* padded = safe_malloc(cipher_len * sizeof *padded);
-    memcpy(padded, cipher, cipher_len);
-    uint8_t temp_iv[AES_BLOCK_SIZE], temp_iv2[AES_BLOCK_SIZE];
-    memcpy(temp_iv, iv, AES_BLOCK_SIZE);
-    // For each block of the ciphertext decrypt it and the XOR it with the IV;
-    for (size_t i = 0; i < cipher_len; i += AES_BLOCK_SIZE) {
-        // Save the current cipher block to use as the next IV;
-        memcpy(temp_iv2, padded + i, AES_BLOCK_SIZE);
-        aes(padded + i, padded + i, key, key_size, true);
-        for (uint8_t j = 0; j < AES_BLOCK_SIZE; j++) {
-            padded[i + j] ^= temp_iv[j];
-        }
-        memcpy(temp_iv, temp_iv2, AES_BLOCK_SIZE);
+uint8_t aes(uint8_t* data_block, uint8_t* cipher_block, uint8_t* key, uint8_t key_size, bool decrypt) {
+    aes_ctx ctx;
+    if (aes_init(&ctx, key, key_size) != 0) {
+        return -1;
+    }
+    if (decrypt) {
+        aes_decrypt_block(&ctx, data_block, cipher_block);
+    } else {
+        aes_encrypt_block(&ctx, data_block, cipher_block);
     }
-    pkcs7_unpad(padded, cipher_len, plain, plain_len);
-    free(padded);
+    aes_clear(&ctx);
+    return 0;
 }
 
-static void aes_cbc_decrypt_no_pad(const uint8_t* cipher, size_t cipher_len, uint8_t* iv, uint8_t* key, uint8_t key_size, uint8_t** plain, size_t* plain_len) {
-    uint8_t* padded = safe_malloc(cipher_len * sizeof *padded);
-    memcpy(padded, cipher, cipher_len);
-    uint8_t temp_iv[AES_BLOCK_SIZE], temp_iv2[AES_BLOCK_SIZE];
+void aes_cbc_encrypt(const uint8_t* plain, size_t plain_len, uint8_t* iv, uint8_t* key, uint8_t key_size, uint8_t** cipher, size_t* cipher_len, arena* arena) {
+    size_t full_len = plain_len - (plain_len % AES_BLOCK_SIZE);
+    uint8_t last_block[AES_BLOCK_SIZE];
+    uint8_t temp_iv[AES_BLOCK_SIZE];
+    aes_ctx ctx;
+    // Expand the key once for the whole message, before anything is allocated for it;
+    if (aes_init(&ctx, key, key_size) != 0) {
+        *cipher = NULL;
+        *cipher_len = 0;
+        return;
+    }
     memcpy(temp_iv, iv, AES_BLOCK_SIZE);
-    // For each block of the ciphertext decrypt it and the XOR it with the IV;
-    for (size_t i = 0; i < cipher_len; i += AES_BLOCK_SIZE) {
-        // Save the current cipher block to use as the next IV;
-        memcpy(temp_iv2, padded + i, AES_BLOCK_SIZE);
-
-        aes(padded + i, padded + i, key, key_size, true);
+    *cipher_len = full_len + AES_BLOCK_SIZE;
+    *cipher = arena_or_malloc(arena, *cipher_len * sizeof **cipher);
+    // Encrypt the whole blocks in place and pad only the last one, the plaintext is never copied;
+    aes_cbc_encrypt_blocks(&ctx, temp_iv, plain, *cipher, full_len);
+    pkcs7_pad_block(plain + full_len, plain_len - full_len, last_block);
+    aes_cbc_encrypt_blocks(&ctx, temp_iv, last_block, *cipher + full_len, AES_BLOCK_SIZE);
+    aes_clear(&ctx);
+}
 
-        for (uint8_t j = 0; j < AES_BLOCK_SIZE; j++) {
-            padded[i + j] ^= temp_iv[j];
+void aes_cbc_decrypt(const uint8_t* cipher, size_t cipher_len, uint8_t* iv, uint8_t* key, uint8_t key_size, uint8_t** plain, size_t* plain_len, arena* arena) {
+    uint8_t* padded = NULL;
+    uint8_t temp_iv[AES_BLOCK_SIZE];
+    aes_ctx ctx;
+    if ((cipher_len == 0) || (cipher_len % AES_BLOCK_SIZE != 0)) {
+        return;
+    }
+    if (aes_init(&ctx, key, key_size) != 0) {
+        *plain = NULL;
+        *plain_len = 0;
+        return;
+    }
+    // Decrypt straight into the returned buffer and strip the padding by shortening it;
+    padded = arena_or_malloc(arena, cipher_len * sizeof *padded);
+    memcpy(temp_iv, iv, AES_BLOCK_SIZE);
+    aes_cbc_decrypt_blocks(&ctx, temp_iv, cipher, padded, cipher_len);
+    aes_clear(&ctx);
+    if (pkcs7_unpadded_len(padded, cipher_len, plain_len) != 0) {
+        if (arena == NULL) {
+            free(padded);
         }
-        memcpy(temp_iv, temp_iv2, AES_BLOCK_SIZE);
+        return;
     }
-    // pkcs7_unpad(cipher, cipher_len, plain, plain_len);
-    *plain_len = cipher_len;
-    *plain = safe_malloc(*plain_len * sizeof **plain);
-    memcpy(*plain, padded, cipher_len);
-    free(padded);
+    *plain = padded;
+}
+
+static void aes_malformed(const rsp_reader* reader) {
+    fprintf(stderr, "Malformed test vector on line %zu. Proceeding to crash. Cleaning up...", reader->record_line);
+    exit(EXIT_FAILURE);
 }
 
 void aes_cbc_test(const char* test_file, uint8_t key_size) {
-    FILE* file_ptr = safe_fopen(test_file, "rb");
-    char buffer[AES_MAX_TEST_MSG_LENGTH];
-    uint8_t* key = NULL;
-    uint8_t* iv = NULL;
-    uint8_t* plain = NULL;
-    size_t plain_len = 0;
-    uint8_t* cipher = NULL;
-    uint8_t* nist_cipher = NULL;
-    size_t cipher_len = 0;
-    size_t count = 1;
-    while (fgets(buffer, AES_MAX_TEST_MSG_LENGTH, file_ptr)) {
-        // Read the key and convert it to a byte array;
-        sscanf(buffer, "KEY = %s", buffer);
-        key = hex_to_byte_array(buffer, key_size * 2);
+    rsp_reader reader;
+    aes_ctx ctx;
+    const uint8_t* key = NULL;
+    const uint8_t* iv = NULL;
+    const uint8_t* plain = NULL;
+    const uint8_t* nist_cipher = NULL;
+    const rsp_field* plain_field = NULL;
+    const rsp_field* cipher_field = NULL;
+    size_t key_len = 0, iv_len = 0, plain_len = 0, cipher_len = 0;
+    uint8_t temp_iv[AES_BLOCK_SIZE];
+    uint8_t* local = NULL;
+    size_t local_cap = 0;
+    bool decrypt = false;
+    rsp_open(&reader, test_file);
+    while (rsp_next(&reader)) {
+        key = rsp_hex(&reader, "KEY", &key_len);
+        iv = rsp_hex(&reader, "IV", &iv_len);
+        plain = rsp_hex(&reader, "PLAINTEXT", &plain_len);
+        nist_cipher = rsp_hex(&reader, "CIPHERTEXT", &cipher_len);
+        if ((key == NULL) || (key_len != key_size) || (iv == NULL) || (iv_len != AES_BLOCK_SIZE) || (plain == NULL) ||
+            (nist_cipher == NULL) || (plain_len != cipher_len) || (plain_len % AES_BLOCK_SIZE != 0)) {
+            aes_malformed(&reader);
+        }
+        // The [DECRYPT] records list the ciphertext first, files without sections are told apart by that alone;
+        plain_field = rsp_find(&reader, "PLAINTEXT");
+        cipher_field = rsp_find(&reader, "CIPHERTEXT");
+        if (reader.section.len > 0) {
+            decrypt = (reader.section.len == 7) && (memcmp(reader.section.data, "DECRYPT", 7) == 0);
+        } else {
+            decrypt = cipher_field < plain_field;
+        }
+        if (plain_len > local_cap) {
+            free(local);
+            local_cap = plain_len;
+            local = safe_malloc(local_cap);
+        }
         printf("KEY = \t\t");
         print_byte_array(key, key_size);
-        memset(buffer, 0, AES_MAX_TEST_MSG_LENGTH);
-        // Read the IV and convert it to a byte array;
-        fgets(buffer, AES_MAX_TEST_MSG_LENGTH, file_ptr);
-        sscanf(buffer, "IV = %s", buffer);
-        iv = hex_to_byte_array(buffer, AES_BLOCK_SIZE * 2);
         printf("IV = \t\t");
         print_byte_array(iv, AES_BLOCK_SIZE);
-        memset(buffer, 0, AES_MAX_TEST_MSG_LENGTH);
-        if (count > 10) {
-            plain_len = (count - 10) * AES_BLOCK_SIZE;
-            // Read the ciphertext and convert it to a byte array;
-            fgets(buffer, AES_MAX_TEST_MSG_LENGTH, file_ptr);
-            sscanf(buffer, "CIPHERTEXT = %s", buffer);
-            nist_cipher = hex_to_byte_array(buffer, plain_len * 2);
+        memcpy(temp_iv, iv, AES_BLOCK_SIZE);
+        aes_init(&ctx, key, key_size);
+        if (decrypt) {
             printf("CIPHER = \t");
-            print_byte_array(nist_cipher, plain_len);
-            memset(buffer, 0, AES_MAX_TEST_MSG_LENGTH);
-            // Read the plaintext and convert it to a byte array;
-            fgets(buffer, AES_MAX_TEST_MSG_LENGTH, file_ptr);
-            sscanf(buffer, "PLAINTEXT = %s", buffer);
-            plain = hex_to_byte_array(buffer, plain_len * 2);
+            print_byte_array(nist_cipher, cipher_len);
             printf("PLAIN = \t");
             print_byte_array(plain, plain_len);
-            memset(buffer, 0, AES_MAX_TEST_MSG_LENGTH);
             // Apply decryption;
-            aes_cbc_decrypt_no_pad(nist_cipher, plain_len, iv, key, key_size, &cipher, &cipher_len);
-            printf("LOCAL = \t");
-            print_byte_array(cipher, cipher_len);
+            aes_cbc_decrypt_blocks(&ctx, temp_iv, nist_cipher, local, cipher_len);
         } else {
-            plain_len = count * AES_BLOCK_SIZE;
-            // Read the plaintext and convert it to a byte array;
-            fgets(buffer, AES_MAX_TEST_MSG_LENGTH, file_ptr);
-            sscanf(buffer, "PLAINTEXT = %s", buffer);
-            plain = hex_to_byte_array(buffer, plain_len * 2);
             printf("PLAIN = \t");
             print_byte_array(plain, plain_len);
-            memset(buffer, 0, AES_MAX_TEST_MSG_LENGTH);
-            // Read the ciphertext and convert it to a byte array;
-            fgets(buffer, AES_MAX_TEST_MSG_LENGTH, file_ptr);
-            sscanf(buffer, "CIPHERTEXT = %s", buffer);
-            nist_cipher = hex_to_byte_array(buffer, plain_len * 2);
             printf("CIPHER = \t");
-            print_byte_array(nist_cipher, plain_len);
-            memset(buffer, 0, AES_MAX_TEST_MSG_LENGTH);
-            // Apply decryption;
-            aes_cbc_encrypt(plain, plain_len, iv, key, key_size, &cipher, &cipher_len);
-            printf("LOCAL = \t");
-            print_byte_array(cipher, cipher_len - 16);
+            print_byte_array(nist_cipher, cipher_len);
+            // Apply encryption, the vectors are not padded;
+            aes_cbc_encrypt_blocks(&ctx, temp_iv, plain, local, plain_len);
         }
-        // Every fifth line is empty;
-        fgets(buffer, AES_MAX_TEST_MSG_LENGTH, file_ptr);
-        memset(buffer, 0, AES_MAX_TEST_MSG_LENGTH);
+        aes_clear(&ctx);
+        printf("LOCAL = \t");
+        print_byte_array(local, plain_len);
         printf("\n");
-        count++;
-    }
-    fclose(file_ptr);
-    free(key);
-    free(iv);
-    free(nist_cipher);
-    free(plain);
-    free(cipher);
+    }
+    rsp_close(&reader);
+    free(local);
 }
\ No newline at end of file
@@ -11,15 +11,99 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "../utils/arena.h"
+
 #define AES_BLOCK_SIZE 16
 #define AES_WORD_SIZE 4
 #define AES_KEY_SIZE_128 16
 #define AES_KEY_SIZE_192 24
 #define AES_KEY_SIZE_256 32
+// AES-256 has the most rounds;
+#define AES_MAX_ROUNDS 14
+
+typedef struct {
+    // The round keys, in the layout the backend works with;
+    uint8_t round_keys[AES_BLOCK_SIZE * (AES_MAX_ROUNDS + 1)];
+    // The round keys of the equivalent inverse cipher (only used by the AES-NI backend);
+    uint8_t decrypt_keys[AES_BLOCK_SIZE * (AES_MAX_ROUNDS + 1)];
+    uint8_t nr_rounds;
+    // The functions of the backend the context was initialised for (private to aes.c);
+    const void* ops;
+} aes_ctx;
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Expands a key once, so any number of blocks can be processed with it.
+ * @details The backend is the one cpu_features selects for the "aes" module.
+ * @param   ctx         A pointer to the context to initialise.
+ * @param   key         A pointer to the secret key.
+ * @param   key_size    The size of the key used IN BYTES (use one of the 3 macros)!
+ * @returns 0 on success, -1 if the key size is not supported.
+ * ---------------------------------------------------------------------------------------- **/
+int aes_init(aes_ctx* ctx, const uint8_t* key, uint8_t key_size);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Expands a key for a given backend.
+ * @param   ctx         A pointer to the context to initialise.
+ * @param   key         A pointer to the secret key.
+ * @param   key_size    The size of the key used IN BYTES (use one of the 3 macros)!
+ * @param   backend     The name of the backend, "aesni" or "generic" (NULL for the selected one).
+ * @returns 0 on success, -1 if the key size is not supported, there is no such backend or
+ *          the CPU cannot run it.
+ * ---------------------------------------------------------------------------------------- **/
+int aes_init_backend(aes_ctx* ctx, const uint8_t* key, uint8_t key_size, const char* backend);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Wipes the round keys of a context.
+ * @param   ctx         A pointer to the context.
+ * ---------------------------------------------------------------------------------------- **/
+void aes_clear(aes_ctx* ctx);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Encrypts a single block.
+ * @param   ctx         A pointer to an initialised context.
+ * @param   plain_block A pointer to the AES_BLOCK_SIZE bytes of plaintext.
+ * @param   cipher_block An array of AES_BLOCK_SIZE bytes to hold the ciphertext (may be plain_block).
+ * ---------------------------------------------------------------------------------------- **/
+void aes_encrypt_block(const aes_ctx* ctx, const uint8_t* plain_block, uint8_t* cipher_block);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Decrypts a single block.
+ * @param   ctx         A pointer to an initialised context.
+ * @param   cipher_block A pointer to the AES_BLOCK_SIZE bytes of ciphertext.
+ * @param   plain_block An array of AES_BLOCK_SIZE bytes to hold the plaintext (may be cipher_block).
+ * ---------------------------------------------------------------------------------------- **/
+void aes_decrypt_block(const aes_ctx* ctx, const uint8_t* cipher_block, uint8_t* plain_block);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Encrypts whole blocks in CBC mode, without padding or allocations.
+ * @details The IV is updated to the last ciphertext block, so a message can be encrypted
+ *          in several calls.
+ * @param   ctx         A pointer to an initialised context.
+ * @param   iv          A pointer to the AES_BLOCK_SIZE bytes of the IV.
+ * @param   plain       A pointer to the plaintext.
+ * @param   cipher      An array of len bytes to hold the ciphertext (may be plain).
+ * @param   len         The length of the data, a multiple of AES_BLOCK_SIZE.
+ * ---------------------------------------------------------------------------------------- **/
+void aes_cbc_encrypt_blocks(const aes_ctx* ctx, uint8_t* iv, const uint8_t* plain, uint8_t* cipher, size_t len);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Decrypts whole blocks in CBC mode, without unpadding or allocations.
+ * @details The IV is updated to the last ciphertext block, so a message can be decrypted
+ *          in several calls. Long messages decrypted out of place are split over the shared
+ *          thread pool, in place they are decrypted on the calling thread.
+ * @param   ctx         A pointer to an initialised context.
+ * @param   iv          A pointer to the AES_BLOCK_SIZE bytes of the IV.
+ * @param   cipher      A pointer to the ciphertext.
+ * @param   plain       An array of len bytes to hold the plaintext (may be cipher).
+ * @param   len         The length of the data, a multiple of AES_BLOCK_SIZE.
+ * ---------------------------------------------------------------------------------------- **/
+void aes_cbc_decrypt_blocks(const aes_ctx* ctx, uint8_t* iv, const uint8_t* cipher, uint8_t* plain, size_t len);
 
 /** ---------------------------------------------------------------------------------------
  * @brief   Encrypts a byte array using AES in CBC mode.
- * @details The caller is responsible for freeing the memory allocated for the ciphertext.
+ * @details The caller is responsible for freeing the memory allocated for the ciphertext
+ *          unless it comes from an arena. An unsupported key size stores a NULL ciphertext
+ *          of length 0.
  * @param   plain       A pointer to the plaintext data.
  * @param   plain_len   The length of the plaintext in bytes.
  * @param   iv          A pointer to the initialisation vector IV.
@@ -27,12 +111,16 @@
  * @param   key_size    The size of the key used IN BYTES (use one of the 3 macros)!
  * @param   cipher      A NULL pointer for storing the ciphertext as a byte array.
  * @param   cipher_len  The length of the returned cipher in bytes.
+ * @param   arena       The arena to allocate the ciphertext from (NULL for the heap).
  * ---------------------------------------------------------------------------------------- **/
-void aes_cbc_encrypt(const uint8_t* plain, size_t plain_len, uint8_t* iv, uint8_t* key, uint8_t key_size, uint8_t** cipher, size_t* cipher_len);
+void aes_cbc_encrypt(const uint8_t* plain, size_t plain_len, uint8_t* iv, uint8_t* key, uint8_t key_size, uint8_t** cipher, size_t* cipher_len, arena* arena);
 
 /** ---------------------------------------------------------------------------------------
  * @brief   Decrypts a byte array using AES in CBC mode.
- * @details The caller is responsible for freeing the memory allocated for the plaintext.
+ * @details The caller is responsible for freeing the memory allocated for the plaintext
+ *          unless it comes from an arena. Nothing is stored if the ciphertext is not a whole
+ *          number of blocks or its padding is invalid. An unsupported key size stores a NULL
+ *          plaintext of length 0.
  * @param   cipher      A pointer to the ciphertext data.
  * @param   cipher_len  The length of the ciphertext in bytes.
  * @param   iv          A pointer to the initialisation vector IV.
@@ -40,8 +128,9 @@ void aes_cbc_encrypt(const uint8_t* plain, size_t plain_len, uint8_t* iv, uint8_
  * @param   key_size    The size of the key used IN BYTES (use one of the 3 macros)!
  * @param   plain       A NULL pointer for storing the plaintext as a byte array.
  * @param   plain_len   The length of the returned plaintext in bytes.
+ * @param   arena       The arena to allocate the plaintext from (NULL for the heap).
  * ---------------------------------------------------------------------------------------- **/
-void aes_cbc_decrypt(const uint8_t* cipher, size_t cipher_len, uint8_t* iv, uint8_t* key, uint8_t key_size, uint8_t** plain, size_t* plain_len);
+void aes_cbc_decrypt(const uint8_t* cipher, size_t cipher_len, uint8_t* iv, uint8_t* key, uint8_t key_size, uint8_t** plain, size_t* plain_len, arena* arena);
 
 /** ---------------------------------------------------------------------------------------
  * @brief   Tests the CBC mode of operation using NIST test vectors for all key sizes.
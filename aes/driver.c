@@ -18,9 +18,9 @@ int main() {
     // uint8_t* plain = NULL;
     // size_t plain_len = 0;
     // size_t cipher_len = 0;
-    // aes_cbc_encrypt(input, 16, iv, key, 24, &cipher, &cipher_len);
+    // aes_cbc_encrypt(input, 16, iv, key, 24, &cipher, &cipher_len, NULL);
     // print_byte_array(cipher, 32);
-    // aes_cbc_decrypt(cipher, 32, iv, key, 24, &plain, &plain_len);
+    // aes_cbc_decrypt(cipher, 32, iv, key, 24, &plain, &plain_len, NULL);
     // print_byte_array(plain, plain_len);
     // free(plain);
     // free(cipher);
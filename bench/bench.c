@@ -0,0 +1,204 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+
+#include "bench.h"
+#include "../utils/general.h"
+#include "../utils/cpu_features.h"
+#include "../utils/threadpool.h"
+
+// The time the time stamp counter is calibrated against the monotonic clock;
+#define BENCH_CALIBRATION_NS 50000000ULL
+#define BENCH_MAX_CPU_MODEL 128
+
+static uint64_t bench_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t bench_cycles(void) {
+#ifdef BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static int bench_compare(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t bench_percentile(const uint64_t* sorted, size_t count, size_t percent) {
+    return sorted[(count - 1) * percent / 100];
+}
+
+// Writes a JSON string (null for NULL), escaping what JSON does not allow inside one;
+static void bench_json_string(FILE* output, const char* text) {
+    if (text == NULL) {
+        fputs("null", output);
+        return;
+    }
+    fputc('"', output);
+    for (; *text != '\0'; text++) {
+        if ((*text == '"') || (*text == '\\')) {
+            fputc('\\', output);
+            fputc(*text, output);
+        } else if ((unsigned char)*text < 0x20) {
+            fprintf(output, "\\u%04x", (unsigned char)*text);
+        } else {
+            fputc(*text, output);
+        }
+    }
+    fputc('"', output);
+}
+
+static void bench_cpu_model(char* model, size_t model_len) {
+    char line[256];
+    char* value = NULL;
+    FILE* cpuinfo = fopen("/proc/cpuinfo", "r");
+    snprintf(model, model_len, "unknown");
+    if (cpuinfo == NULL) {
+        return;
+    }
+    while (fgets(line, sizeof line, cpuinfo) != NULL) {
+        if ((strncmp(line, "model name", 10) == 0) && ((value = strchr(line, ':')) != NULL)) {
+            value += strspn(value, ": \t");
+            value[strcspn(value, "\n")] = '\0';
+            snprintf(model, model_len, "%s", value);
+            break;
+        }
+    }
+    fclose(cpuinfo);
+}
+
+static void bench_pin(bench_session* session, int cpu) {
+    cpu_set_t set;
+    session->cpu = -1;
+    if (cpu < 0) {
+        return;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof set, &set) != 0) {
+        fprintf(stderr, "Could not pin to CPU %d, running unpinned\n", cpu);
+        return;
+    }
+    session->cpu = cpu;
+}
+
+static double bench_calibrate(void) {
+    uint64_t start_ns = bench_now(), start_cycles = bench_cycles();
+    uint64_t end_ns = start_ns;
+    while (end_ns - start_ns < BENCH_CALIBRATION_NS) {
+        end_ns = bench_now();
+    }
+    return (double)(bench_cycles() - start_cycles) / (double)(end_ns - start_ns);
+}
+
+// The modules with several backends, the ones not linked in are left out of the meta data;
+static const char* const bench_modules[] = { "hex", "endian", "aes", "sha256", "chaos", "lorenz" };
+
+static void bench_backends(FILE* output) {
+    const char* backend = NULL;
+    const char* separator = "";
+    fprintf(output, ", \"backends\": {");
+    for (size_t i = 0; i < sizeof bench_modules / sizeof bench_modules[0]; i++) {
+        backend = cpu_backend_active(bench_modules[i]);
+        if (backend != NULL) {
+            fprintf(output, "%s\"%s\": ", separator, bench_modules[i]);
+            bench_json_string(output, backend);
+            separator = ", ";
+        }
+    }
+    fprintf(output, "}");
+}
+
+void bench_open(bench_session* session, FILE* output, const char* label, const char* filter, int cpu) {
+    char model[BENCH_MAX_CPU_MODEL];
+    memset(session, 0, sizeof *session);
+    session->output = output;
+    session->filter = filter;
+    session->ns_samples = safe_malloc(BENCH_MAX_SAMPLES * sizeof *session->ns_samples);
+    session->cycle_samples = safe_malloc(BENCH_MAX_SAMPLES * sizeof *session->cycle_samples);
+    // The pool is started before the measuring thread is pinned, so its workers keep every CPU;
+    threadpool_start();
+    bench_pin(session, cpu);
+    session->tsc_per_ns = bench_calibrate();
+    bench_cpu_model(model, sizeof model);
+    fprintf(output, "{\n  \"meta\": {\"label\": ");
+    bench_json_string(output, label);
+    fprintf(output, ", \"cpu_model\": ");
+    bench_json_string(output, model);
+    bench_backends(output);
+    fprintf(output, ", \"pinned_cpu\": %d, \"threads\": %zu, \"tsc_ghz\": %.4f, \"timestamp\": %lld},\n  \"results\": [",
+        session->cpu, threadpool_size(), session->tsc_per_ns, (long long)time(NULL));
+}
+
+int bench_enabled(const bench_session* session, const char* name) {
+    return (session->filter == NULL) || (strstr(name, session->filter) != NULL);
+}
+
+void bench_run(bench_session* session, const char* name, size_t bytes, bench_fn fn, void* context) {
+    uint64_t start = 0, ns = 0, cycles = 0, total_ns = 0, mallocs = 0;
+    size_t count = 0;
+    double ops_per_sec = 0.0;
+    if (!bench_enabled(session, name)) {
+        return;
+    }
+    // Warm the caches, branch predictors and allocator up with at least one call;
+    start = bench_now();
+    do {
+        fn(context, bytes);
+    } while (bench_now() - start < BENCH_WARMUP_NS);
+    // Count the heap allocations of the sampled calls, a steady state should make none;
+    mallocs = safe_malloc_count();
+    while ((count < BENCH_MAX_SAMPLES) && ((count < BENCH_MIN_SAMPLES) || (total_ns < BENCH_TARGET_NS))) {
+        ns = bench_now();
+        cycles = bench_cycles();
+        fn(context, bytes);
+        cycles = bench_cycles() - cycles;
+        ns = bench_now() - ns;
+        session->ns_samples[count] = ns;
+        session->cycle_samples[count++] = cycles;
+        total_ns += ns;
+    }
+    mallocs = safe_malloc_count() - mallocs;
+    qsort(session->ns_samples, count, sizeof *session->ns_samples, bench_compare);
+    qsort(session->cycle_samples, count, sizeof *session->cycle_samples, bench_compare);
+    ops_per_sec = (double)count / ((double)total_ns * 1e-9);
+    fprintf(session->output, "%s\n    {\"name\": ", (session->nr_results++ > 0) ? "," : "");
+    bench_json_string(session->output, name);
+    fprintf(session->output, ", \"bytes\": %zu, \"samples\": %zu, \"ops_per_sec\": %.3f, ", bytes, count, ops_per_sec);
+    if (bytes > 0) {
+        fprintf(session->output, "\"mb_per_sec\": %.3f, \"cycles_per_byte\": %.3f, ", ops_per_sec * (double)bytes / 1e6,
+            (double)bench_percentile(session->cycle_samples, count, 50) / (double)bytes);
+    } else {
+        fprintf(session->output, "\"mb_per_sec\": null, \"cycles_per_byte\": null, ");
+    }
+    fprintf(session->output, "\"ns\": {\"min\": %llu, \"p50\": %llu, \"p99\": %llu, \"mean\": %.1f}, ",
+        (unsigned long long)session->ns_samples[0], (unsigned long long)bench_percentile(session->ns_samples, count, 50),
+        (unsigned long long)bench_percentile(session->ns_samples, count, 99), (double)total_ns / (double)count);
+    fprintf(session->output, "\"cycles\": {\"p50\": %llu, \"p99\": %llu}, \"mallocs_per_op\": %.3f}",
+        (unsigned long long)bench_percentile(session->cycle_samples, count, 50),
+        (unsigned long long)bench_percentile(session->cycle_samples, count, 99), (double)mallocs / (double)count);
+    fflush(session->output);
+    fprintf(stderr, "%-28s %10zu B %8zu samples  p50 %12llu ns  p99 %12llu ns  %12.1f ops/s  %8.2f mallocs/op\n", name,
+        bytes, count, (unsigned long long)bench_percentile(session->ns_samples, count, 50),
+        (unsigned long long)bench_percentile(session->ns_samples, count, 99), ops_per_sec, (double)mallocs / (double)count);
+}
+
+void bench_close(bench_session* session) {
+    fprintf(session->output, "\n  ]\n}\n");
+    fflush(session->output);
+    free(session->ns_samples);
+    free(session->cycle_samples);
+}
\ No newline at end of file
@@ -0,0 +1,78 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   This file implements the timing harness behind the benchmark suite.
+ * @details Every case is warmed up, then called repeatedly with each call timed on its own
+ *          with clock_gettime() and the time stamp counter. The results (ops/s, MB/s,
+ *          cycles/byte, the p50/p99 latencies and the heap allocations per call made through
+ *          safe_malloc()) are written as one JSON document, so runs can be diffed between
+ *          commits, while a readable line per case goes to stderr.
+ *          Only the measuring thread is pinned to one CPU. The thread pool is started before,
+ *          so the parallel paths keep running on every CPU the process may use.
+ * @author  Murea Cosmin Alexandru
+ * @date    01.03.2024
+ * ---------------------------------------------------------------------------------------- **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+// The time spent on warm-up calls before the first sample of a case;
+#define BENCH_WARMUP_NS 50000000ULL
+// Samples are taken until a case has run for this long (and at least BENCH_MIN_SAMPLES times);
+#define BENCH_TARGET_NS 500000000ULL
+#define BENCH_MIN_SAMPLES 3
+#define BENCH_MAX_SAMPLES 100000
+
+// Measured calls receive the context of the case and the message size in bytes (0 if none);
+typedef void (*bench_fn)(void* context, size_t bytes);
+
+typedef struct {
+    FILE* output;
+    // Only cases whose name contains the filter are run (NULL runs everything);
+    const char* filter;
+    // The CPU the session is pinned to (-1 if it is not pinned);
+    int cpu;
+    double tsc_per_ns;
+    size_t nr_results;
+    uint64_t* ns_samples;
+    uint64_t* cycle_samples;
+} bench_session;
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Starts the thread pool, pins the calling thread, calibrates the time stamp counter
+ *          and starts the JSON.
+ * @param   session     A pointer to the session to initialise.
+ * @param   output      The stream that receives the JSON document.
+ * @param   label       A label stored with the results, e.g. a commit hash (can be NULL).
+ * @param   filter      A substring the names of the cases to run must contain (can be NULL).
+ * @param   cpu         The CPU to pin to, or -1 to leave the thread unpinned.
+ * ---------------------------------------------------------------------------------------- **/
+void bench_open(bench_session* session, FILE* output, const char* label, const char* filter, int cpu);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Checks whether a case passes the filter, so expensive set-up can be skipped.
+ * @param   session     A pointer to the session.
+ * @param   name        The name of the case.
+ * @returns 1 if the case would run, 0 otherwise.
+ * ---------------------------------------------------------------------------------------- **/
+int bench_enabled(const bench_session* session, const char* name);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Measures one case and appends its result to the JSON document.
+ * @param   session     A pointer to the session.
+ * @param   name        The name of the case, e.g. "sha256".
+ * @param   bytes       The number of bytes processed per call (0 for fixed-size operations).
+ * @param   fn          The function to measure.
+ * @param   context     The context passed to every call.
+ * ---------------------------------------------------------------------------------------- **/
+void bench_run(bench_session* session, const char* name, size_t bytes, bench_fn fn, void* context);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Ends the JSON document and frees the memory held by a session.
+ * @param   session     A pointer to the session.
+ * ---------------------------------------------------------------------------------------- **/
+void bench_close(bench_session* session);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,441 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <fcntl.h>
+
+#include "bench.h"
+#include "../aes/aes.h"
+#include "../sha256/sha256.h"
+#include "../chaos/chaos.h"
+#include "../rsa/rsa.h"
+#include "../utils/general.h"
+#include "../utils/arena.h"
+#include "../utils/pool.h"
+#include "../utils/seed.h"
+#include "../utils/stats.h"
+#include "../utils/endian.h"
+
+#define BENCH_MIN_BYTES 16
+#define BENCH_MAX_BYTES (64 << 20)
+// generate_entropy() runs three chaotic maps per output bit => stop at a size that still ends;
+#define BENCH_ENTROPY_MAX_BYTES (1 << 20)
+// shannon_entropy() counts frequencies pairwise in stack arrays of the sample size => quadratic;
+#define BENCH_SHANNON_MAX_BYTES (16 << 10)
+#define BENCH_SWEEP_LEN 1024
+#define BENCH_RSA_MESSAGE_LEN 32
+#define BENCH_MAX_NAME 64
+// The allocator cases make this many allocations of BENCH_ALLOC_SIZE bytes per call;
+#define BENCH_ALLOC_COUNT 1024
+#define BENCH_ALLOC_SIZE 64
+
+typedef struct {
+    uint8_t key[AES_KEY_SIZE_256];
+    uint8_t key_size;
+    uint8_t iv[AES_BLOCK_SIZE];
+    uint8_t* plain;
+    // The output of the last encryption, which the decryption cases read back;
+    uint8_t* cipher;
+    size_t cipher_len;
+    size_t cipher_plain_len;
+    // Every call resets its arena => the outputs stop costing a malloc() after the warm-up;
+    arena encrypt_arena;
+    arena decrypt_arena;
+} aes_bench;
+
+typedef struct {
+    uint8_t* data;
+    arena arena;
+} hash_bench;
+
+typedef struct {
+    const uint8_t* data;
+    uint32_t* words;
+} endian_bench;
+
+typedef struct {
+    arena arena;
+    pool pool;
+    void* objects[BENCH_ALLOC_COUNT];
+} alloc_bench;
+
+typedef struct {
+    rsa_private_key private_key;
+    rsa_public_key public_key;
+    size_t bits;
+    size_t k;
+    uint8_t* plain;
+    uint8_t* cipher;
+    uint8_t* oaep_cipher;
+    uint8_t* signature;
+    uint8_t* output;
+    uint8_t message[BENCH_RSA_MESSAGE_LEN];
+} rsa_bench;
+
+// Keeps results alive so no call can be optimised away;
+static volatile double bench_sink = 0.0;
+
+static void bench_aes_encrypt(void* context, size_t bytes) {
+    aes_bench* bench = context;
+    arena_reset(&bench->encrypt_arena);
+    aes_cbc_encrypt(bench->plain, bytes, bench->iv, bench->key, bench->key_size, &bench->cipher, &bench->cipher_len,
+        &bench->encrypt_arena);
+    bench->cipher_plain_len = bytes;
+}
+
+static void bench_aes_decrypt(void* context, size_t bytes) {
+    aes_bench* bench = context;
+    uint8_t* plain = NULL;
+    size_t plain_len = 0;
+    arena_reset(&bench->decrypt_arena);
+    aes_cbc_decrypt(bench->cipher, bench->cipher_len, bench->iv, bench->key, bench->key_size, &plain, &plain_len,
+        &bench->decrypt_arena);
+}
+
+static void bench_sha256(void* context, size_t bytes) {
+    hash_bench* bench = context;
+    uint8_t* digest = NULL;
+    arena_reset(&bench->arena);
+    sha256(bench->data, bytes, &digest, &bench->arena);
+}
+
+static void bench_load_be32(void* context, size_t bytes) {
+    endian_bench* bench = context;
+    endian_load_be32_array(bench->words, bench->data, bytes / sizeof(uint32_t));
+}
+
+static void bench_safe_malloc(void* context, size_t bytes) {
+    alloc_bench* bench = context;
+    for (size_t i = 0; i < BENCH_ALLOC_COUNT; i++) {
+        bench->objects[i] = safe_malloc(BENCH_ALLOC_SIZE);
+    }
+    for (size_t i = 0; i < BENCH_ALLOC_COUNT; i++) {
+        free(bench->objects[i]);
+    }
+}
+
+static void bench_arena_alloc(void* context, size_t bytes) {
+    alloc_bench* bench = context;
+    for (size_t i = 0; i < BENCH_ALLOC_COUNT; i++) {
+        bench->objects[i] = arena_alloc(&bench->arena, BENCH_ALLOC_SIZE);
+    }
+    arena_reset(&bench->arena);
+}
+
+static void bench_pool_get(void* context, size_t bytes) {
+    alloc_bench* bench = context;
+    for (size_t i = 0; i < BENCH_ALLOC_COUNT; i++) {
+        bench->objects[i] = pool_get(&bench->pool);
+    }
+    for (size_t i = 0; i < BENCH_ALLOC_COUNT; i++) {
+        pool_put(&bench->pool, bench->objects[i]);
+    }
+}
+
+static void bench_generate_entropy(void* context, size_t bytes) {
+    generate_entropy(context, bytes);
+}
+
+static void bench_shannon_entropy(void* context, size_t bytes) {
+    bench_sink = shannon_entropy(context, bytes);
+}
+
+static void bench_lm_lyapunov(void* context, size_t bytes) {
+    bench_sink = lm_lyapunov_exp(3.9);
+}
+
+static void bench_tent_lyapunov(void* context, size_t bytes) {
+    bench_sink = tent_lyapunov_exp(1.9);
+}
+
+static void bench_sine_lyapunov(void* context, size_t bytes) {
+    bench_sink = sine_lyapunov_exp(0.99);
+}
+
+static void bench_lm_sweep(void* context, size_t bytes) {
+    double exponents[BENCH_SWEEP_LEN];
+    lm_lyapunov_sweep(context, exponents, BENCH_SWEEP_LEN);
+    bench_sink = exponents[0];
+}
+
+static void bench_tent_sweep(void* context, size_t bytes) {
+    double exponents[BENCH_SWEEP_LEN];
+    tent_lyapunov_sweep(context, exponents, BENCH_SWEEP_LEN);
+    bench_sink = exponents[0];
+}
+
+static void bench_sine_sweep(void* context, size_t bytes) {
+    double exponents[BENCH_SWEEP_LEN];
+    sine_lyapunov_sweep(context, exponents, BENCH_SWEEP_LEN);
+    bench_sink = exponents[0];
+}
+
+static void bench_rsa_keygen(void* context, size_t bytes) {
+    rsa_bench* bench = context;
+    rsa_keygen(bench->bits, 65537, &bench->private_key);
+}
+
+static void bench_rsa_encrypt(void* context, size_t bytes) {
+    rsa_bench* bench = context;
+    rsa_encrypt_bytes(&bench->public_key, bench->plain, bench->k, bench->cipher);
+}
+
+static void bench_rsa_decrypt(void* context, size_t bytes) {
+    rsa_bench* bench = context;
+    rsa_decrypt_bytes(&bench->private_key, bench->cipher, bench->k, bench->output);
+}
+
+static void bench_rsa_oaep_encrypt(void* context, size_t bytes) {
+    rsa_bench* bench = context;
+    rsa_oaep_encrypt(&bench->public_key, bench->message, BENCH_RSA_MESSAGE_LEN, NULL, 0, bench->oaep_cipher);
+}
+
+static void bench_rsa_oaep_decrypt(void* context, size_t bytes) {
+    rsa_bench* bench = context;
+    size_t message_len = 0;
+    rsa_oaep_decrypt(&bench->private_key, bench->oaep_cipher, bench->k, NULL, 0, bench->output, &message_len);
+}
+
+static void bench_rsa_sign(void* context, size_t bytes) {
+    rsa_bench* bench = context;
+    rsa_pss_sign(&bench->private_key, bench->message, BENCH_RSA_MESSAGE_LEN, bench->signature);
+}
+
+static void bench_rsa_verify(void* context, size_t bytes) {
+    rsa_bench* bench = context;
+    bench_sink = rsa_pss_verify(&bench->public_key, bench->message, BENCH_RSA_MESSAGE_LEN, bench->signature, bench->k);
+}
+
+// shannon_entropy() prints every probability it computes => send stdout to /dev/null meanwhile;
+static int bench_silence_stdout(void) {
+    int saved = 0, null_fd = 0;
+    fflush(stdout);
+    saved = dup(STDOUT_FILENO);
+    null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+    return saved;
+}
+
+static void bench_restore_stdout(int saved) {
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+}
+
+static void aes_suite(bench_session* session, uint8_t* data, size_t max_bytes) {
+    const uint8_t key_sizes[] = { AES_KEY_SIZE_128, AES_KEY_SIZE_192, AES_KEY_SIZE_256 };
+    char name[BENCH_MAX_NAME];
+    aes_bench bench = { .plain = data };
+    arena_init(&bench.encrypt_arena, 0);
+    arena_init(&bench.decrypt_arena, 0);
+    seed_bytes("bench.aes", bench.key, sizeof bench.key);
+    seed_bytes("bench.aes", bench.iv, sizeof bench.iv);
+    for (size_t i = 0; i < sizeof key_sizes; i++) {
+        bench.key_size = key_sizes[i];
+        for (size_t bytes = BENCH_MIN_BYTES; bytes <= max_bytes; bytes *= 4) {
+            snprintf(name, sizeof name, "aes_cbc_encrypt/%d", 8 * key_sizes[i]);
+            bench_run(session, name, bytes, bench_aes_encrypt, &bench);
+            snprintf(name, sizeof name, "aes_cbc_decrypt/%d", 8 * key_sizes[i]);
+            if (!bench_enabled(session, name)) {
+                continue;
+            }
+            // The decryption needs a ciphertext of this size under this key;
+            if ((bench.cipher == NULL) || (bench.cipher_plain_len != bytes)) {
+                bench_aes_encrypt(&bench, bytes);
+            }
+            bench_run(session, name, bytes, bench_aes_decrypt, &bench);
+            // Never decrypt a ciphertext made under another key size;
+            bench.cipher_plain_len = 0;
+        }
+    }
+    arena_free(&bench.encrypt_arena);
+    arena_free(&bench.decrypt_arena);
+}
+
+static void hash_suite(bench_session* session, uint8_t* data, size_t max_bytes) {
+    hash_bench bench = { .data = data };
+    arena_init(&bench.arena, 0);
+    for (size_t bytes = BENCH_MIN_BYTES; bytes <= max_bytes; bytes *= 4) {
+        bench_run(session, "sha256", bytes, bench_sha256, &bench);
+    }
+    arena_free(&bench.arena);
+}
+
+// The sizes are multiples of 4 => whole words;
+static void endian_suite(bench_session* session, uint8_t* data, size_t max_bytes) {
+    endian_bench bench = { .data = data, .words = safe_malloc((max_bytes > BENCH_MIN_BYTES) ? max_bytes : BENCH_MIN_BYTES) };
+    for (size_t bytes = BENCH_MIN_BYTES; bytes <= max_bytes; bytes *= 4) {
+        bench_run(session, "endian_load_be32", bytes, bench_load_be32, &bench);
+    }
+    free(bench.words);
+}
+
+static void alloc_suite(bench_session* session) {
+    alloc_bench bench;
+    arena_init(&bench.arena, 0);
+    pool_init(&bench.pool, BENCH_ALLOC_SIZE, 0);
+    bench_run(session, "safe_malloc/64x1024", 0, bench_safe_malloc, &bench);
+    bench_run(session, "arena_alloc/64x1024", 0, bench_arena_alloc, &bench);
+    bench_run(session, "pool_get/64x1024", 0, bench_pool_get, &bench);
+    arena_free(&bench.arena);
+    pool_free(&bench.pool);
+}
+
+static void chaos_suite(bench_session* session, uint8_t* data, size_t max_bytes) {
+    double r_lm[BENCH_SWEEP_LEN], r_tent[BENCH_SWEEP_LEN], r_sine[BENCH_SWEEP_LEN];
+    for (size_t bytes = BENCH_MIN_BYTES; (bytes <= max_bytes) && (bytes <= BENCH_ENTROPY_MAX_BYTES); bytes *= 4) {
+        bench_run(session, "generate_entropy", bytes, bench_generate_entropy, data);
+    }
+    if (bench_enabled(session, "shannon_entropy")) {
+        int saved = bench_silence_stdout();
+        for (size_t bytes = BENCH_MIN_BYTES; (bytes <= max_bytes) && (bytes <= BENCH_SHANNON_MAX_BYTES); bytes *= 4) {
+            bench_run(session, "shannon_entropy", bytes, bench_shannon_entropy, data);
+        }
+        bench_restore_stdout(saved);
+    }
+    for (size_t i = 0; i < BENCH_SWEEP_LEN; i++) {
+        r_lm[i] = 3.5 + 0.5 * (double)i / (BENCH_SWEEP_LEN - 1);
+        r_tent[i] = 1.0 + 1.0 * (double)i / (BENCH_SWEEP_LEN - 1);
+        r_sine[i] = 0.5 + 0.5 * (double)i / (BENCH_SWEEP_LEN - 1);
+    }
+    bench_run(session, "lm_lyapunov_exp", 0, bench_lm_lyapunov, NULL);
+    bench_run(session, "tent_lyapunov_exp", 0, bench_tent_lyapunov, NULL);
+    bench_run(session, "sine_lyapunov_exp", 0, bench_sine_lyapunov, NULL);
+    bench_run(session, "lm_lyapunov_sweep/1024", 0, bench_lm_sweep, r_lm);
+    bench_run(session, "tent_lyapunov_sweep/1024", 0, bench_tent_sweep, r_tent);
+    bench_run(session, "sine_lyapunov_sweep/1024", 0, bench_sine_sweep, r_sine);
+}
+
+static void rsa_suite(bench_session* session) {
+    const size_t modulus_sizes[] = { 1024, 2048, 3072, 4096 };
+    char name[BENCH_MAX_NAME];
+    rsa_bench bench;
+    size_t message_len = 0;
+    for (size_t i = 0; i < sizeof modulus_sizes / sizeof modulus_sizes[0]; i++) {
+        rsa_private_key_init(&bench.private_key);
+        rsa_public_key_init(&bench.public_key);
+        bench.bits = modulus_sizes[i];
+        bench.k = (bench.bits + 7) / 8;
+        snprintf(name, sizeof name, "rsa_keygen/%zu", bench.bits);
+        if (bench_enabled(session, name)) {
+            bench_run(session, name, 0, bench_rsa_keygen, &bench);
+        } else {
+            bench_rsa_keygen(&bench, 0);
+        }
+        rsa_public_key_from_private(&bench.private_key, &bench.public_key);
+        bench.plain = safe_malloc(bench.k);
+        bench.cipher = safe_malloc(bench.k);
+        bench.oaep_cipher = safe_malloc(bench.k);
+        bench.signature = safe_malloc(bench.k);
+        bench.output = safe_malloc(bench.k);
+        // A representative with a zero top byte is always below n;
+        seed_bytes("bench.rsa", bench.plain, bench.k);
+        bench.plain[0] = 0;
+        seed_bytes("bench.rsa", bench.message, BENCH_RSA_MESSAGE_LEN);
+        rsa_encrypt_bytes(&bench.public_key, bench.plain, bench.k, bench.cipher);
+        rsa_oaep_encrypt(&bench.public_key, bench.message, BENCH_RSA_MESSAGE_LEN, NULL, 0, bench.oaep_cipher);
+        rsa_pss_sign(&bench.private_key, bench.message, BENCH_RSA_MESSAGE_LEN, bench.signature);
+        // Measure nothing if the key does not round trip;
+        if ((rsa_decrypt_bytes(&bench.private_key, bench.cipher, bench.k, bench.output) != 0) ||
+            (memcmp(bench.output, bench.plain, bench.k) != 0) ||
+            (rsa_oaep_decrypt(&bench.private_key, bench.oaep_cipher, bench.k, NULL, 0, bench.output, &message_len) != 0) ||
+            (rsa_pss_verify(&bench.public_key, bench.message, BENCH_RSA_MESSAGE_LEN, bench.signature, bench.k) != 0)) {
+            fprintf(stderr, "The %zu bit key does not round trip. Proceeding to crash. Cleaning up...", bench.bits);
+            exit(EXIT_FAILURE);
+        }
+        snprintf(name, sizeof name, "rsa_encrypt/%zu", bench.bits);
+        bench_run(session, name, 0, bench_rsa_encrypt, &bench);
+        snprintf(name, sizeof name, "rsa_decrypt/%zu", bench.bits);
+        bench_run(session, name, 0, bench_rsa_decrypt, &bench);
+        snprintf(name, sizeof name, "rsa_oaep_encrypt/%zu", bench.bits);
+        bench_run(session, name, 0, bench_rsa_oaep_encrypt, &bench);
+        snprintf(name, sizeof name, "rsa_oaep_decrypt/%zu", bench.bits);
+        bench_run(session, name, 0, bench_rsa_oaep_decrypt, &bench);
+        snprintf(name, sizeof name, "rsa_pss_sign/%zu", bench.bits);
+        bench_run(session, name, 0, bench_rsa_sign, &bench);
+        snprintf(name, sizeof name, "rsa_pss_verify/%zu", bench.bits);
+        bench_run(session, name, 0, bench_rsa_verify, &bench);
+        free(bench.plain);
+        free(bench.cipher);
+        free(bench.oaep_cipher);
+        free(bench.signature);
+        free(bench.output);
+        rsa_public_key_clear(&bench.public_key);
+        rsa_private_key_clear(&bench.private_key);
+    }
+}
+
+static int first_cpu(void) {
+    // The pool leaves the first CPU the process may use to the calling thread when it pins its workers;
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof allowed, &allowed) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                return cpu;
+            }
+        }
+    }
+    return sched_getcpu();
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [-f filter] [-m max bytes] [-c cpu, -1 to not pin] [-l label] [-o output.json]\n", program);
+}
+
+int main(int argc, char* argv[]) {
+    bench_session session;
+    stats_totals totals;
+    const char* filter = NULL;
+    const char* label = NULL;
+    FILE* output = NULL;
+    size_t max_bytes = BENCH_MAX_BYTES;
+    int cpu = first_cpu();
+    int option = 0;
+    uint8_t* data = NULL;
+    while ((option = getopt(argc, argv, "f:m:c:l:o:")) != -1) {
+        switch (option) {
+        case 'f':
+            filter = optarg;
+            break;
+        case 'm':
+            max_bytes = strtoull(optarg, NULL, 10);
+            break;
+        case 'c':
+            cpu = atoi(optarg);
+            break;
+        case 'l':
+            label = optarg;
+            break;
+        case 'o':
+            output = safe_fopen(optarg, "w");
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    // The JSON goes to its own copy of stdout, which is muted while shannon_entropy() runs;
+    if (output == NULL) {
+        output = fdopen(dup(STDOUT_FILENO), "w");
+    }
+    data = safe_malloc((max_bytes > BENCH_MIN_BYTES) ? max_bytes : BENCH_MIN_BYTES);
+    seed_bytes("bench.data", data, (max_bytes > BENCH_MIN_BYTES) ? max_bytes : BENCH_MIN_BYTES);
+    bench_open(&session, output, label, filter, cpu);
+    aes_suite(&session, data, max_bytes);
+    hash_suite(&session, data, max_bytes);
+    endian_suite(&session, data, max_bytes);
+    alloc_suite(&session);
+    chaos_suite(&session, data, max_bytes);
+    rsa_suite(&session);
+    bench_close(&session);
+    // Builds with the counters also report what the primitives did over the whole run;
+    if (stats_enabled()) {
+        stats_snapshot(&totals);
+        stats_print(stderr, &totals);
+    }
+    fclose(output);
+    free(data);
+    return 0;
+}
\ No newline at end of file
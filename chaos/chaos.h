@@ -9,6 +9,7 @@
  * ----------------------------------------------------------------------------------- **/
 
 #include <stdlib.h>
+#include <stdint.h>
 
 /** ---------------------------------------------------------------------------------------
  * @brief   Generate random bytes.
@@ -42,6 +43,30 @@ double tent_lyapunov_exp(double r);
  * ---------------------------------------------------------------------------------------- **/
 double sine_lyapunov_exp(double r);
 
-void lorenz_generator();
+/** ---------------------------------------------------------------------------------------
+ * @brief   Computes the Lyapunov exponents of the logistics map for an array of parameters.
+ * @details The parameters are evaluated in SIMD-sized lanes and the sweep is split across
+ *          all online CPUs. Every parameter is iterated from its own starting point.
+ * @param   r           An array of parameters, 0 <= r[i] <= 4.
+ * @param   exponents   An array of r_len elements to hold the computed exponents.
+ * @param   r_len       The number of parameters in the sweep.
+ * ---------------------------------------------------------------------------------------- **/
+void lm_lyapunov_sweep(const double* r, double* exponents, size_t r_len);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Computes the Lyapunov exponents of the tent map for an array of parameters.
+ * @param   r           An array of parameters, 0 <= r[i] <= 2.
+ * @param   exponents   An array of r_len elements to hold the computed exponents.
+ * @param   r_len       The number of parameters in the sweep.
+ * ---------------------------------------------------------------------------------------- **/
+void tent_lyapunov_sweep(const double* r, double* exponents, size_t r_len);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Computes the Lyapunov exponents of the sine map for an array of parameters.
+ * @param   r           An array of parameters, 0 <= r[i] <= 1.
+ * @param   exponents   An array of r_len elements to hold the computed exponents.
+ * @param   r_len       The number of parameters in the sweep.
+ * ---------------------------------------------------------------------------------------- **/
+void sine_lyapunov_sweep(const double* r, double* exponents, size_t r_len);
 
 #endif
\ No newline at end of file
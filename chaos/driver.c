@@ -1,5 +1,17 @@
 #include <stdio.h>
 #include "chaos.h"
+#include "lorenz.h"
+#include "../utils/general.h"
+
+#define SWEEP_LEN 10000
+#define LORENZ_BATCH 64
+#define ENSEMBLE_LEN 1024
+
+static void print_states(const lorenz_state* states, size_t count, void* context) {
+    for (size_t i = 0; i < count; i++) {
+        printf("Time = %lf, x = %.15f, y = %.15f, z = %.15f\n", states[i].t, states[i].x, states[i].y, states[i].z);
+    }
+}
 
 int main() {
     // uint8_t sample[100000];
@@ -15,6 +27,44 @@ int main() {
     // printf("The Lyapunov exponent of the logistics map for r = %f is %f \n", r_lm, lyap_lm);
     // printf("The Lyapunov exponent of the tent map for r = %f is %f \n", r_tent, lyap_tent);
     // printf("The Lyapunov exponent of the sine map for r = %f is %f \n", r_sine, lyap_sine);
-    lorenz_generator();
+    // Sweep the logistics map over r in [3.5, 4.0] for a Lyapunov plot;
+    static double r_sweep[SWEEP_LEN];
+    static double lyap_sweep[SWEEP_LEN];
+    for (size_t i = 0; i < SWEEP_LEN; i++) {
+        r_sweep[i] = 3.5 + 0.5 * (double)i / (SWEEP_LEN - 1);
+    }
+    lm_lyapunov_sweep(r_sweep, lyap_sweep, SWEEP_LEN);
+    for (size_t i = 0; i < SWEEP_LEN; i += SWEEP_LEN / 10) {
+        printf("The Lyapunov exponent of the logistics map for r = %f is %f \n", r_sweep[i], lyap_sweep[i]);
+    }
+    // Sample the Lorenz trajectory every 0.01 time units;
+    lorenz_engine engine;
+    lorenz_state states[LORENZ_BATCH];
+    lorenz_init(&engine);
+    engine.sample_interval = 0.01;
+    if (lorenz_set_sink(&engine, states, LORENZ_BATCH, print_states, NULL) != 0) {
+        fprintf(stderr, "Could not register the Lorenz sink. Proceeding to crash. Cleaning up...");
+        exit(EXIT_FAILURE);
+    }
+    lorenz_run(&engine);
+    // Extract bytes from the trajectory;
+    uint8_t lorenz_bytes[32];
+    lorenz_entropy(&engine, lorenz_bytes, 32);
+    print_byte_array(lorenz_bytes, 32);
+    // Advance an ensemble of perturbed trajectories and measure how far they drift apart;
+    lorenz_ensemble ensemble;
+    lorenz_state base = { 0.0, 1.0, 1.0, 1.0 };
+    lorenz_ensemble_init(&ensemble, ENSEMBLE_LEN);
+    lorenz_ensemble_perturb(&ensemble, &base, 1e-12);
+    for (double t = 5.0; t <= 20.0; t += 5.0) {
+        size_t steps = lorenz_ensemble_advance(&ensemble, t);
+        double min_x = ensemble.x[0], max_x = ensemble.x[0];
+        for (size_t i = 1; i < ENSEMBLE_LEN; i++) {
+            min_x = (ensemble.x[i] < min_x) ? ensemble.x[i] : min_x;
+            max_x = (ensemble.x[i] > max_x) ? ensemble.x[i] : max_x;
+        }
+        printf("Time = %lf, steps = %zu, spread of x = %.15f\n", t, steps, max_x - min_x);
+    }
+    lorenz_ensemble_free(&ensemble);
     return 0;
 }
\ No newline at end of file
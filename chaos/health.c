@@ -0,0 +1,138 @@
+#include <string.h>
+#include <math.h>
+
+#include "health.h"
+
+static uint32_t rct_cutoff(double min_entropy) {
+    // C = 1 + ceil(-log2(alpha) / H);
+    return 1 + (uint32_t)ceil(HEALTH_ALPHA_EXP / min_entropy);
+}
+
+static uint32_t apt_cutoff(double min_entropy) {
+    // C = 1 + CRITBINOM(W, 2^-H, 1 - alpha), the smallest k with P(X <= k) >= 1 - alpha;
+    double p = pow(2.0, -min_entropy);
+    double target = 1.0 - ldexp(1.0, -HEALTH_ALPHA_EXP);
+    double pmf = pow(1.0 - p, HEALTH_APT_WINDOW);
+    double cdf = pmf;
+    uint32_t k = 0;
+    while ((cdf < target) && (k < HEALTH_APT_WINDOW)) {
+        pmf *= (double)(HEALTH_APT_WINDOW - k) / (double)(k + 1) * p / (1.0 - p);
+        cdf += pmf;
+        k++;
+    }
+    return 1 + k;
+}
+
+void health_init(health_state* state, double min_entropy) {
+    memset(state, 0, sizeof *state);
+    state->min_entropy = min_entropy;
+    state->rct_cutoff = rct_cutoff(min_entropy);
+    state->apt_cutoff = apt_cutoff(min_entropy);
+}
+
+static size_t health_online(health_state* state, uint8_t byte) {
+    size_t failures = 0;
+    // Repetition count test: count consecutive identical samples;
+    if ((state->rct_count > 0) && (byte == state->rct_value)) {
+        state->rct_count++;
+        // Report every run once, when it reaches the cutoff;
+        if (state->rct_count == state->rct_cutoff) {
+            state->rct_failures++;
+            failures++;
+        }
+    } else {
+        state->rct_value = byte;
+        state->rct_count = 1;
+    }
+    // Adaptive proportion test: count the first sample of the window in the whole window;
+    if (state->apt_seen == 0) {
+        state->apt_value = byte;
+        state->apt_count = 1;
+    } else if (byte == state->apt_value) {
+        state->apt_count++;
+        if (state->apt_count == state->apt_cutoff) {
+            state->apt_failures++;
+            failures++;
+        }
+    }
+    state->apt_seen = (state->apt_seen + 1 == HEALTH_APT_WINDOW) ? 0 : state->apt_seen + 1;
+    return failures;
+}
+
+size_t health_check(health_state* state, const uint8_t* bytes, size_t bytes_len) {
+    size_t failures = 0;
+    for (size_t i = 0; i < bytes_len; i++) {
+        failures += health_online(state, bytes[i]);
+    }
+    return failures;
+}
+
+size_t health_test(health_state* state, const uint8_t* bytes, size_t bytes_len) {
+    size_t failures = 0;
+    uint8_t byte = 0;
+    uint8_t previous = state->last_byte;
+    if ((bytes_len > 0) && (state->bytes == 0)) {
+        state->first_byte = bytes[0];
+    }
+    for (size_t i = 0; i < bytes_len; i++) {
+        byte = bytes[i];
+        failures += health_online(state, byte);
+        state->histogram[byte]++;
+        state->ones += __builtin_popcount(byte);
+        // Bit transitions inside the byte (MSB first) and between the previous byte and this one;
+        state->transitions += __builtin_popcount((byte ^ (byte >> 1)) & 0x7F);
+        if (state->bytes + i > 0) {
+            state->transitions += (previous ^ (byte >> 7)) & 1;
+            state->sum_products += (double)previous * byte;
+        }
+        state->sum += byte;
+        state->sum_squares += (double)byte * byte;
+        previous = byte;
+    }
+    state->bytes += bytes_len;
+    state->last_byte = previous;
+    return failures;
+}
+
+static double chi_square_p(double chi_square, double dof) {
+    // Wilson-Hilferty approximation of the chi-square distribution by a normal distribution;
+    double z = (cbrt(chi_square / dof) - (1.0 - 2.0 / (9.0 * dof))) / sqrt(2.0 / (9.0 * dof));
+    return 0.5 * erfc(z / M_SQRT2);
+}
+
+void health_summary(const health_state* state, health_report* report) {
+    double n = (double)state->bytes;
+    double bits = n * 8.0;
+    double pi = 0.0;
+    double expected = n / 256.0;
+    double prob = 0.0;
+    double numerator = 0.0;
+    double denominator = 0.0;
+    memset(report, 0, sizeof *report);
+    report->bytes = state->bytes;
+    report->rct_failures = state->rct_failures;
+    report->apt_failures = state->apt_failures;
+    if (state->bytes == 0) {
+        return;
+    }
+    // Shannon entropy and chi-square statistic of the byte distribution;
+    for (size_t i = 0; i < 256; i++) {
+        if (state->histogram[i] != 0) {
+            prob = (double)state->histogram[i] / n;
+            report->entropy -= prob * log2(prob);
+        }
+        report->chi_square += ((double)state->histogram[i] - expected) * ((double)state->histogram[i] - expected) / expected;
+    }
+    report->chi_square_p = chi_square_p(report->chi_square, 255.0);
+    // Frequency (monobit) test from NIST SP 800-22;
+    report->monobit_p = erfc(fabs(2.0 * (double)state->ones - bits) / sqrt(bits) / M_SQRT2);
+    // Runs test from NIST SP 800-22 (only meaningful if the monobit prerequisite holds);
+    pi = (double)state->ones / bits;
+    if (fabs(pi - 0.5) < 2.0 / sqrt(bits)) {
+        report->runs_p = erfc(fabs((double)state->transitions + 1.0 - 2.0 * bits * pi * (1.0 - pi)) / (2.0 * sqrt(2.0 * bits) * pi * (1.0 - pi)));
+    }
+    // Serial correlation coefficient of consecutive bytes (the last byte wraps around to the first);
+    numerator = n * (state->sum_products + (double)state->last_byte * state->first_byte) - state->sum * state->sum;
+    denominator = n * state->sum_squares - state->sum * state->sum;
+    report->serial_correlation = (denominator != 0.0) ? numerator / denominator : 1.0;
+}
\ No newline at end of file
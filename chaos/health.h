@@ -0,0 +1,93 @@
+#ifndef HEALTH_H
+#define HEALTH_H
+
+/** ----------------------------------------------------------------------------------
+ * @brief   The functions defined in this file test the output of the entropy sources.
+ * @details The repetition count and adaptive proportion tests follow NIST SP 800-90B and
+ *          run online over the byte stream. The monobit, runs, chi-square and serial
+ *          correlation statistics are accumulated over the stream and reported on demand.
+ * @author  Murea Cosmin Alexandru
+ * @date    01.03.2024
+ * ----------------------------------------------------------------------------------- **/
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// The window size of the adaptive proportion test for non-binary (byte) samples;
+#define HEALTH_APT_WINDOW 512
+// The false positive probability of the health tests is 2^-HEALTH_ALPHA_EXP;
+#define HEALTH_ALPHA_EXP 20
+
+typedef struct {
+    // The claimed min-entropy per byte and the cutoffs derived from it;
+    double min_entropy;
+    uint32_t rct_cutoff;
+    uint32_t apt_cutoff;
+    // The state of the repetition count test;
+    uint8_t rct_value;
+    uint32_t rct_count;
+    // The state of the adaptive proportion test;
+    uint8_t apt_value;
+    uint32_t apt_count;
+    uint32_t apt_seen;
+    uint64_t rct_failures;
+    uint64_t apt_failures;
+    // The statistics accumulated by health_test();
+    uint64_t bytes;
+    uint64_t ones;
+    uint64_t transitions;
+    uint64_t histogram[256];
+    uint8_t first_byte;
+    uint8_t last_byte;
+    double sum;
+    double sum_squares;
+    double sum_products;
+} health_state;
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t rct_failures;
+    uint64_t apt_failures;
+    // The Shannon entropy of the byte distribution in bits per byte;
+    double entropy;
+    double monobit_p;
+    double runs_p;
+    double chi_square;
+    double chi_square_p;
+    double serial_correlation;
+} health_report;
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Initialises the health tests for a source with the given min-entropy.
+ * @param   state       A pointer to the state to initialise.
+ * @param   min_entropy The claimed min-entropy per byte, 0 < min_entropy <= 8.
+ * ---------------------------------------------------------------------------------------- **/
+void health_init(health_state* state, double min_entropy);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Runs the continuous repetition count and adaptive proportion tests.
+ * @details Only the online tests are run, which costs a few operations per byte.
+ * @param   state       A pointer to the health test state.
+ * @param   bytes       A pointer to the next block of output.
+ * @param   bytes_len   The length of the block in bytes.
+ * @returns The number of failures detected in this block (0 if the source is healthy).
+ * ---------------------------------------------------------------------------------------- **/
+size_t health_check(health_state* state, const uint8_t* bytes, size_t bytes_len);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Runs the continuous tests and accumulates the statistical tests over a block.
+ * @param   state       A pointer to the health test state.
+ * @param   bytes       A pointer to the next block of output.
+ * @param   bytes_len   The length of the block in bytes.
+ * @returns The number of continuous test failures detected in this block.
+ * ---------------------------------------------------------------------------------------- **/
+size_t health_test(health_state* state, const uint8_t* bytes, size_t bytes_len);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Computes the statistics accumulated by health_test() so far.
+ * @param   state       A pointer to the health test state.
+ * @param   report      A pointer to the report to fill.
+ * ---------------------------------------------------------------------------------------- **/
+void health_summary(const health_state* state, health_report* report);
+
+#endif
\ No newline at end of file
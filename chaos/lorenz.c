@@ -0,0 +1,519 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+// For splitting the ensemble across threads;
+
+#include "lorenz.h"
+#include "../utils/general.h"
+#include "../utils/cpu_features.h"
+#include "../utils/stats.h"
+#include "../utils/threadpool.h"
+
+// The number of states buffered internally while extracting entropy;
+#define LORENZ_ENTROPY_BATCH 256
+// Bounds for the step size scale factor after each attempt;
+#define LORENZ_MIN_SCALE 0.1
+#define LORENZ_MAX_SCALE 4.0
+// A lane that still misses the tolerance with a step this short is given up on;
+#define LORENZ_MIN_STEP 1e-12
+// The minimum number of lane blocks worth handing to another thread;
+#define LORENZ_MIN_BLOCKS_PER_THREAD 4
+// The alignment of the ensemble arrays (one cache line);
+#define LORENZ_ALIGNMENT 64
+
+typedef struct {
+    uint8_t* bytes;
+    size_t bytes_len;
+    size_t written;
+} lorenz_extractor;
+
+typedef struct {
+    // Advances LORENZ_LANES trajectories to t_end, returns the number of accepted steps;
+    size_t (*lanes_advance)(const lorenz_ensemble* ensemble, double* x, double* y, double* z, double* t, double* dt, double t_end);
+} lorenz_ops;
+
+typedef struct {
+    lorenz_ensemble* ensemble;
+    double t_end;
+    // The accepted steps summed over the ranges;
+    size_t steps;
+} lorenz_ensemble_job;
+
+// Coefficients for slope estimation A(i,j);
+static const double a21 = 1.0 / 4.0;
+static const double a31 = 3.0 / 32.0;
+static const double a32 = 9.0 / 32.0;
+static const double a41 = 1932.0 / 2197.0;
+static const double a42 = -7200.0 / 2197.0;
+static const double a43 = 7296.0 / 2197.0;
+static const double a51 = 439.0 / 216.0;
+static const double a52 = -8.0;
+static const double a53 = 3680.0 / 513.0;
+static const double a54 = -845.0 / 4104.0;
+static const double a61 = -8.0 / 27.0;
+static const double a62 = 2.0;
+static const double a63 = -3544.0 / 2565.0;
+static const double a64 = 1859.0 / 4104.0;
+static const double a65 = -11.0 / 40.0;
+// The weights used in determining the 5th order estimates;
+static const double b1 = 16.0 / 135.0;
+static const double b3 = 6656.0 / 12825.0;
+static const double b4 = 28561.0 / 56430.0;
+static const double b5 = -9.0 / 50.0;
+static const double b6 = 2.0 / 55.0;
+// The coefficients used for computing the local truncation error for each variable;
+// In this case, the final coefficients are c_i = b_i - b'_i where b'_i are the 4th order coefficients;
+static const double c1 = 1.0 / 360.0;
+static const double c3 = -128.0 / 4275.0;
+static const double c4 = -2197.0 / 75240.0;
+static const double c5 = 1.0 / 50.0;
+static const double c6 = 2.0 / 55.0;
+
+static void lorenz_system(const lorenz_engine* engine, const double* s, double* ds) {
+    // Compute the derivatives at the given values;
+    ds[0] = engine->sigma * (s[1] - s[0]);
+    ds[1] = s[0] * (engine->rho - s[2]) - s[1];
+    ds[2] = s[0] * s[1] - engine->beta * s[2];
+}
+
+static double runge_kutta_fehlberg_45(const lorenz_engine* engine, const double* s, const double* k1, double dt, double* next) {
+    // The first slope is the derivative at s, computed once per accepted step by the caller;
+    double k2[3], k3[3], k4[3], k5[3], k6[3];
+    double temp[3];
+    double error[3];
+
+    // Compute the remaining 5 intermediate slopes for each variable;
+    for (size_t i = 0; i < 3; i++) {
+        temp[i] = s[i] + dt * a21 * k1[i];
+    }
+    lorenz_system(engine, temp, k2);
+    for (size_t i = 0; i < 3; i++) {
+        temp[i] = s[i] + dt * (a31 * k1[i] + a32 * k2[i]);
+    }
+    lorenz_system(engine, temp, k3);
+    for (size_t i = 0; i < 3; i++) {
+        temp[i] = s[i] + dt * (a41 * k1[i] + a42 * k2[i] + a43 * k3[i]);
+    }
+    lorenz_system(engine, temp, k4);
+    for (size_t i = 0; i < 3; i++) {
+        temp[i] = s[i] + dt * (a51 * k1[i] + a52 * k2[i] + a53 * k3[i] + a54 * k4[i]);
+    }
+    lorenz_system(engine, temp, k5);
+    for (size_t i = 0; i < 3; i++) {
+        temp[i] = s[i] + dt * (a61 * k1[i] + a62 * k2[i] + a63 * k3[i] + a64 * k4[i] + a65 * k5[i]);
+    }
+    lorenz_system(engine, temp, k6);
+
+    // Compute the new value using the 5th order estimate;
+    // The error is TE = (1 / dt) * | w - w' | where w is the 5th order value and w' is the 4th order value;
+    for (size_t i = 0; i < 3; i++) {
+        next[i] = s[i] + dt * (b1 * k1[i] + b3 * k3[i] + b4 * k4[i] + b5 * k5[i] + b6 * k6[i]);
+        error[i] = fabs(c1 * k1[i] + c3 * k3[i] + c4 * k4[i] + c5 * k5[i] + c6 * k6[i]);
+    }
+
+    // Compute the error using the Euclidean vector norm;
+    return sqrt(error[0] * error[0] + error[1] * error[1] + error[2] * error[2]);
+}
+
+static void hermite(const double* s0, const double* f0, const double* s1, const double* f1, double dt, double theta, double* s) {
+    // Cubic Hermite interpolation between two accepted states using the slopes at both ends;
+    double theta2 = theta * theta;
+    double theta3 = theta2 * theta;
+    double h00 = 2 * theta3 - 3 * theta2 + 1;
+    double h10 = theta3 - 2 * theta2 + theta;
+    double h01 = -2 * theta3 + 3 * theta2;
+    double h11 = theta3 - theta2;
+    for (size_t i = 0; i < 3; i++) {
+        s[i] = h00 * s0[i] + h10 * dt * f0[i] + h01 * s1[i] + h11 * dt * f1[i];
+    }
+}
+
+static void lorenz_emit(lorenz_engine* engine, double t, const double* s) {
+    lorenz_state* state = &engine->buffer[engine->buffered++];
+    state->t = t;
+    state->x = s[0];
+    state->y = s[1];
+    state->z = s[2];
+    // Hand the full buffer to the sink and start over;
+    if ((engine->buffered == engine->buffer_len) && (engine->sink != NULL)) {
+        engine->sink(engine->buffer, engine->buffered, engine->context);
+        engine->buffered = 0;
+    }
+}
+
+static uint8_t lorenz_full(const lorenz_engine* engine) {
+    return (engine->sink == NULL) && (engine->buffered == engine->buffer_len);
+}
+
+static void lorenz_sample_start(lorenz_engine* engine) {
+    // Restart the sampling clock if the state was moved past the next sample point;
+    if (engine->next_sample <= engine->state.t) {
+        engine->sample_origin = engine->state.t;
+        engine->sample_index = 1;
+        engine->next_sample = engine->state.t + engine->sample_interval;
+    }
+}
+
+static size_t lorenz_step(lorenz_engine* engine, double t_end) {
+    double s0[3] = { engine->state.x, engine->state.y, engine->state.z };
+    double s1[3], f1[3], sample[3];
+    double t0 = engine->state.t;
+    double t_sample = t0;
+    double dt = 0.0;
+    double loc_trunc_err = 0.0;
+    double scale_factor = 0.0;
+    size_t emitted = 0;
+    if (!engine->slope_valid) {
+        lorenz_system(engine, s0, engine->slope);
+        engine->slope_valid = 1;
+    }
+    // Retry with a smaller step until the error is acceptable;
+    // The slope at s0 does not depend on the step size and is reused by every attempt;
+    do {
+        dt = (engine->dt < t_end - t0) ? engine->dt : t_end - t0;
+        loc_trunc_err = runge_kutta_fehlberg_45(engine, s0, engine->slope, dt, s1);
+        // Compute the scale factor based on the obtained error;
+        // Let s = 0.84 * (tolerance / local_truncation_error)^(1/4);
+        if (loc_trunc_err > 0.0) {
+            scale_factor = 0.84 * sqrt(sqrt(engine->tolerance / loc_trunc_err));
+        } else {
+            scale_factor = LORENZ_MAX_SCALE;
+        }
+        scale_factor = fmin(fmax(scale_factor, LORENZ_MIN_SCALE), LORENZ_MAX_SCALE);
+        // A step shortened to land on t_end says nothing about the regular step size;
+        if ((loc_trunc_err >= engine->tolerance) || (dt == engine->dt)) {
+            engine->dt = dt * scale_factor;
+        }
+    } while (loc_trunc_err >= engine->tolerance);
+    // The slope at the new state is the first slope of the next step;
+    lorenz_system(engine, s1, f1);
+    if (engine->sample_interval > 0.0) {
+        // Emit every sample point inside the step using dense output;
+        while ((engine->next_sample <= t0 + dt) && !lorenz_full(engine)) {
+            hermite(s0, engine->slope, s1, f1, dt, (engine->next_sample - t0) / dt, sample);
+            lorenz_emit(engine, engine->next_sample, sample);
+            t_sample = engine->next_sample;
+            engine->next_sample = engine->sample_origin + (double)(++engine->sample_index) * engine->sample_interval;
+            emitted++;
+        }
+        // The buffer filled up before the end of the step => stop at the last sample, so the next run
+        // carries on with the following point of the same grid instead of skipping the rest;
+        if (engine->next_sample <= t0 + dt) {
+            if (emitted == 0) {
+                return 0;
+            }
+            dt = t_sample - t0;
+            runge_kutta_fehlberg_45(engine, s0, engine->slope, dt, s1);
+            lorenz_system(engine, s1, f1);
+        }
+    } else {
+        lorenz_emit(engine, t0 + dt, s1);
+        emitted++;
+    }
+    engine->state.t = t0 + dt;
+    engine->state.x = s1[0];
+    engine->state.y = s1[1];
+    engine->state.z = s1[2];
+    memcpy(engine->slope, f1, sizeof engine->slope);
+    return emitted;
+}
+
+void lorenz_init(lorenz_engine* engine) {
+    memset(engine, 0, sizeof *engine);
+    engine->sigma = 10.0;
+    engine->rho = 28.0;
+    engine->beta = 8.0 / 3.0;
+    // The smaller the tolerance the more accurate the results (but more intensive comp.);
+    engine->tolerance = 1e-7;
+    engine->duration = 1.0;
+    engine->dt = 0.01;
+    engine->state.x = 1.0;
+    engine->state.y = 1.0;
+    engine->state.z = 1.0;
+}
+
+int lorenz_set_sink(lorenz_engine* engine, lorenz_state* buffer, size_t buffer_len, lorenz_sink sink, void* context) {
+    // An empty buffer is never full, so the states would be written past its end;
+    if ((buffer == NULL) || (buffer_len == 0)) {
+        return -1;
+    }
+    engine->buffer = buffer;
+    engine->buffer_len = buffer_len;
+    engine->buffered = 0;
+    engine->sink = sink;
+    engine->context = context;
+    return 0;
+}
+
+size_t lorenz_run(lorenz_engine* engine) {
+    double t_end = engine->state.t + engine->duration;
+    size_t emitted = 0;
+    STATS_PROBE1(lorenz_run, engine->duration);
+    STATS_BEGIN(scope, STATS_EXACT_BYTES);
+    // The state may have been changed by the caller since the last run;
+    engine->slope_valid = 0;
+    lorenz_sample_start(engine);
+    while ((engine->state.t < t_end) && !lorenz_full(engine)) {
+        emitted += lorenz_step(engine, t_end);
+    }
+    // Flush the partially filled buffer;
+    if ((engine->sink != NULL) && (engine->buffered > 0)) {
+        engine->sink(engine->buffer, engine->buffered, engine->context);
+        engine->buffered = 0;
+    }
+    STATS_END(scope, STATS_CHAOS, 0, emitted * sizeof(lorenz_state), emitted);
+    return emitted;
+}
+
+static uint64_t lorenz_mantissa(double value) {
+    uint64_t bits = 0;
+    memcpy(&bits, &value, sizeof bits);
+    return bits & 0x000FFFFFFFFFFFFFULL;
+}
+
+static void lorenz_extract(const lorenz_state* states, size_t count, void* context) {
+    lorenz_extractor* extractor = context;
+    uint64_t mixed = 0;
+    for (size_t i = 0; (i < count) && (extractor->written < extractor->bytes_len); i++) {
+        // The low mantissa bits are the ones most sensitive to the chaotic dynamics;
+        mixed = lorenz_mantissa(states[i].x) ^ lorenz_mantissa(states[i].y) ^ lorenz_mantissa(states[i].z);
+        for (size_t j = 0; (j < LORENZ_ENTROPY_BYTES) && (extractor->written < extractor->bytes_len); j++) {
+            extractor->bytes[extractor->written++] = (uint8_t)(mixed >> (j * 8));
+        }
+    }
+}
+
+void lorenz_entropy(lorenz_engine* engine, uint8_t* bytes, size_t bytes_len) {
+    lorenz_state batch[LORENZ_ENTROPY_BATCH];
+    lorenz_extractor extractor = { bytes, bytes_len, 0 };
+    // Swap in an internal buffer and sink, and restore the caller's afterwards;
+    lorenz_state* buffer = engine->buffer;
+    size_t buffer_len = engine->buffer_len;
+    size_t buffered = engine->buffered;
+    lorenz_sink sink = engine->sink;
+    void* context = engine->context;
+    STATS_PROBE2(lorenz_entropy, bytes, bytes_len);
+    STATS_BEGIN(scope, STATS_EXACT_BYTES);
+    lorenz_set_sink(engine, batch, LORENZ_ENTROPY_BATCH, lorenz_extract, &extractor);
+    engine->slope_valid = 0;
+    lorenz_sample_start(engine);
+    while (extractor.written + engine->buffered * LORENZ_ENTROPY_BYTES < bytes_len) {
+        lorenz_step(engine, INFINITY);
+    }
+    lorenz_extract(engine->buffer, engine->buffered, &extractor);
+    engine->buffer = buffer;
+    engine->buffer_len = buffer_len;
+    engine->buffered = buffered;
+    engine->sink = sink;
+    engine->context = context;
+    STATS_END(scope, STATS_CHAOS, 0, bytes_len, (bytes_len + LORENZ_ENTROPY_BYTES - 1) / LORENZ_ENTROPY_BYTES);
+}
+
+void lorenz_ensemble_init(lorenz_ensemble* ensemble, size_t count) {
+    size_t padded = ((count + LORENZ_LANES - 1) / LORENZ_LANES) * LORENZ_LANES;
+    ensemble->sigma = 10.0;
+    ensemble->rho = 28.0;
+    ensemble->beta = 8.0 / 3.0;
+    ensemble->tolerance = 1e-7;
+    ensemble->count = count;
+    ensemble->x = safe_aligned_malloc(LORENZ_ALIGNMENT, padded * sizeof *ensemble->x);
+    ensemble->y = safe_aligned_malloc(LORENZ_ALIGNMENT, padded * sizeof *ensemble->y);
+    ensemble->z = safe_aligned_malloc(LORENZ_ALIGNMENT, padded * sizeof *ensemble->z);
+    ensemble->t = safe_aligned_malloc(LORENZ_ALIGNMENT, padded * sizeof *ensemble->t);
+    ensemble->dt = safe_aligned_malloc(LORENZ_ALIGNMENT, padded * sizeof *ensemble->dt);
+    // The padding lanes are integrated like the others and their results ignored;
+    for (size_t i = 0; i < padded; i++) {
+        ensemble->x[i] = 1.0;
+        ensemble->y[i] = 1.0;
+        ensemble->z[i] = 1.0;
+        ensemble->t[i] = 0.0;
+        ensemble->dt[i] = 0.01;
+    }
+}
+
+void lorenz_ensemble_perturb(lorenz_ensemble* ensemble, const lorenz_state* base, double epsilon) {
+    size_t padded = ((ensemble->count + LORENZ_LANES - 1) / LORENZ_LANES) * LORENZ_LANES;
+    for (size_t i = 0; i < padded; i++) {
+        ensemble->x[i] = base->x + (double)i * epsilon;
+        ensemble->y[i] = base->y;
+        ensemble->z[i] = base->z;
+        ensemble->t[i] = base->t;
+    }
+}
+
+static inline __attribute__((always_inline)) void lorenz_lanes_system(const lorenz_ensemble* ensemble, const double* x, const double* y, const double* z, double* dx, double* dy, double* dz) {
+    for (size_t j = 0; j < LORENZ_LANES; j++) {
+        dx[j] = ensemble->sigma * (y[j] - x[j]);
+        dy[j] = x[j] * (ensemble->rho - z[j]) - y[j];
+        dz[j] = x[j] * y[j] - ensemble->beta * z[j];
+    }
+}
+
+// Inlined into every backend, so each one vectorizes the lane loops for its own instruction set;
+static inline __attribute__((always_inline)) size_t lorenz_lanes_advance(const lorenz_ensemble* ensemble, double* x, double* y, double* z, double* t, double* dt, double t_end) {
+    // Slopes for every lane, k[stage][coordinate][lane];
+    double k[6][3][LORENZ_LANES];
+    double tx[LORENZ_LANES], ty[LORENZ_LANES], tz[LORENZ_LANES];
+    double nx[LORENZ_LANES], ny[LORENZ_LANES], nz[LORENZ_LANES];
+    double h[LORENZ_LANES];
+    double error[LORENZ_LANES];
+    double scale_factor = 0.0;
+    double next_dt = 0.0;
+    double tolerance = ensemble->tolerance;
+    size_t active = LORENZ_LANES;
+    size_t steps = 0;
+    lorenz_lanes_system(ensemble, x, y, z, k[0][0], k[0][1], k[0][2]);
+    while (active > 0) {
+        // Finished lanes take a zero step, which leaves them unchanged;
+        for (size_t j = 0; j < LORENZ_LANES; j++) {
+            h[j] = (dt[j] < t_end - t[j]) ? dt[j] : t_end - t[j];
+            h[j] = (h[j] > 0.0) ? h[j] : 0.0;
+        }
+        for (size_t j = 0; j < LORENZ_LANES; j++) {
+            tx[j] = x[j] + h[j] * a21 * k[0][0][j];
+            ty[j] = y[j] + h[j] * a21 * k[0][1][j];
+            tz[j] = z[j] + h[j] * a21 * k[0][2][j];
+        }
+        lorenz_lanes_system(ensemble, tx, ty, tz, k[1][0], k[1][1], k[1][2]);
+        for (size_t j = 0; j < LORENZ_LANES; j++) {
+            tx[j] = x[j] + h[j] * (a31 * k[0][0][j] + a32 * k[1][0][j]);
+            ty[j] = y[j] + h[j] * (a31 * k[0][1][j] + a32 * k[1][1][j]);
+            tz[j] = z[j] + h[j] * (a31 * k[0][2][j] + a32 * k[1][2][j]);
+        }
+        lorenz_lanes_system(ensemble, tx, ty, tz, k[2][0], k[2][1], k[2][2]);
+        for (size_t j = 0; j < LORENZ_LANES; j++) {
+            tx[j] = x[j] + h[j] * (a41 * k[0][0][j] + a42 * k[1][0][j] + a43 * k[2][0][j]);
+            ty[j] = y[j] + h[j] * (a41 * k[0][1][j] + a42 * k[1][1][j] + a43 * k[2][1][j]);
+            tz[j] = z[j] + h[j] * (a41 * k[0][2][j] + a42 * k[1][2][j] + a43 * k[2][2][j]);
+        }
+        lorenz_lanes_system(ensemble, tx, ty, tz, k[3][0], k[3][1], k[3][2]);
+        for (size_t j = 0; j < LORENZ_LANES; j++) {
+            tx[j] = x[j] + h[j] * (a51 * k[0][0][j] + a52 * k[1][0][j] + a53 * k[2][0][j] + a54 * k[3][0][j]);
+            ty[j] = y[j] + h[j] * (a51 * k[0][1][j] + a52 * k[1][1][j] + a53 * k[2][1][j] + a54 * k[3][1][j]);
+            tz[j] = z[j] + h[j] * (a51 * k[0][2][j] + a52 * k[1][2][j] + a53 * k[2][2][j] + a54 * k[3][2][j]);
+        }
+        lorenz_lanes_system(ensemble, tx, ty, tz, k[4][0], k[4][1], k[4][2]);
+        for (size_t j = 0; j < LORENZ_LANES; j++) {
+            tx[j] = x[j] + h[j] * (a61 * k[0][0][j] + a62 * k[1][0][j] + a63 * k[2][0][j] + a64 * k[3][0][j] + a65 * k[4][0][j]);
+            ty[j] = y[j] + h[j] * (a61 * k[0][1][j] + a62 * k[1][1][j] + a63 * k[2][1][j] + a64 * k[3][1][j] + a65 * k[4][1][j]);
+            tz[j] = z[j] + h[j] * (a61 * k[0][2][j] + a62 * k[1][2][j] + a63 * k[2][2][j] + a64 * k[3][2][j] + a65 * k[4][2][j]);
+        }
+        lorenz_lanes_system(ensemble, tx, ty, tz, k[5][0], k[5][1], k[5][2]);
+        // Compute the 5th order estimates and the local truncation errors;
+        for (size_t j = 0; j < LORENZ_LANES; j++) {
+            double ex = c1 * k[0][0][j] + c3 * k[2][0][j] + c4 * k[3][0][j] + c5 * k[4][0][j] + c6 * k[5][0][j];
+            double ey = c1 * k[0][1][j] + c3 * k[2][1][j] + c4 * k[3][1][j] + c5 * k[4][1][j] + c6 * k[5][1][j];
+            double ez = c1 * k[0][2][j] + c3 * k[2][2][j] + c4 * k[3][2][j] + c5 * k[4][2][j] + c6 * k[5][2][j];
+            nx[j] = x[j] + h[j] * (b1 * k[0][0][j] + b3 * k[2][0][j] + b4 * k[3][0][j] + b5 * k[4][0][j] + b6 * k[5][0][j]);
+            ny[j] = y[j] + h[j] * (b1 * k[0][1][j] + b3 * k[2][1][j] + b4 * k[3][1][j] + b5 * k[4][1][j] + b6 * k[5][1][j]);
+            nz[j] = z[j] + h[j] * (b1 * k[0][2][j] + b3 * k[2][2][j] + b4 * k[3][2][j] + b5 * k[4][2][j] + b6 * k[5][2][j]);
+            error[j] = sqrt(ex * ex + ey * ey + ez * ez);
+        }
+        // Masked accept / reject: accepted lanes take the new state, the others keep the old one;
+        // Every lane scales its own step size based on its own error;
+        for (size_t j = 0; j < LORENZ_LANES; j++) {
+            int accept = (error[j] < tolerance) && (h[j] > 0.0);
+            // An overflowed state gives a NaN error that is never accepted and would shrink the step to 0;
+            int failed = (h[j] > 0.0) && (!isfinite(error[j]) || !isfinite(nx[j]) || !isfinite(ny[j]) || !isfinite(nz[j]) ||
+                (!accept && (h[j] <= LORENZ_MIN_STEP)));
+            scale_factor = 0.84 * sqrt(sqrt(tolerance / error[j]));
+            scale_factor = (scale_factor > LORENZ_MIN_SCALE) ? scale_factor : LORENZ_MIN_SCALE;
+            scale_factor = (scale_factor < LORENZ_MAX_SCALE) ? scale_factor : LORENZ_MAX_SCALE;
+            x[j] = accept ? nx[j] : x[j];
+            y[j] = accept ? ny[j] : y[j];
+            z[j] = accept ? nz[j] : z[j];
+            // A step shortened to land on t_end says nothing about the regular step size;
+            // Finished lanes (h = 0) keep their step size for the next call;
+            next_dt = (accept && (h[j] < dt[j])) ? dt[j] : h[j] * scale_factor;
+            next_dt = (next_dt > LORENZ_MIN_STEP) ? next_dt : LORENZ_MIN_STEP;
+            dt[j] = (h[j] > 0.0) ? next_dt : dt[j];
+            t[j] = accept ? ((h[j] == t_end - t[j]) ? t_end : t[j] + h[j]) : t[j];
+            steps += accept && !failed;
+            // A failed lane is finished with its coordinates set to NaN, so the caller can tell it diverged;
+            x[j] = failed ? NAN : x[j];
+            y[j] = failed ? NAN : y[j];
+            z[j] = failed ? NAN : z[j];
+            t[j] = failed ? t_end : t[j];
+        }
+        // The slopes at the accepted states are the first slopes of the next step;
+        lorenz_lanes_system(ensemble, x, y, z, k[0][0], k[0][1], k[0][2]);
+        active = 0;
+        for (size_t j = 0; j < LORENZ_LANES; j++) {
+            active += (t[j] < t_end);
+        }
+    }
+    return steps;
+}
+
+static size_t lorenz_lanes_advance_generic(const lorenz_ensemble* ensemble, double* x, double* y, double* z, double* t, double* dt, double t_end) {
+    return lorenz_lanes_advance(ensemble, x, y, z, t, dt, t_end);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// No FMA: contracting the stages would round differently, so every backend integrates the same trajectories;
+__attribute__((target("avx2")))
+static size_t lorenz_lanes_advance_avx2(const lorenz_ensemble* ensemble, double* x, double* y, double* z, double* t, double* dt, double t_end) {
+    return lorenz_lanes_advance(ensemble, x, y, z, t, dt, t_end);
+}
+
+#endif
+
+static const lorenz_ops lorenz_generic_ops = { lorenz_lanes_advance_generic };
+#if defined(__x86_64__) || defined(__i386__)
+static const lorenz_ops lorenz_avx2_ops = { lorenz_lanes_advance_avx2 };
+#endif
+
+static const cpu_backend lorenz_backends[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    { "avx2", CPU_FEATURE_AVX2, &lorenz_avx2_ops },
+#endif
+    { "generic", 0, &lorenz_generic_ops }
+};
+
+static cpu_dispatch lorenz_dispatch = { "lorenz", lorenz_backends, sizeof lorenz_backends / sizeof lorenz_backends[0], NULL };
+
+__attribute__((constructor))
+static void lorenz_register(void) {
+    cpu_dispatch_register(&lorenz_dispatch);
+}
+
+// Advances the lane blocks [start, end);
+static void lorenz_ensemble_range(void* context, size_t start, size_t end) {
+    lorenz_ensemble_job* job = context;
+    lorenz_ensemble* ensemble = job->ensemble;
+    const lorenz_ops* ops = cpu_dispatch_active(&lorenz_dispatch)->ops;
+    size_t steps = 0;
+    for (size_t i = start * LORENZ_LANES; i < end * LORENZ_LANES; i += LORENZ_LANES) {
+        steps += ops->lanes_advance(ensemble, ensemble->x + i, ensemble->y + i, ensemble->z + i, ensemble->t + i, ensemble->dt + i, job->t_end);
+    }
+    __atomic_fetch_add(&job->steps, steps, __ATOMIC_RELAXED);
+}
+
+size_t lorenz_ensemble_advance(lorenz_ensemble* ensemble, double t_end) {
+    lorenz_ensemble_job job = { .ensemble = ensemble, .t_end = t_end, .steps = 0 };
+    size_t nr_blocks = (ensemble->count + LORENZ_LANES - 1) / LORENZ_LANES;
+    if (nr_blocks == 0) {
+        return 0;
+    }
+    STATS_PROBE2(lorenz_ensemble_advance, ensemble->count, t_end);
+    STATS_BEGIN(scope, STATS_EXACT_BYTES);
+    parallel_for(nr_blocks, LORENZ_MIN_BLOCKS_PER_THREAD, lorenz_ensemble_range, &job);
+    // The blocks are the accepted integration steps over all trajectories;
+    STATS_END(scope, STATS_CHAOS, 0, 0, job.steps);
+    return job.steps;
+}
+
+void lorenz_ensemble_free(lorenz_ensemble* ensemble) {
+    free(ensemble->x);
+    free(ensemble->y);
+    free(ensemble->z);
+    free(ensemble->t);
+    free(ensemble->dt);
+    ensemble->x = NULL;
+    ensemble->y = NULL;
+    ensemble->z = NULL;
+    ensemble->t = NULL;
+    ensemble->dt = NULL;
+    ensemble->count = 0;
+}
\ No newline at end of file
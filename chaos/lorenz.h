@@ -0,0 +1,158 @@
+#ifndef LORENZ_H
+#define LORENZ_H
+
+/** ----------------------------------------------------------------------------------
+ * @brief   The functions defined in this file integrate the Lorenz system using RKF45.
+ * @details Accepted (or sampled) states are pushed into a caller-provided buffer and
+ *          handed to a callback in batches instead of being printed.
+ * @author  Murea Cosmin Alexandru
+ * @date    01.03.2024
+ * ----------------------------------------------------------------------------------- **/
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// The number of bytes extracted from every state in entropy mode;
+#define LORENZ_ENTROPY_BYTES 2
+// The number of trajectories integrated together by the ensemble (one AVX-512 vector of doubles);
+#define LORENZ_LANES 8
+
+typedef struct {
+    double t;
+    double x;
+    double y;
+    double z;
+} lorenz_state;
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Receives a batch of states from the engine.
+ * @param   states      A pointer to the batch of states (the engine's buffer).
+ * @param   count       The number of states in the batch.
+ * @param   context     The context pointer given to lorenz_set_sink().
+ * ---------------------------------------------------------------------------------------- **/
+typedef void (*lorenz_sink)(const lorenz_state* states, size_t count, void* context);
+
+typedef struct {
+    // The parameters of the system;
+    double sigma;
+    double rho;
+    double beta;
+    // The maximum local truncation error accepted for a step;
+    double tolerance;
+    // The amount of time integrated by each lorenz_run() call;
+    double duration;
+    // The current step size (adapted after every step);
+    double dt;
+    // If > 0 the states are sampled every sample_interval time units using dense output;
+    double sample_interval;
+    // The current state of the system;
+    lorenz_state state;
+    // The derivative at the current state (reused by rejected steps and dense output);
+    double slope[3];
+    uint8_t slope_valid;
+    // Samples are taken at sample_origin + k * sample_interval to avoid accumulating drift;
+    double sample_origin;
+    size_t sample_index;
+    double next_sample;
+    // The output buffer and the callback that consumes it;
+    lorenz_state* buffer;
+    size_t buffer_len;
+    size_t buffered;
+    lorenz_sink sink;
+    void* context;
+} lorenz_engine;
+
+typedef struct {
+    // The parameters shared by all trajectories;
+    double sigma;
+    double rho;
+    double beta;
+    double tolerance;
+    // The number of trajectories (the arrays are padded to a multiple of LORENZ_LANES);
+    size_t count;
+    // The states, times and step sizes stored as structure-of-arrays;
+    double* x;
+    double* y;
+    double* z;
+    double* t;
+    double* dt;
+} lorenz_ensemble;
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Initialises an engine with the classic parameters (10, 28, 8/3).
+ * @details The initial state is (1, 1, 1) at t = 0, the tolerance 1e-7, the initial step
+ *          0.01 and the duration 1.0. Every accepted step is emitted (no sampling).
+ * @param   engine      A pointer to the engine to initialise.
+ * ---------------------------------------------------------------------------------------- **/
+void lorenz_init(lorenz_engine* engine);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Sets the buffer receiving the states and the callback consuming it.
+ * @details Every time the buffer fills up it is handed to the sink and reused. Without a
+ *          sink lorenz_run() stops at the sample that fills the buffer, and the next run
+ *          continues with the following sample point.
+ * @param   engine      A pointer to the engine.
+ * @param   buffer      A pointer to an array of buffer_len states.
+ * @param   buffer_len  The length of the buffer in states.
+ * @param   sink        The callback receiving full buffers (can be NULL).
+ * @param   context     A pointer passed back to the sink.
+ * @returns 0 on success, -1 if the buffer is NULL or empty (the engine is left unchanged).
+ * ---------------------------------------------------------------------------------------- **/
+int lorenz_set_sink(lorenz_engine* engine, lorenz_state* buffer, size_t buffer_len, lorenz_sink sink, void* context);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Integrates the system for engine->duration time units from the current state.
+ * @details Any states left in the buffer are flushed to the sink before returning.
+ * @param   engine      A pointer to the engine.
+ * @returns The number of states emitted.
+ * ---------------------------------------------------------------------------------------- **/
+size_t lorenz_run(lorenz_engine* engine);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Fills a byte array with bits extracted from the trajectory.
+ * @details The low mantissa bits of x, y and z are mixed into LORENZ_ENTROPY_BYTES bytes per
+ *          emitted state. The duration is ignored and the configured sink is not called.
+ *          The initial state should be seeded by the caller.
+ * @param   engine      A pointer to the engine.
+ * @param   bytes       An array to hold the extracted bytes.
+ * @param   bytes_len   The number of bytes to extract.
+ * ---------------------------------------------------------------------------------------- **/
+void lorenz_entropy(lorenz_engine* engine, uint8_t* bytes, size_t bytes_len);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Initialises an ensemble of trajectories with the classic parameters.
+ * @details Every trajectory starts at (1, 1, 1) at t = 0 with an initial step of 0.01 and the
+ *          tolerance is 1e-7. The caller is responsible for calling lorenz_ensemble_free().
+ * @param   ensemble    A pointer to the ensemble to initialise.
+ * @param   count       The number of trajectories.
+ * ---------------------------------------------------------------------------------------- **/
+void lorenz_ensemble_init(lorenz_ensemble* ensemble, size_t count);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Spreads the trajectories around a base state for sensitivity analysis.
+ * @details Trajectory i starts at (x + i * epsilon, y, z) at time base->t.
+ * @param   ensemble    A pointer to the ensemble.
+ * @param   base        The unperturbed initial state.
+ * @param   epsilon     The perturbation between neighbouring trajectories.
+ * ---------------------------------------------------------------------------------------- **/
+void lorenz_ensemble_perturb(lorenz_ensemble* ensemble, const lorenz_state* base, double epsilon);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Advances every trajectory of the ensemble to the time t_end.
+ * @details LORENZ_LANES trajectories are integrated together, each with its own adaptive
+ *          step size, and the blocks of lanes are split across all online CPUs. A
+ *          trajectory that overflows, or cannot meet the tolerance with the shortest
+ *          step, is stopped at t_end with its coordinates set to NaN.
+ * @param   ensemble    A pointer to the ensemble.
+ * @param   t_end       The time every trajectory is advanced to.
+ * @returns The total number of accepted steps.
+ * ---------------------------------------------------------------------------------------- **/
+size_t lorenz_ensemble_advance(lorenz_ensemble* ensemble, double t_end);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Frees the arrays owned by an ensemble.
+ * @param   ensemble    A pointer to the ensemble.
+ * ---------------------------------------------------------------------------------------- **/
+void lorenz_ensemble_free(lorenz_ensemble* ensemble);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "chaos.h"
+#include "lorenz.h"
+#include "health.h"
+#include "../utils/general.h"
+
+// The output of every generator is produced and tested in blocks of QUALITY_BLOCK_LEN bytes;
+#define QUALITY_BLOCK_LEN 65536
+#define QUALITY_SAMPLE_LEN (16 * QUALITY_BLOCK_LEN)
+// The min-entropy per byte claimed for the continuous health tests;
+#define QUALITY_MIN_ENTROPY 7.0
+#define QUALITY_ENSEMBLE_LEN 4096
+// The amount of time the Lorenz generators are run before their output is used;
+#define QUALITY_LORENZ_WARMUP 10.0
+
+typedef void (*quality_generator)(uint8_t* bytes, size_t bytes_len, void* context);
+
+typedef struct {
+    const char* name;
+    quality_generator generate;
+    void* context;
+} quality_config;
+
+static double elapsed(const struct timespec* start, const struct timespec* end) {
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static void discard_states(const lorenz_state* states, size_t count, void* context) {
+}
+
+static void maps_generate(uint8_t* bytes, size_t bytes_len, void* context) {
+    generate_entropy(bytes, bytes_len);
+}
+
+static void lorenz_generate(uint8_t* bytes, size_t bytes_len, void* context) {
+    lorenz_entropy(context, bytes, bytes_len);
+}
+
+static void ensemble_generate(uint8_t* bytes, size_t bytes_len, void* context) {
+    lorenz_ensemble* ensemble = context;
+    uint64_t bits_x = 0, bits_y = 0, bits_z = 0;
+    size_t written = 0;
+    // Advance every trajectory by 0.01 and take 2 bytes from each of them;
+    while (written < bytes_len) {
+        lorenz_ensemble_advance(ensemble, ensemble->t[0] + 0.01);
+        for (size_t i = 0; (i < ensemble->count) && (written < bytes_len); i++) {
+            memcpy(&bits_x, &ensemble->x[i], sizeof bits_x);
+            memcpy(&bits_y, &ensemble->y[i], sizeof bits_y);
+            memcpy(&bits_z, &ensemble->z[i], sizeof bits_z);
+            bits_x ^= bits_y ^ bits_z;
+            for (size_t j = 0; (j < LORENZ_ENTROPY_BYTES) && (written < bytes_len); j++) {
+                bytes[written++] = (uint8_t)(bits_x >> (j * 8));
+            }
+        }
+    }
+}
+
+static void quality_run(const quality_config* config) {
+    static uint8_t block[QUALITY_BLOCK_LEN];
+    health_state full;
+    health_state online;
+    health_report report;
+    struct timespec start, end;
+    double generate_time = 0.0;
+    double check_time = 0.0;
+    health_init(&full, QUALITY_MIN_ENTROPY);
+    health_init(&online, QUALITY_MIN_ENTROPY);
+    for (size_t i = 0; i < QUALITY_SAMPLE_LEN; i += QUALITY_BLOCK_LEN) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        config->generate(block, QUALITY_BLOCK_LEN, config->context);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        generate_time += elapsed(&start, &end);
+        // Time the continuous tests on their own, as they would run in production;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        health_check(&online, block, QUALITY_BLOCK_LEN);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        check_time += elapsed(&start, &end);
+        health_test(&full, block, QUALITY_BLOCK_LEN);
+    }
+    health_summary(&full, &report);
+    printf("%s\n", config->name);
+    printf("\tGeneration : \t\t%10.3f MB/s\n", QUALITY_SAMPLE_LEN / generate_time / 1e6);
+    printf("\tHealth checks : \t%10.3f MB/s\n", QUALITY_SAMPLE_LEN / check_time / 1e6);
+    printf("\tRCT / APT failures : \t%llu / %llu (cutoffs %u / %u)\n", (unsigned long long)report.rct_failures,
+        (unsigned long long)report.apt_failures, full.rct_cutoff, full.apt_cutoff);
+    printf("\tEntropy : \t\t%10.6f bits/byte\n", report.entropy);
+    printf("\tMonobit p : \t\t%10.6f\n", report.monobit_p);
+    printf("\tRuns p : \t\t%10.6f\n", report.runs_p);
+    printf("\tChi-square : \t\t%10.3f (p = %f)\n", report.chi_square, report.chi_square_p);
+    printf("\tSerial correlation : \t%10.6f\n", report.serial_correlation);
+}
+
+int main() {
+    lorenz_engine steps;
+    lorenz_engine samples;
+    lorenz_state buffer[1];
+    lorenz_ensemble ensemble;
+    lorenz_state base = { 0.0, 1.0, 1.0, 1.0 };
+    // Move the Lorenz generators past their transient before using their output;
+    lorenz_init(&steps);
+    lorenz_init(&samples);
+    if ((lorenz_set_sink(&steps, buffer, 1, discard_states, NULL) != 0) ||
+        (lorenz_set_sink(&samples, buffer, 1, discard_states, NULL) != 0)) {
+        fprintf(stderr, "Could not register the Lorenz sinks. Proceeding to crash. Cleaning up...");
+        exit(EXIT_FAILURE);
+    }
+    steps.duration = QUALITY_LORENZ_WARMUP;
+    lorenz_run(&steps);
+    samples.duration = QUALITY_LORENZ_WARMUP;
+    lorenz_run(&samples);
+    samples.sample_interval = 0.01;
+    lorenz_ensemble_init(&ensemble, QUALITY_ENSEMBLE_LEN);
+    lorenz_ensemble_perturb(&ensemble, &base, 1e-9);
+    lorenz_ensemble_advance(&ensemble, QUALITY_LORENZ_WARMUP);
+    quality_config configs[] = {
+        { "Logistics / tent / sine maps (generate_entropy)", maps_generate, NULL },
+        { "Lorenz RKF45, every accepted step (lorenz_entropy)", lorenz_generate, &steps },
+        { "Lorenz RKF45, sampled every 0.01 (lorenz_entropy)", lorenz_generate, &samples },
+        { "Lorenz ensemble of 4096 trajectories (lorenz_ensemble_advance)", ensemble_generate, &ensemble }
+    };
+    for (size_t i = 0; i < sizeof configs / sizeof configs[0]; i++) {
+        quality_run(&configs[i]);
+    }
+    lorenz_ensemble_free(&ensemble);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "envelope.h"
+#include "../utils/general.h"
+#include "../utils/seed.h"
+
+// The size of the payload sealed by the benchmark;
+#define PAYLOAD_LEN (8 << 20)
+
+static double elapsed(const struct timespec* start, const struct timespec* end) {
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static const char* outcome(int status) {
+    return (status == 0) ? "accepted" : "rejected";
+}
+
+static void round_trip(const rsa_public_key* public_key, const rsa_private_key* private_key, size_t payload_len, uint32_t chunk_size) {
+    uint8_t* payload = safe_malloc(payload_len + 1);
+    uint8_t* sealed = NULL;
+    uint8_t* opened = NULL;
+    size_t sealed_len = 0, opened_len = 0;
+    seed_bytes("envelope.driver", payload, payload_len);
+    envelope_seal(public_key, payload, payload_len, chunk_size, &sealed, &sealed_len);
+    if ((envelope_open(private_key, sealed, sealed_len, &opened, &opened_len) == 0) && (opened_len == payload_len) &&
+        (memcmp(opened, payload, payload_len) == 0)) {
+        printf("%zu bytes in chunks of %u: ok (%zu bytes sealed)\n", payload_len, chunk_size, sealed_len);
+    } else {
+        printf("%zu bytes in chunks of %u: failed\n", payload_len, chunk_size);
+    }
+    free(opened);
+    free(sealed);
+    free(payload);
+}
+
+static void tamper_demo(const rsa_public_key* public_key, const rsa_private_key* private_key, const rsa_private_key* other_key) {
+    size_t payload_len = 4 * 4096 + 100;
+    uint8_t* payload = safe_malloc(payload_len);
+    uint8_t* sealed = NULL;
+    uint8_t* opened = NULL;
+    size_t sealed_len = 0, opened_len = 0;
+    envelope_ctx ctx;
+    seed_bytes("envelope.driver", payload, payload_len);
+    if ((envelope_seal(public_key, payload, payload_len, 4096, &sealed, &sealed_len) != 0) ||
+        (envelope_open_init(&ctx, private_key, sealed, sealed_len) != 0)) {
+        printf("Tamper demo: sealing failed\n");
+        free(sealed);
+        free(payload);
+        return;
+    }
+    uint8_t chunk[ctx.chunk_size];
+    uint8_t swapped[envelope_chunk_len(&ctx, 0, NULL)];
+    // A single chunk opens on its own;
+    printf("Chunk 2 alone: %s\n", outcome(envelope_open_chunk(&ctx, 2, sealed + envelope_chunk_offset(&ctx, 2),
+        envelope_chunk_len(&ctx, 2, NULL), chunk) | memcmp(chunk, payload + 2 * 4096, 4096)));
+    sealed[envelope_chunk_offset(&ctx, 1) + 7] ^= 0x01;
+    printf("Flipped ciphertext bit: %s\n", outcome(envelope_open(private_key, sealed, sealed_len, &opened, &opened_len)));
+    sealed[envelope_chunk_offset(&ctx, 1) + 7] ^= 0x01;
+    // Swap chunks 0 and 1;
+    memcpy(swapped, sealed + envelope_chunk_offset(&ctx, 0), sizeof swapped);
+    memcpy(sealed + envelope_chunk_offset(&ctx, 0), sealed + envelope_chunk_offset(&ctx, 1), sizeof swapped);
+    memcpy(sealed + envelope_chunk_offset(&ctx, 1), swapped, sizeof swapped);
+    printf("Reordered chunks: %s\n", outcome(envelope_open(private_key, sealed, sealed_len, &opened, &opened_len)));
+    memcpy(sealed + envelope_chunk_offset(&ctx, 1), sealed + envelope_chunk_offset(&ctx, 0), sizeof swapped);
+    memcpy(sealed + envelope_chunk_offset(&ctx, 0), swapped, sizeof swapped);
+    // Dropping the last chunk must not pass as a shorter payload;
+    printf("Truncated envelope: %s\n", outcome(envelope_open(private_key, sealed, envelope_chunk_offset(&ctx, 4), &opened, &opened_len)));
+    sealed[14] ^= 0x01;
+    printf("Modified payload length: %s\n", outcome(envelope_open(private_key, sealed, sealed_len, &opened, &opened_len)));
+    sealed[14] ^= 0x01;
+    printf("Wrong recipient: %s\n", outcome(envelope_open(other_key, sealed, sealed_len, &opened, &opened_len)));
+    printf("Untouched envelope: %s\n", outcome(envelope_open(private_key, sealed, sealed_len, &opened, &opened_len)));
+    envelope_clear(&ctx);
+    free(opened);
+    free(sealed);
+    free(payload);
+}
+
+static void benchmark(const rsa_public_key* public_key, const rsa_private_key* private_key) {
+    struct timespec start, end;
+    uint8_t* payload = safe_malloc(PAYLOAD_LEN);
+    uint8_t* sealed = NULL;
+    uint8_t* opened = NULL;
+    size_t sealed_len = 0, opened_len = 0;
+    double seal_time = 0.0, open_time = 0.0;
+    memset(payload, 0x5a, PAYLOAD_LEN);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    envelope_seal(public_key, payload, PAYLOAD_LEN, ENVELOPE_CHUNK_SIZE, &sealed, &sealed_len);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seal_time = elapsed(&start, &end);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    envelope_open(private_key, sealed, sealed_len, &opened, &opened_len);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    open_time = elapsed(&start, &end);
+    printf("Sealed %d MiB at %.2f MB/s, opened at %.2f MB/s (%s)\n", PAYLOAD_LEN >> 20, PAYLOAD_LEN / seal_time / 1e6,
+        PAYLOAD_LEN / open_time / 1e6, ((opened_len == PAYLOAD_LEN) && (memcmp(opened, payload, PAYLOAD_LEN) == 0)) ? "ok" : "failed");
+    free(opened);
+    free(sealed);
+    free(payload);
+}
+
+int main() {
+    rsa_private_key private_key, other_key;
+    rsa_public_key public_key;
+    rsa_private_key_init(&private_key);
+    rsa_private_key_init(&other_key);
+    rsa_public_key_init(&public_key);
+    rsa_keygen(2048, 65537, &private_key);
+    rsa_keygen(2048, 65537, &other_key);
+    rsa_public_key_from_private(&private_key, &public_key);
+    round_trip(&public_key, &private_key, 0, 4096);
+    round_trip(&public_key, &private_key, 15, 4096);
+    round_trip(&public_key, &private_key, 4 * 4096, 4096);
+    round_trip(&public_key, &private_key, 100000, 4096);
+    tamper_demo(&public_key, &private_key, &other_key);
+    benchmark(&public_key, &private_key);
+    rsa_public_key_clear(&public_key);
+    rsa_private_key_clear(&other_key);
+    rsa_private_key_clear(&private_key);
+    return 0;
+}
\ No newline at end of file
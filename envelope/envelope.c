@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "envelope.h"
+#include "../utils/general.h"
+#include "../utils/seed.h"
+#include "../utils/endian.h"
+#include "../utils/threadpool.h"
+
+// The OAEP label binds the wrapped secret to its use;
+#define ENVELOPE_LABEL "nighthawk.envelope"
+#define ENVELOPE_HMAC_IPAD 0x36
+#define ENVELOPE_HMAC_OPAD 0x5c
+
+typedef struct {
+    const envelope_ctx* ctx;
+    const uint8_t* input;
+    uint8_t* output;
+    // Set to -1 by any range with a chunk that fails to open;
+    int status;
+} envelope_job;
+
+size_t envelope_header_len(const rsa_public_key* key) {
+    return ENVELOPE_HEADER_FIXED_LEN + rsa_modulus_len(key->n);
+}
+
+static int envelope_chunk_size_valid(uint32_t chunk_size) {
+    return (chunk_size > 0) && (chunk_size % AES_BLOCK_SIZE == 0) && (chunk_size <= ENVELOPE_MAX_CHUNK_SIZE);
+}
+
+static void envelope_kdf(const uint8_t* secret, const char* label, const uint8_t* header_hash, uint8_t* derived) {
+    // Single-step KDF (SP 800-56C): SHA2-256(counter || secret || label || 0x00 || header hash);
+    static const uint8_t counter[4] = { 0x00, 0x00, 0x00, 0x01 };
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, counter, 4);
+    sha256_update(&ctx, secret, ENVELOPE_SECRET_LEN);
+    sha256_update(&ctx, (const uint8_t*)label, strlen(label) + 1);
+    sha256_update(&ctx, header_hash, SHA256_DIGEST_SIZE);
+    sha256_final(&ctx, derived);
+    secure_zero(&ctx, sizeof ctx);
+}
+
+static int envelope_derive(envelope_ctx* ctx, const uint8_t* secret, const uint8_t* header) {
+    uint8_t header_hash[SHA256_DIGEST_SIZE];
+    uint8_t key[SHA256_DIGEST_SIZE];
+    uint8_t pad[SHA256_BLOCK_SIZE];
+    sha256_ctx hash_ctx;
+    sha256_init(&hash_ctx);
+    sha256_update(&hash_ctx, header, ctx->header_len);
+    sha256_final(&hash_ctx, header_hash);
+    envelope_kdf(secret, "envelope.aes", header_hash, key);
+    if (aes_init(&ctx->aes, key, AES_KEY_SIZE_256) != 0) {
+        secure_zero(key, SHA256_DIGEST_SIZE);
+        return -1;
+    }
+    envelope_kdf(secret, "envelope.iv", header_hash, ctx->iv_key);
+    // Hash the padded MAC key once => every tag starts from the saved midstates;
+    envelope_kdf(secret, "envelope.mac", header_hash, key);
+    memset(pad, ENVELOPE_HMAC_IPAD, SHA256_BLOCK_SIZE);
+    for (size_t i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        pad[i] ^= key[i];
+    }
+    sha256_init(&ctx->mac_inner);
+    sha256_update(&ctx->mac_inner, pad, SHA256_BLOCK_SIZE);
+    sha256_update(&ctx->mac_inner, header_hash, SHA256_DIGEST_SIZE);
+    memset(pad, ENVELOPE_HMAC_OPAD, SHA256_BLOCK_SIZE);
+    for (size_t i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        pad[i] ^= key[i];
+    }
+    sha256_init(&ctx->mac_outer);
+    sha256_update(&ctx->mac_outer, pad, SHA256_BLOCK_SIZE);
+    secure_zero(key, SHA256_DIGEST_SIZE);
+    secure_zero(pad, SHA256_BLOCK_SIZE);
+    return 0;
+}
+
+static void envelope_set_sizes(envelope_ctx* ctx, uint64_t payload_len, uint32_t chunk_size, size_t header_len) {
+    ctx->chunk_size = chunk_size;
+    ctx->payload_len = payload_len;
+    // The last chunk always exists and is always padded, even if it carries no payload;
+    ctx->nr_chunks = payload_len / chunk_size + 1;
+    ctx->header_len = header_len;
+}
+
+int envelope_seal_init(envelope_ctx* ctx, const rsa_public_key* key, uint64_t payload_len, uint32_t chunk_size, uint8_t* header) {
+    size_t k = rsa_modulus_len(key->n);
+    uint8_t secret[ENVELOPE_SECRET_LEN];
+    int status = 0;
+    if (!envelope_chunk_size_valid(chunk_size)) {
+        return -1;
+    }
+    seed_bytes("envelope.secret", secret, ENVELOPE_SECRET_LEN);
+    if (rsa_oaep_encrypt(key, secret, ENVELOPE_SECRET_LEN, (const uint8_t*)ENVELOPE_LABEL, strlen(ENVELOPE_LABEL),
+        header + ENVELOPE_HEADER_FIXED_LEN) != 0) {
+        secure_zero(secret, ENVELOPE_SECRET_LEN);
+        return -1;
+    }
+    memcpy(header, ENVELOPE_MAGIC, 4);
+    header[4] = ENVELOPE_VERSION;
+    header[5] = ENVELOPE_SUITE_AES256_CBC_HMAC;
+    header[6] = 0;
+    header[7] = 0;
+    endian_store_be32(header + 8, chunk_size);
+    endian_store_be64(header + 12, payload_len);
+    endian_store_be16(header + 20, (uint16_t)k);
+    envelope_set_sizes(ctx, payload_len, chunk_size, ENVELOPE_HEADER_FIXED_LEN + k);
+    status = envelope_derive(ctx, secret, header);
+    secure_zero(secret, ENVELOPE_SECRET_LEN);
+    return status;
+}
+
+int envelope_open_init(envelope_ctx* ctx, const rsa_private_key* key, const uint8_t* sealed, size_t sealed_len) {
+    size_t k = rsa_modulus_len(key->n);
+    uint8_t secret[k];
+    size_t secret_len = 0;
+    uint32_t chunk_size = 0;
+    int status = 0;
+    if ((sealed_len < ENVELOPE_HEADER_FIXED_LEN) || (memcmp(sealed, ENVELOPE_MAGIC, 4) != 0) || (sealed[4] != ENVELOPE_VERSION) ||
+        (sealed[5] != ENVELOPE_SUITE_AES256_CBC_HMAC) || (sealed[6] != 0) || (sealed[7] != 0)) {
+        return -1;
+    }
+    chunk_size = endian_load_be32(sealed + 8);
+    // The wrapped key must be exactly one ciphertext of the recipient's modulus;
+    if (!envelope_chunk_size_valid(chunk_size) || (endian_load_be16(sealed + 20) != k) || (sealed_len - ENVELOPE_HEADER_FIXED_LEN < k)) {
+        return -1;
+    }
+    if ((rsa_oaep_decrypt(key, sealed + ENVELOPE_HEADER_FIXED_LEN, k, (const uint8_t*)ENVELOPE_LABEL, strlen(ENVELOPE_LABEL),
+        secret, &secret_len) != 0) || (secret_len != ENVELOPE_SECRET_LEN)) {
+        secure_zero(secret, k);
+        return -1;
+    }
+    envelope_set_sizes(ctx, endian_load_be64(sealed + 12), chunk_size, ENVELOPE_HEADER_FIXED_LEN + k);
+    status = envelope_derive(ctx, secret, sealed);
+    secure_zero(secret, k);
+    return status;
+}
+
+void envelope_clear(envelope_ctx* ctx) {
+    secure_zero(ctx, sizeof *ctx);
+}
+
+size_t envelope_chunk_len(const envelope_ctx* ctx, uint64_t index, size_t* payload_len) {
+    size_t chunk_payload = ctx->chunk_size;
+    if (index == ctx->nr_chunks - 1) {
+        // PKCS7 adds 1 to AES_BLOCK_SIZE bytes to the last chunk;
+        chunk_payload = (size_t)(ctx->payload_len - index * ctx->chunk_size);
+        if (payload_len != NULL) {
+            *payload_len = chunk_payload;
+        }
+        return (chunk_payload / AES_BLOCK_SIZE + 1) * AES_BLOCK_SIZE + ENVELOPE_TAG_LEN;
+    }
+    if (payload_len != NULL) {
+        *payload_len = chunk_payload;
+    }
+    return chunk_payload + ENVELOPE_TAG_LEN;
+}
+
+uint64_t envelope_chunk_offset(const envelope_ctx* ctx, uint64_t index) {
+    return ctx->header_len + index * ((uint64_t)ctx->chunk_size + ENVELOPE_TAG_LEN);
+}
+
+static void envelope_chunk_iv(const envelope_ctx* ctx, uint64_t index, uint8_t* iv) {
+    // IV_i = SHA2-256(IV key || i) truncated to one block => unpredictable without the key;
+    uint8_t index_bytes[8];
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    sha256_ctx hash_ctx;
+    endian_store_be64(index_bytes, index);
+    sha256_init(&hash_ctx);
+    sha256_update(&hash_ctx, ctx->iv_key, SHA256_DIGEST_SIZE);
+    sha256_update(&hash_ctx, index_bytes, 8);
+    sha256_final(&hash_ctx, digest);
+    memcpy(iv, digest, AES_BLOCK_SIZE);
+}
+
+static void envelope_chunk_tag(const envelope_ctx* ctx, uint64_t index, const uint8_t* cipher, size_t cipher_len, uint8_t* tag) {
+    // HMAC(header hash || index || last || ciphertext), the header hash is already in the midstate;
+    uint8_t position[9];
+    uint8_t inner_digest[SHA256_DIGEST_SIZE];
+    sha256_ctx hash_ctx = ctx->mac_inner;
+    endian_store_be64(position, index);
+    position[8] = (index == ctx->nr_chunks - 1);
+    sha256_update(&hash_ctx, position, 9);
+    sha256_update(&hash_ctx, cipher, cipher_len);
+    sha256_final(&hash_ctx, inner_digest);
+    hash_ctx = ctx->mac_outer;
+    sha256_update(&hash_ctx, inner_digest, SHA256_DIGEST_SIZE);
+    sha256_final(&hash_ctx, tag);
+}
+
+void envelope_seal_chunk(const envelope_ctx* ctx, uint64_t index, const uint8_t* payload, uint8_t* chunk) {
+    size_t payload_len = 0;
+    size_t chunk_len = envelope_chunk_len(ctx, index, &payload_len);
+    size_t cipher_len = chunk_len - ENVELOPE_TAG_LEN;
+    size_t full_len = payload_len - payload_len % AES_BLOCK_SIZE;
+    uint8_t iv[AES_BLOCK_SIZE];
+    uint8_t block[AES_BLOCK_SIZE];
+    envelope_chunk_iv(ctx, index, iv);
+    aes_cbc_encrypt_blocks(&ctx->aes, iv, payload, chunk, full_len);
+    // Only the last chunk has a partial block, which PKCS7 pads to a full one;
+    if (cipher_len > full_len) {
+        memset(block, (int)(AES_BLOCK_SIZE - payload_len % AES_BLOCK_SIZE), AES_BLOCK_SIZE);
+        memcpy(block, payload + full_len, payload_len - full_len);
+        aes_cbc_encrypt_blocks(&ctx->aes, iv, block, chunk + full_len, AES_BLOCK_SIZE);
+    }
+    envelope_chunk_tag(ctx, index, chunk, cipher_len, chunk + cipher_len);
+}
+
+int envelope_open_chunk(const envelope_ctx* ctx, uint64_t index, const uint8_t* chunk, size_t chunk_len, uint8_t* payload) {
+    size_t payload_len = 0;
+    size_t cipher_len = 0;
+    size_t full_len = 0;
+    uint8_t iv[AES_BLOCK_SIZE];
+    uint8_t block[AES_BLOCK_SIZE];
+    uint8_t tag[ENVELOPE_TAG_LEN];
+    uint8_t difference = 0;
+    uint8_t padding = 0;
+    if ((index >= ctx->nr_chunks) || (chunk_len != envelope_chunk_len(ctx, index, &payload_len))) {
+        return -1;
+    }
+    cipher_len = chunk_len - ENVELOPE_TAG_LEN;
+    full_len = payload_len - payload_len % AES_BLOCK_SIZE;
+    // Encrypt-then-MAC: compare the tags in constant time before anything is decrypted;
+    envelope_chunk_tag(ctx, index, chunk, cipher_len, tag);
+    for (size_t i = 0; i < ENVELOPE_TAG_LEN; i++) {
+        difference |= tag[i] ^ chunk[cipher_len + i];
+    }
+    if (difference != 0) {
+        return -1;
+    }
+    envelope_chunk_iv(ctx, index, iv);
+    aes_cbc_decrypt_blocks(&ctx->aes, iv, chunk, payload, full_len);
+    if (cipher_len > full_len) {
+        aes_cbc_decrypt_blocks(&ctx->aes, iv, chunk + full_len, block, AES_BLOCK_SIZE);
+        // The tag already vouches for the padding, check it anyway;
+        padding = (uint8_t)(AES_BLOCK_SIZE - payload_len % AES_BLOCK_SIZE);
+        for (size_t i = payload_len - full_len; i < AES_BLOCK_SIZE; i++) {
+            difference |= block[i] ^ padding;
+        }
+        memcpy(payload + full_len, block, payload_len - full_len);
+        memset(block, 0, AES_BLOCK_SIZE);
+    }
+    return (difference == 0) ? 0 : -1;
+}
+
+static void envelope_seal_range(void* context, size_t start, size_t end) {
+    envelope_job* job = context;
+    for (uint64_t i = start; i < end; i++) {
+        envelope_seal_chunk(job->ctx, i, job->input + i * job->ctx->chunk_size, job->output + envelope_chunk_offset(job->ctx, i));
+    }
+}
+
+static void envelope_open_range(void* context, size_t start, size_t end) {
+    envelope_job* job = context;
+    size_t chunk_len = 0;
+    for (uint64_t i = start; i < end; i++) {
+        chunk_len = envelope_chunk_len(job->ctx, i, NULL);
+        if (envelope_open_chunk(job->ctx, i, job->input + envelope_chunk_offset(job->ctx, i), chunk_len,
+            job->output + i * job->ctx->chunk_size) != 0) {
+            __atomic_store_n(&job->status, -1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static int envelope_run(const envelope_ctx* ctx, const uint8_t* input, uint8_t* output, parallel_fn range) {
+    envelope_job job = { .ctx = ctx, .input = input, .output = output, .status = 0 };
+    // The chunks are independent, every range takes at least ENVELOPE_MIN_PER_THREAD of them;
+    parallel_for(ctx->nr_chunks, ENVELOPE_MIN_PER_THREAD, range, &job);
+    return job.status;
+}
+
+int envelope_seal(const rsa_public_key* key, const uint8_t* payload, size_t payload_len, uint32_t chunk_size,
+    uint8_t** sealed, size_t* sealed_len) {
+    envelope_ctx ctx;
+    uint8_t* header = safe_malloc(envelope_header_len(key));
+    if (envelope_seal_init(&ctx, key, payload_len, chunk_size, header) != 0) {
+        free(header);
+        return -1;
+    }
+    *sealed_len = envelope_chunk_offset(&ctx, ctx.nr_chunks - 1) + envelope_chunk_len(&ctx, ctx.nr_chunks - 1, NULL);
+    *sealed = safe_malloc(*sealed_len * sizeof **sealed);
+    memcpy(*sealed, header, ctx.header_len);
+    free(header);
+    envelope_run(&ctx, payload, *sealed, envelope_seal_range);
+    envelope_clear(&ctx);
+    return 0;
+}
+
+int envelope_open(const rsa_private_key* key, const uint8_t* sealed, size_t sealed_len, uint8_t** payload, size_t* payload_len) {
+    envelope_ctx ctx;
+    int status = 0;
+    *payload = NULL;
+    *payload_len = 0;
+    if (envelope_open_init(&ctx, key, sealed, sealed_len) != 0) {
+        return -1;
+    }
+    // The sealed envelope is always longer than its payload, which also bounds the chunk arithmetic;
+    if ((ctx.payload_len >= sealed_len) ||
+        (envelope_chunk_offset(&ctx, ctx.nr_chunks - 1) + envelope_chunk_len(&ctx, ctx.nr_chunks - 1, NULL) != sealed_len)) {
+        envelope_clear(&ctx);
+        return -1;
+    }
+    // One spare byte keeps the allocation valid for an empty payload;
+    *payload = safe_malloc((size_t)ctx.payload_len + 1);
+    status = envelope_run(&ctx, sealed, *payload, envelope_open_range);
+    if (status != 0) {
+        // Never hand out a partially authentic payload;
+        memset(*payload, 0, (size_t)ctx.payload_len);
+        free(*payload);
+        *payload = NULL;
+    } else {
+        *payload_len = (size_t)ctx.payload_len;
+    }
+    envelope_clear(&ctx);
+    return status;
+}
\ No newline at end of file
@@ -0,0 +1,159 @@
+#ifndef ENVELOPE_H
+#define ENVELOPE_H
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   This file implements hybrid envelope encryption for large payloads.
+ * @details A fresh 32 byte secret is wrapped for the recipient with RSA-OAEP, and the AES
+ *          key, MAC key and IV key are derived from it with SHA2-256. The payload is split
+ *          into chunks, each encrypted with AES-256-CBC under its own IV and authenticated
+ *          with HMAC-SHA2-256, so every chunk can be sealed and opened on its own thread.
+ *
+ *          header = ENVELOPE_MAGIC || version (1) || suite (1) || reserved (2)
+ *                   || chunk size (4) || payload length (8) || wrapped length (2) || wrapped key
+ *          chunk  = AES-256-CBC(payload chunk) || HMAC(header hash || index || last || ciphertext)
+ *
+ *          Only the last chunk is padded (PKCS7), the others hold exactly chunk size bytes.
+ * @author  Murea Cosmin Alexandru
+ * @date    01.03.2024
+ * ---------------------------------------------------------------------------------------- **/
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "../rsa/rsa.h"
+#include "../aes/aes.h"
+#include "../sha256/sha256.h"
+
+#define ENVELOPE_MAGIC "NHEV"
+#define ENVELOPE_VERSION 1
+// AES-256-CBC with HMAC-SHA2-256, keys derived with SHA2-256 from an RSA-OAEP wrapped secret;
+#define ENVELOPE_SUITE_AES256_CBC_HMAC 1
+// The length of the fixed part of the header, up to and including the wrapped key length;
+#define ENVELOPE_HEADER_FIXED_LEN 22
+#define ENVELOPE_SECRET_LEN 32
+#define ENVELOPE_TAG_LEN SHA256_DIGEST_SIZE
+#define ENVELOPE_CHUNK_SIZE 65536
+// The largest chunk size accepted, so a chunk always fits in memory;
+#define ENVELOPE_MAX_CHUNK_SIZE (1 << 30)
+// envelope_seal() and envelope_open() never give a thread less than this many chunks;
+#define ENVELOPE_MIN_PER_THREAD 4
+
+typedef struct {
+    // The keys derived from the wrapped secret;
+    aes_ctx aes;
+    uint8_t iv_key[SHA256_DIGEST_SIZE];
+    // The HMAC midstates after the padded MAC key, the inner one has also absorbed the
+    // header hash that binds every chunk to the header;
+    sha256_ctx mac_inner;
+    sha256_ctx mac_outer;
+    uint32_t chunk_size;
+    uint64_t payload_len;
+    uint64_t nr_chunks;
+    size_t header_len;
+} envelope_ctx;
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Computes the length of the header for a recipient key.
+ * @param   key         A pointer to the recipient's public key.
+ * @returns The length of the header in bytes.
+ * ---------------------------------------------------------------------------------------- **/
+size_t envelope_header_len(const rsa_public_key* key);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Wraps a fresh secret for the recipient, writes the header and derives the keys.
+ * @param   ctx         A pointer to the context to initialise.
+ * @param   key         A pointer to the recipient's public key.
+ * @param   payload_len The length of the whole payload in bytes.
+ * @param   chunk_size  The number of payload bytes per chunk, a multiple of AES_BLOCK_SIZE.
+ * @param   header      An array of envelope_header_len() bytes to hold the header.
+ * @returns 0 on success, -1 if the chunk size or the key is not usable, or the AES key
+ *          schedule fails.
+ * ---------------------------------------------------------------------------------------- **/
+int envelope_seal_init(envelope_ctx* ctx, const rsa_public_key* key, uint64_t payload_len, uint32_t chunk_size, uint8_t* header);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Unwraps the secret of a header and derives the keys.
+ * @details The RSA private operation runs once here, every chunk only needs the context.
+ * @param   ctx         A pointer to the context to initialise.
+ * @param   key         A pointer to the recipient's private key.
+ * @param   sealed      A pointer to the header (or the whole sealed envelope).
+ * @param   sealed_len  The number of bytes available at sealed.
+ * @returns 0 on success, -1 if the header is malformed, was not sealed for this key or the
+ *          AES key schedule fails.
+ * ---------------------------------------------------------------------------------------- **/
+int envelope_open_init(envelope_ctx* ctx, const rsa_private_key* key, const uint8_t* sealed, size_t sealed_len);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Wipes the keys of a context.
+ * @param   ctx         A pointer to the context.
+ * ---------------------------------------------------------------------------------------- **/
+void envelope_clear(envelope_ctx* ctx);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Computes the length of the payload and sealed data of a chunk.
+ * @param   ctx         A pointer to an initialised context.
+ * @param   index       The index of the chunk, below ctx->nr_chunks.
+ * @param   payload_len A pointer to hold the number of payload bytes in the chunk (can be NULL).
+ * @returns The length of the sealed chunk (ciphertext and tag) in bytes.
+ * ---------------------------------------------------------------------------------------- **/
+size_t envelope_chunk_len(const envelope_ctx* ctx, uint64_t index, size_t* payload_len);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Computes the offset of a sealed chunk from the start of the envelope.
+ * @param   ctx         A pointer to an initialised context.
+ * @param   index       The index of the chunk.
+ * @returns The offset of the chunk in bytes.
+ * ---------------------------------------------------------------------------------------- **/
+uint64_t envelope_chunk_offset(const envelope_ctx* ctx, uint64_t index);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Encrypts and authenticates one chunk.
+ * @details Chunks share nothing but the context, so any number of them can be sealed
+ *          concurrently.
+ * @param   ctx         A pointer to an initialised context.
+ * @param   index       The index of the chunk.
+ * @param   payload     A pointer to the payload bytes of the chunk.
+ * @param   chunk       An array of envelope_chunk_len() bytes to hold the sealed chunk.
+ * ---------------------------------------------------------------------------------------- **/
+void envelope_seal_chunk(const envelope_ctx* ctx, uint64_t index, const uint8_t* payload, uint8_t* chunk);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Authenticates and decrypts one chunk.
+ * @details Nothing is decrypted unless the tag matches.
+ * @param   ctx         A pointer to an initialised context.
+ * @param   index       The index of the chunk.
+ * @param   chunk       A pointer to the sealed chunk.
+ * @param   chunk_len   The length of the sealed chunk, which must be envelope_chunk_len().
+ * @param   payload     An array of the chunk's payload length to hold the payload bytes.
+ * @returns 0 on success, -1 if the chunk was modified, moved or truncated.
+ * ---------------------------------------------------------------------------------------- **/
+int envelope_open_chunk(const envelope_ctx* ctx, uint64_t index, const uint8_t* chunk, size_t chunk_len, uint8_t* payload);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Seals a whole payload for a recipient, with the chunks spread over all CPUs.
+ * @details The caller is responsible for freeing the memory allocated for the envelope.
+ * @param   key         A pointer to the recipient's public key.
+ * @param   payload     A pointer to the payload.
+ * @param   payload_len The length of the payload in bytes.
+ * @param   chunk_size  The number of payload bytes per chunk (ENVELOPE_CHUNK_SIZE if unsure).
+ * @param   sealed      A NULL pointer for storing the envelope as a byte array.
+ * @param   sealed_len  The length of the returned envelope in bytes.
+ * @returns 0 on success, -1 if the chunk size or the key is not usable.
+ * ---------------------------------------------------------------------------------------- **/
+int envelope_seal(const rsa_public_key* key, const uint8_t* payload, size_t payload_len, uint32_t chunk_size,
+    uint8_t** sealed, size_t* sealed_len);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Opens a whole envelope, with the chunks spread over all CPUs.
+ * @details The caller is responsible for freeing the memory allocated for the payload.
+ *          Nothing is returned unless every chunk is authentic.
+ * @param   key         A pointer to the recipient's private key.
+ * @param   sealed      A pointer to the envelope.
+ * @param   sealed_len  The length of the envelope in bytes.
+ * @param   payload     A NULL pointer for storing the payload as a byte array.
+ * @param   payload_len The length of the returned payload in bytes.
+ * @returns 0 on success, -1 if the envelope is malformed or any chunk is not authentic.
+ * ---------------------------------------------------------------------------------------- **/
+int envelope_open(const rsa_private_key* key, const uint8_t* sealed, size_t sealed_len, uint8_t** payload, size_t* payload_len);
+
+#endif
\ No newline at end of file
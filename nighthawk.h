@@ -0,0 +1,34 @@
+#ifndef NIGHTHAWK_H
+#define NIGHTHAWK_H
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   The public header of libnighthawk, it pulls in the API of every module.
+ * @details Build the library with the makefile at the root of the tree and link with
+ *          -lnighthawk -lgmp -lm -pthread. The module headers stay where they are, so code
+ *          inside the tree can keep including only what it uses.
+ * @author  Murea Cosmin Alexandru
+ * @date    01.03.2024
+ * ---------------------------------------------------------------------------------------- **/
+
+#include "utils/general.h"
+#include "utils/arena.h"
+#include "utils/pool.h"
+#include "utils/cpu_features.h"
+#include "utils/endian.h"
+#include "utils/stats.h"
+#include "utils/threadpool.h"
+#include "utils/hex.h"
+#include "utils/pkcs7.h"
+#include "utils/rsp.h"
+#include "utils/seed.h"
+#include "utils/drbg.h"
+#include "aes/aes.h"
+#include "sha256/sha256.h"
+#include "chaos/chaos.h"
+#include "chaos/lorenz.h"
+#include "chaos/health.h"
+#include "rsa/rsa.h"
+#include "envelope/envelope.h"
+#include "selftest/selftest.h"
+
+#endif
\ No newline at end of file
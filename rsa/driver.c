@@ -1,4 +1,333 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
 #include "rsa.h"
+#include "../utils/general.h"
+
+// The number of keys generated for every benchmarked modulus size;
+#define KEYGEN_RUNS 4
+// The batch verification benchmark uses BATCH_KEYS keys with BATCH_PER_KEY signatures each;
+#define BATCH_KEYS 4
+#define BATCH_PER_KEY 128
+#define BATCH_MESSAGE_LEN 64
+// The number of private (CRT) and public operations timed per modulus size;
+#define POWM_PRIVATE_OPS 100
+#define POWM_PUBLIC_OPS 5000
+#define POWM_ROUNDS 3
+// The number of public operations timed through the byte and the integer interfaces;
+#define BYTES_OPS 5000
+// The number of private operations timed for every prime count of a multi-prime key;
+#define MULTIPRIME_OPS 20
+
+static double elapsed(const struct timespec* start, const struct timespec* end) {
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static const char* corrupted_import(rsa_private_key* key, mpz_ptr field, const mpz_t delta) {
+    // Export the key with delta added to one field, then restore the field;
+    rsa_private_key imported_key;
+    int status = 0;
+    mpz_add(field, field, delta);
+    size_t key_len = rsa_private_key_export(key, NULL, 0);
+    uint8_t* key_bytes = safe_malloc(key_len);
+    rsa_private_key_export(key, key_bytes, key_len);
+    mpz_sub(field, field, delta);
+    rsa_private_key_init(&imported_key);
+    status = rsa_private_key_import(&imported_key, key_bytes, key_len);
+    rsa_private_key_clear(&imported_key);
+    free(key_bytes);
+    return (status == 0) ? "accepted" : "rejected";
+}
+
+static void keygen_benchmark(size_t bits) {
+    struct timespec start, end;
+    double seconds = 0.0, total = 0.0, fastest = 0.0, slowest = 0.0;
+    rsa_private_key key;
+    rsa_private_key_init(&key);
+    for (size_t i = 0; i < KEYGEN_RUNS; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (rsa_keygen(bits, 65537, &key) != 0) {
+            fprintf(stderr, "Key generation failed.\n");
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        seconds = elapsed(&start, &end);
+        total += seconds;
+        fastest = ((i == 0) || (seconds < fastest)) ? seconds : fastest;
+        slowest = (seconds > slowest) ? seconds : slowest;
+        if (mpz_sizeinbase(key.n, 2) != bits) {
+            fprintf(stderr, "Generated a modulus of the wrong size.\n");
+        }
+    }
+    printf("RSA-%zu key generation: mean %.3f s, min %.3f s, max %.3f s (%d keys)\n", bits, total / KEYGEN_RUNS, fastest, slowest, KEYGEN_RUNS);
+    rsa_private_key_clear(&key);
+}
+
+static void oaep_demo(size_t bits) {
+    const uint8_t label[] = "nighthawk";
+    const uint8_t message[] = "A per-message key wrapped with RSA-OAEP";
+    rsa_private_key private_key;
+    rsa_public_key public_key;
+    rsa_private_key_init(&private_key);
+    rsa_public_key_init(&public_key);
+    rsa_keygen(bits, 65537, &private_key);
+    rsa_public_key_from_private(&private_key, &public_key);
+    size_t k = rsa_modulus_len(public_key.n);
+    uint8_t cipher[k];
+    uint8_t decrypted[k];
+    size_t decrypted_len = 0;
+    rsa_oaep_encrypt(&public_key, message, sizeof message - 1, label, sizeof label - 1, cipher);
+    if ((rsa_oaep_decrypt(&private_key, cipher, k, label, sizeof label - 1, decrypted, &decrypted_len) == 0) &&
+        (decrypted_len == sizeof message - 1) && (memcmp(decrypted, message, decrypted_len) == 0)) {
+        printf("RSA-%zu OAEP round trip: %.*s\n", bits, (int)decrypted_len, decrypted);
+    } else {
+        printf("RSA-%zu OAEP round trip failed\n", bits);
+    }
+    // A flipped ciphertext bit or a different label must both be rejected;
+    cipher[k / 2] ^= 0x01;
+    printf("Tampered ciphertext: %s\n", (rsa_oaep_decrypt(&private_key, cipher, k, label, sizeof label - 1, decrypted, &decrypted_len) == 0) ? "accepted" : "rejected");
+    cipher[k / 2] ^= 0x01;
+    printf("Wrong label: %s\n", (rsa_oaep_decrypt(&private_key, cipher, k, NULL, 0, decrypted, &decrypted_len) == 0) ? "accepted" : "rejected");
+    rsa_public_key_clear(&public_key);
+    rsa_private_key_clear(&private_key);
+}
+
+static void batch_benchmark(size_t bits) {
+    struct timespec start, end;
+    rsa_private_key private_keys[BATCH_KEYS];
+    rsa_public_key public_keys[BATCH_KEYS];
+    size_t count = BATCH_KEYS * BATCH_PER_KEY;
+    size_t k = bits / 8;
+    uint8_t* messages = safe_malloc(count * BATCH_MESSAGE_LEN);
+    uint8_t* signatures = safe_malloc(count * k);
+    rsa_verify_item* items = safe_malloc(count * sizeof *items);
+    int* results = safe_malloc(count * sizeof *results);
+    size_t valid = 0, single_valid = 0;
+    double batch_time = 0.0, single_time = 0.0;
+    for (size_t i = 0; i < BATCH_KEYS; i++) {
+        rsa_private_key_init(&private_keys[i]);
+        rsa_public_key_init(&public_keys[i]);
+        rsa_keygen(bits, 65537, &private_keys[i]);
+        rsa_public_key_from_private(&private_keys[i], &public_keys[i]);
+    }
+    // Items are grouped by key and every 16th signature is corrupted;
+    for (size_t i = 0; i < count; i++) {
+        memset(messages + i * BATCH_MESSAGE_LEN, (int)i, BATCH_MESSAGE_LEN);
+        rsa_pss_sign(&private_keys[i / BATCH_PER_KEY], messages + i * BATCH_MESSAGE_LEN, BATCH_MESSAGE_LEN, signatures + i * k);
+        if (i % 16 == 15) {
+            signatures[i * k + k / 2] ^= 0x01;
+        }
+        items[i] = (rsa_verify_item){ &public_keys[i / BATCH_PER_KEY], messages + i * BATCH_MESSAGE_LEN, BATCH_MESSAGE_LEN, signatures + i * k, k };
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < count; i++) {
+        single_valid += (rsa_pss_verify(items[i].key, items[i].message, items[i].message_len, items[i].signature, items[i].signature_len) == 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    single_time = elapsed(&start, &end);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    valid = rsa_verify_batch(items, count, results);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    batch_time = elapsed(&start, &end);
+    printf("RSA-%zu PSS verification: %zu / %zu valid, one by one %.0f /s, batched %.0f /s\n", bits, valid, count,
+        count / single_time, count / batch_time);
+    if ((valid != single_valid) || (results[15] == 0) || (results[0] != 0)) {
+        printf("Batch results do not match the individual verifications\n");
+    }
+    for (size_t i = 0; i < BATCH_KEYS; i++) {
+        rsa_public_key_clear(&public_keys[i]);
+        rsa_private_key_clear(&private_keys[i]);
+    }
+    free(messages);
+    free(signatures);
+    free(items);
+    free(results);
+}
+
+static void bytes_demo(size_t bits) {
+    struct timespec start, end;
+    rsa_private_key private_key;
+    rsa_public_key public_key;
+    double bytes_rate = 0.0, mpz_rate = 0.0;
+    mpz_t value;
+    rsa_private_key_init(&private_key);
+    rsa_public_key_init(&public_key);
+    rsa_keygen(bits, 65537, &private_key);
+    rsa_public_key_from_private(&private_key, &public_key);
+    size_t k = rsa_modulus_len(public_key.n);
+    uint8_t plain[k];
+    uint8_t buffer[k];
+    // A leading zero byte keeps the representative below n;
+    for (size_t i = 0; i < k; i++) {
+        plain[i] = (uint8_t)(i * 31 + 7);
+    }
+    plain[0] = 0x00;
+    rsa_encrypt_bytes(&public_key, plain, k, buffer);
+    rsa_decrypt_bytes(&private_key, buffer, k, buffer);
+    printf("RSA-%zu byte round trip: %s\n", bits, (memcmp(plain, buffer, k) == 0) ? "ok" : "failed");
+    memset(buffer, 0xFF, k);
+    printf("Representative above n: %s\n", (rsa_encrypt_bytes(&public_key, buffer, k, buffer) == 0) ? "accepted" : "rejected");
+    printf("Short buffer: %s\n", (rsa_decrypt_bytes(&private_key, plain, k - 1, buffer) == 0) ? "accepted" : "rejected");
+    // The same encryptions through the bytes API and through a fresh integer per call;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < BYTES_OPS; i++) {
+        rsa_encrypt_bytes(&public_key, plain, k, buffer);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    bytes_rate = BYTES_OPS / elapsed(&start, &end);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < BYTES_OPS; i++) {
+        mpz_init(value);
+        mpz_import(value, k, 1, 1, 1, 0, plain);
+        rsa_encrypt(value, &public_key, value);
+        memset(buffer, 0, k);
+        mpz_export(buffer + k - (mpz_sizeinbase(value, 2) + 7) / 8, NULL, 1, 1, 1, 0, value);
+        mpz_clear(value);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    mpz_rate = BYTES_OPS / elapsed(&start, &end);
+    printf("RSA-%zu byte encryption: %.0f /s with scratch, %.0f /s with a fresh integer\n", bits, bytes_rate, mpz_rate);
+    rsa_public_key_clear(&public_key);
+    rsa_private_key_clear(&private_key);
+}
+
+static void plain_crt(const mpz_t input, const rsa_private_key* key, mpz_t output, uint8_t secure) {
+    // The private operation without blinding, as it was done before;
+    mpz_t m1, m2, h;
+    mpz_inits(m1, m2, h, NULL);
+    if (secure) {
+        mpz_powm_sec(m1, input, key->dp, key->p);
+        mpz_powm_sec(m2, input, key->dq, key->q);
+    } else {
+        mpz_powm(m1, input, key->dp, key->p);
+        mpz_powm(m2, input, key->dq, key->q);
+    }
+    mpz_sub(h, m1, m2);
+    mpz_mul(h, h, key->q_inv);
+    mpz_mod(h, h, key->p);
+    mpz_mul(h, h, key->q);
+    mpz_add(output, m2, h);
+    mpz_clears(m1, m2, h, NULL);
+}
+
+// The private operation variants timed by private_benchmark();
+typedef enum {
+    PRIVATE_MPZ_POWM,
+    PRIVATE_MPZ_POWM_SEC,
+    PRIVATE_HARDENED
+} private_variant;
+
+static double time_private(const rsa_private_key* key, mpz_t value, private_variant variant, size_t ops) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < ops; i++) {
+        if (variant == PRIVATE_HARDENED) {
+            rsa_decrypt(value, key, value);
+        } else {
+            plain_crt(value, key, value, variant == PRIVATE_MPZ_POWM_SEC);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ops / elapsed(&start, &end);
+}
+
+static double time_public(const rsa_public_key* key, mpz_t value, size_t ops) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < ops; i++) {
+        rsa_encrypt(value, key, value);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ops / elapsed(&start, &end);
+}
+
+static void powm_benchmark(size_t bits) {
+    rsa_private_key private_key;
+    rsa_public_key public_key;
+    double plain = 0.0, secure = 0.0, hardened = 0.0, public = 0.0;
+    mpz_t value, check;
+    rsa_private_key_init(&private_key);
+    rsa_public_key_init(&public_key);
+    rsa_keygen(bits, 65537, &private_key);
+    rsa_public_key_from_private(&private_key, &public_key);
+    mpz_init_set_ui(value, 0x1234567);
+    mpz_init(check);
+    // The hardened path must agree with the plain one;
+    rsa_decrypt(value, &private_key, check);
+    plain_crt(value, &private_key, value, 0);
+    if (mpz_cmp(value, check) != 0) {
+        printf("Blinded decryption does not match the plain CRT\n");
+    }
+    // Interleave the variants and keep the best round of each, so frequency changes hit them alike;
+    for (size_t round = 0; round < POWM_ROUNDS; round++) {
+        plain = fmax(plain, time_private(&private_key, value, PRIVATE_MPZ_POWM, POWM_PRIVATE_OPS));
+        secure = fmax(secure, time_private(&private_key, value, PRIVATE_MPZ_POWM_SEC, POWM_PRIVATE_OPS));
+        hardened = fmax(hardened, time_private(&private_key, value, PRIVATE_HARDENED, POWM_PRIVATE_OPS));
+    }
+    public = time_public(&public_key, value, POWM_PUBLIC_OPS);
+    printf("RSA-%zu private ops: %.0f /s mpz_powm, %.0f /s mpz_powm_sec, %.0f /s mpn_sec_powm + blinding (hardening costs %.1f%%)\n",
+        bits, plain, secure, hardened, (plain / hardened - 1.0) * 100.0);
+    printf("RSA-%zu public ops: %.0f /s\n", bits, public);
+    mpz_clears(value, check, NULL);
+    rsa_public_key_clear(&public_key);
+    rsa_private_key_clear(&private_key);
+}
+
+static void multiprime_benchmark(size_t bits) {
+    rsa_private_key private_key, imported_key;
+    rsa_public_key public_key;
+    double rate = 0.0, two_prime_rate = 0.0;
+    size_t key_len = 0;
+    mpz_t value, check;
+    mpz_inits(value, check, NULL);
+    rsa_private_key_init(&imported_key);
+    rsa_public_key_init(&public_key);
+    for (size_t nr_primes = 2; nr_primes <= RSA_MAX_PRIMES; nr_primes++) {
+        rsa_private_key_init(&private_key);
+        if ((rsa_keygen_multiprime(bits, nr_primes, 65537, &private_key) != 0) || (mpz_sizeinbase(private_key.n, 2) != bits)) {
+            printf("RSA-%zu key generation with %zu primes failed\n", bits, nr_primes);
+            rsa_private_key_clear(&private_key);
+            continue;
+        }
+        rsa_public_key_from_private(&private_key, &public_key);
+        // The key must survive the binary format and still decrypt what the public key encrypts;
+        key_len = rsa_private_key_export(&private_key, NULL, 0);
+        uint8_t key_bytes[key_len];
+        rsa_private_key_export(&private_key, key_bytes, key_len);
+        mpz_set_ui(value, 0x616263);
+        rsa_encrypt(value, &public_key, check);
+        if ((rsa_private_key_import(&imported_key, key_bytes, key_len) != 0) || (imported_key.nr_primes != nr_primes)) {
+            printf("RSA-%zu key with %zu primes: import failed\n", bits, nr_primes);
+        } else {
+            rsa_decrypt(check, &imported_key, check);
+            if (mpz_cmp(value, check) != 0) {
+                printf("RSA-%zu key with %zu primes: decryption failed\n", bits, nr_primes);
+            }
+        }
+        // The exponent and coefficient of the last prime must follow from the others;
+        if (nr_primes > 2) {
+            mpz_set_ui(check, 2);
+            printf("RSA-%zu key with %zu primes, corrupted d_%zu import: %s\n", bits, nr_primes, nr_primes,
+                corrupted_import(&private_key, private_key.dr[nr_primes - 3], check));
+            mpz_set_ui(check, 1);
+            printf("RSA-%zu key with %zu primes, corrupted t_%zu import: %s\n", bits, nr_primes, nr_primes,
+                corrupted_import(&private_key, private_key.t[nr_primes - 3], check));
+        }
+        rate = 0.0;
+        for (size_t round = 0; round < POWM_ROUNDS; round++) {
+            rate = fmax(rate, time_private(&private_key, value, PRIVATE_HARDENED, MULTIPRIME_OPS));
+        }
+        two_prime_rate = (nr_primes == 2) ? rate : two_prime_rate;
+        printf("RSA-%zu private ops with %zu primes: %.0f /s, %.3f ms each (%.2fx the two-prime key)\n",
+            bits, nr_primes, rate, 1e3 / rate, rate / two_prime_rate);
+        rsa_private_key_clear(&private_key);
+    }
+    mpz_clears(value, check, NULL);
+    rsa_public_key_clear(&public_key);
+    rsa_private_key_clear(&imported_key);
+}
 
 int main() {
     char p[] = "618970019642690137449562111";
@@ -6,13 +335,57 @@ int main() {
     char e[] = "170141183460469231731687303715884105727";
     uint8_t msg[3] = { 0x61, 0x62, 0x63 };
     rsa(msg, 3, p, q, e);
-    // mpz_t p, q, n, e, d;
-    // mpz_inits(p, q, n, e, d, NULL);
-    // mpz_set_str(p, "618970019642690137449562111", 10);
-    // mpz_set_str(q, "162259276829213363391578010288127", 10);
-    // mpz_set_str(n, "0", 10);
-    // mpz_set_str(e, "0", 10);
-    // mpz_set_str(d, "0", 10);
-    // rsa_generate_keys(p, q, n, e, d);
+    // Derive the key once, then round trip it through the binary format;
+    mpz_t p_value, q_value, e_value, plain, cipher, decrypted, signature;
+    rsa_private_key private_key, imported_key;
+    rsa_public_key public_key;
+    mpz_inits(plain, cipher, decrypted, signature, NULL);
+    mpz_init_set_str(p_value, p, 10);
+    mpz_init_set_str(q_value, q, 10);
+    mpz_init_set_str(e_value, e, 10);
+    rsa_private_key_init(&private_key);
+    rsa_private_key_init(&imported_key);
+    rsa_public_key_init(&public_key);
+    if (rsa_generate_decryption_key(p_value, q_value, e_value, &private_key) == 0) {
+        size_t private_len = rsa_private_key_export(&private_key, NULL, 0);
+        uint8_t private_bytes[private_len];
+        rsa_private_key_export(&private_key, private_bytes, private_len);
+        rsa_public_key_from_private(&private_key, &public_key);
+        size_t public_len = rsa_public_key_export(&public_key, NULL, 0);
+        uint8_t public_bytes[public_len];
+        rsa_public_key_export(&public_key, public_bytes, public_len);
+        printf("Exported private key: %zu bytes, public key: %zu bytes\n", private_len, public_len);
+        if ((rsa_private_key_import(&imported_key, private_bytes, private_len) == 0) &&
+            (rsa_public_key_import(&public_key, public_bytes, public_len) == 0)) {
+            mpz_set_ui(plain, 0x616263);
+            rsa_encrypt(plain, &public_key, cipher);
+            rsa_decrypt(cipher, &imported_key, decrypted);
+            rsa_sign(plain, &imported_key, signature, 1);
+            printf("Imported key decryption: %s\n", (mpz_cmp(plain, decrypted) == 0) ? "ok" : "failed");
+            printf("Imported key signature: %s\n", (rsa_verify(plain, signature, &public_key) == 0) ? "valid" : "invalid");
+        }
+        // A truncated key must be rejected;
+        printf("Truncated key import: %s\n", (rsa_private_key_import(&imported_key, private_bytes, private_len - 1) == 0) ? "accepted" : "rejected");
+        // The CRT fields must follow from p, q and d, an exponent longer than its prime included;
+        mpz_set_ui(plain, 2);
+        printf("Corrupted dP import: %s\n", corrupted_import(&private_key, private_key.dp, plain));
+        mpz_set_ui(plain, 1);
+        printf("Corrupted qInv import: %s\n", corrupted_import(&private_key, private_key.q_inv, plain));
+        mpz_sub_ui(plain, private_key.p, 1);
+        mpz_mul_2exp(plain, plain, 4096);
+        printf("Oversized dP import: %s\n", corrupted_import(&private_key, private_key.dp, plain));
+    }
+    oaep_demo(2048);
+    bytes_demo(2048);
+    batch_benchmark(2048);
+    powm_benchmark(2048);
+    powm_benchmark(4096);
+    multiprime_benchmark(4096);
+    keygen_benchmark(3072);
+    keygen_benchmark(4096);
+    rsa_public_key_clear(&public_key);
+    rsa_private_key_clear(&imported_key);
+    rsa_private_key_clear(&private_key);
+    mpz_clears(p_value, q_value, e_value, plain, cipher, decrypted, signature, NULL);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include <string.h>
+
+#include "mont.h"
+#include "../utils/general.h"
+
+static mp_limb_t mont_inverse_limb(mp_limb_t n0) {
+    // Newton's iteration x = x * (2 - n0 * x) doubles the correct low bits of n0^-1 each step;
+    // n0 * n0 = 1 (mod 8) for every odd n0, so n0 is its own inverse to 3 bits;
+    mp_limb_t x = n0;
+    for (size_t i = 0; i < 6; i++) {
+        x *= 2 - n0 * x;
+    }
+    return x;
+}
+
+static void mont_redc(const mont_ctx* ctx, mp_limb_t* result, mp_limb_t* product) {
+    mp_size_t size = ctx->size;
+    mp_limb_t carry = 0;
+    mp_limb_t borrow = 0;
+    // Clear one limb per row: product += (product[i] * n0inv mod 2^64) * n * 2^(64 * i);
+    for (mp_size_t i = 0; i < size; i++) {
+        // The row leaves product[i] = 0, so it can hold the carry out of the row until the end;
+        product[i] = mpn_addmul_1(product + i, ctx->modulus, size, product[i] * ctx->n0inv);
+    }
+    // The carries belong size limbs higher, which is where the upper half of the product sits;
+    carry = mpn_add_n(result, product + size, product, size);
+    // The result is below 2n => keep result - n (computed into the spent lower half) if it did not borrow;
+    borrow = mpn_sub_n(product, result, ctx->modulus, size);
+    mpn_cnd_swap(carry | (borrow ^ 1), result, product, size);
+}
+
+static void mont_mul(const mont_ctx* ctx, mp_limb_t* result, const mp_limb_t* a, const mp_limb_t* b, mp_limb_t* scratch) {
+    if (a == b) {
+        mpn_sqr(scratch, a, ctx->size);
+    } else {
+        mpn_mul_n(scratch, a, b, ctx->size);
+    }
+    mont_redc(ctx, result, scratch);
+}
+
+static void mont_limbs(mp_limb_t* limbs, mp_size_t size, const mpz_t value) {
+    // Copy a reduced value into exactly size limbs;
+    mp_size_t value_size = mpz_size(value);
+    mpn_zero(limbs, size);
+    if (value_size > 0) {
+        mpn_copyi(limbs, mpz_limbs_read(value), value_size);
+    }
+}
+
+static void mont_reduce(const mont_ctx* ctx, mp_limb_t* limbs, const mpz_t value) {
+    // Reduce a non-negative value modulo n into exactly size limbs, the values are secret => constant-time division;
+    mp_size_t value_size = mpz_size(value);
+    if (value_size < ctx->size) {
+        mont_limbs(limbs, ctx->size, value);
+        return;
+    }
+    mp_limb_t remainder[value_size];
+    mp_limb_t scratch[mpn_sec_div_r_itch(value_size, ctx->size)];
+    mpn_copyi(remainder, mpz_limbs_read(value), value_size);
+    mpn_sec_div_r(remainder, value_size, ctx->modulus, ctx->size, scratch);
+    mpn_copyi(limbs, remainder, ctx->size);
+    secure_zero(remainder, sizeof remainder);
+    secure_zero(scratch, sizeof scratch);
+}
+
+void mont_init(mont_ctx* ctx) {
+    memset(ctx, 0, sizeof *ctx);
+}
+
+int mont_set(mont_ctx* ctx, const mpz_t modulus) {
+    mpz_t temp;
+    mont_clear(ctx);
+    if ((mpz_cmp_ui(modulus, 1) <= 0) || mpz_even_p(modulus)) {
+        return -1;
+    }
+    ctx->size = mpz_size(modulus);
+    ctx->modulus = safe_malloc(2 * ctx->size * sizeof *ctx->modulus);
+    ctx->r2 = ctx->modulus + ctx->size;
+    mont_limbs(ctx->modulus, ctx->size, modulus);
+    ctx->n0inv = -mont_inverse_limb(ctx->modulus[0]);
+    // R^2 mod n is computed once with mpz;
+    mpz_init(temp);
+    mpz_setbit(temp, 2 * GMP_NUMB_BITS * ctx->size);
+    mpz_mod(temp, temp, modulus);
+    mont_limbs(ctx->r2, ctx->size, temp);
+    mpz_clear(temp);
+    return 0;
+}
+
+int mont_ready(const mont_ctx* ctx) {
+    return ctx->size > 0;
+}
+
+void mont_clear(mont_ctx* ctx) {
+    // Wipe the constants before the memory is released;
+    if (ctx->modulus != NULL) {
+        secure_zero(ctx->modulus, 2 * ctx->size * sizeof *ctx->modulus);
+    }
+    free(ctx->modulus);
+    memset(ctx, 0, sizeof *ctx);
+}
+
+void mont_to(const mont_ctx* ctx, mpz_t result, const mpz_t value) {
+    mp_size_t size = ctx->size;
+    mp_limb_t limbs[size];
+    mp_limb_t scratch[2 * size];
+    mont_reduce(ctx, limbs, value);
+    // value * R mod n = REDC(value * R^2);
+    mont_mul(ctx, limbs, limbs, ctx->r2, scratch);
+    mpn_copyi(mpz_limbs_write(result, size), limbs, size);
+    mpz_limbs_finish(result, size);
+}
+
+void mont_mulmod(const mont_ctx* ctx, mpz_t result, const mpz_t a, const mpz_t b) {
+    mp_size_t size = ctx->size;
+    mp_limb_t a_limbs[size];
+    mp_limb_t b_limbs[size];
+    mp_limb_t scratch[2 * size];
+    mont_limbs(a_limbs, size, a);
+    mont_limbs(b_limbs, size, b);
+    mont_mul(ctx, a_limbs, a_limbs, b_limbs, scratch);
+    mpn_copyi(mpz_limbs_write(result, size), a_limbs, size);
+    mpz_limbs_finish(result, size);
+    secure_zero(b_limbs, sizeof b_limbs);
+    secure_zero(scratch, sizeof scratch);
+}
\ No newline at end of file
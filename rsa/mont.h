@@ -0,0 +1,73 @@
+#ifndef MONT_H
+#define MONT_H
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   This file implements Montgomery arithmetic on top of the GMP mpn layer.
+ * @details A context holds the constants of one odd modulus (-n^-1 mod 2^64 and R^2 mod n,
+ *          where R = 2^(64 * size)), so repeated products with the same modulus
+ *          take a fixed number of limb operations and skip a division each.
+ * @author  Murea Cosmin Alexandru
+ * @date    17.03.2024
+ * ---------------------------------------------------------------------------------------- **/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <gmp.h>
+
+typedef struct {
+    // The number of limbs of the modulus (0 if the context is empty);
+    mp_size_t size;
+    // -n^-1 mod 2^GMP_NUMB_BITS;
+    mp_limb_t n0inv;
+    mp_limb_t* modulus;
+    // R^2 mod n (converts into Montgomery form);
+    mp_limb_t* r2;
+} mont_ctx;
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Sets up an empty context, which mont_ready() reports as not usable.
+ * @param   ctx         A pointer to the context.
+ * ---------------------------------------------------------------------------------------- **/
+void mont_init(mont_ctx* ctx);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Precomputes the Montgomery constants of a modulus.
+ * @param   ctx         A pointer to an initialised context (previous constants are freed).
+ * @param   modulus     An odd modulus greater than 1.
+ * @returns 0 on success, -1 if the modulus is even or too small.
+ * ---------------------------------------------------------------------------------------- **/
+int mont_set(mont_ctx* ctx, const mpz_t modulus);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Reports whether a context holds the constants of a modulus.
+ * @param   ctx         A pointer to the context.
+ * @returns 1 if mont_set() succeeded on the context, 0 otherwise.
+ * ---------------------------------------------------------------------------------------- **/
+int mont_ready(const mont_ctx* ctx);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Frees the constants of a context and leaves it empty.
+ * @param   ctx         A pointer to the context.
+ * ---------------------------------------------------------------------------------------- **/
+void mont_clear(mont_ctx* ctx);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Converts a value into Montgomery form: value * R mod n.
+ * @param   ctx         A pointer to a ready context for n.
+ * @param   result      An initialised integer to hold the result (may alias value).
+ * @param   value       The value (reduced modulo n first if needed).
+ * ---------------------------------------------------------------------------------------- **/
+void mont_to(const mont_ctx* ctx, mpz_t result, const mpz_t value);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Computes the Montgomery product a * b * R^-1 mod n.
+ * @details The running time depends only on the size of n. With b in Montgomery form the
+ *          result is simply a * b' mod n, where b' is the value b represents.
+ * @param   ctx         A pointer to a ready context for n.
+ * @param   result      An initialised integer to hold the result (may alias a or b).
+ * @param   a           The first factor, 0 <= a < n.
+ * @param   b           The second factor, 0 <= b < n.
+ * ---------------------------------------------------------------------------------------- **/
+void mont_mulmod(const mont_ctx* ctx, mpz_t result, const mpz_t a, const mpz_t b);
+
+#endif
\ No newline at end of file
@@ -1,122 +1,1157 @@
 #include <stdio.h>
 #include <string.h>
-#include <assert.h>
+#include <pthread.h>
 
 #include "rsa.h"
 #include "../sha256/sha256.h"
 #include "../utils/general.h"
+#include "../utils/drbg.h"
+#include "../utils/seed.h"
+#include "../chaos/chaos.h"
+#include "../utils/stats.h"
+#include "../utils/endian.h"
+#include "../utils/threadpool.h"
 
-static void rsa_generate_decryption_key(const mpz_t p, const mpz_t q, const mpz_t enc_key, mpz_t n, mpz_t dec_key) {
-    // Multiply two big primes (p & q) to obtain the modulo (n);
-    mpz_mul(n, p, q);
-    mpz_t temp, p_temp, q_temp, lambda, gcd, product;
+// The length of the key format header: magic (4) || version (1) || type (1) || count (2);
+#define RSA_KEY_HEADER_LEN 8
+// The length prefix of every integer in the key format;
+#define RSA_KEY_FIELD_PREFIX 4
+#define RSA_PUBLIC_FIELDS 2
+#define RSA_PRIVATE_FIELDS 8
+// Every additional prime of a multi-prime key adds the fields r_i, d_i and t_i;
+#define RSA_PRIME_FIELDS 3
+// The number of odd primes the candidates are sieved with (3 up to 17881);
+#define RSA_SIEVE_PRIMES 2048
+// The number of consecutive odd candidates covered by one sieve window;
+#define RSA_SIEVE_SPAN 4096
+// mpz_probab_prime_p() runs Baillie-PSW and reps - 24 Miller-Rabin rounds => BPSW plus 4 rounds,
+// which exceeds the FIPS 186-5 requirement for random primes of 1024 bits or more;
+#define RSA_PRIME_REPS 28
+// The number of bytes drawn from the chaotic maps and mixed into the DRBG seeds;
+#define RSA_CHAOS_LEN 32
+
+struct rsa_blinding {
+    pthread_mutex_t mutex;
+    // The pair (r^e, r^-1) mod n, both kept in Montgomery form;
+    mpz_t blind;
+    mpz_t unblind;
+    uint8_t ready;
+};
+
+typedef struct {
+    mpz_t prime;
+    size_t bits;
+    unsigned long enc_key;
+    const char* domain;
+    const uint8_t* chaos;
+} rsa_prime_job;
+
+typedef struct {
+    // The integers one thread reuses for every private operation and byte conversion;
+    mpz_t value;
+    mpz_t signature;
+    mpz_t check;
+    mpz_t h;
+    mpz_t term;
+    mpz_t modulus;
+    mpz_t blind;
+    mpz_t unblind;
+    mpz_t results[RSA_MAX_PRIMES];
+} rsa_scratch;
+
+typedef struct {
+    // One exponentiation of a private operation: result = base^exponent mod modulus;
+    mpz_ptr result;
+    mpz_srcptr base;
+    mpz_srcptr exponent;
+    mpz_srcptr modulus;
+} rsa_crt_job;
+
+typedef struct {
+    // The sizes of one public key that every verification with it needs;
+    const rsa_public_key* key;
+    size_t k;
+    size_t em_bits;
+    size_t em_len;
+} rsa_verify_ctx;
+
+typedef struct {
+    const rsa_verify_item* items;
+    int* results;
+    // The valid signatures summed over the ranges;
+    size_t valid;
+} rsa_batch_job;
+
+typedef struct {
+    rsa_prime_job* jobs;
+    const uint8_t* pending;
+} rsa_prime_search;
+
+static uint32_t rsa_small_primes[RSA_SIEVE_PRIMES];
+static pthread_once_t rsa_small_primes_once = PTHREAD_ONCE_INIT;
+static pthread_key_t rsa_scratch_key;
+static pthread_once_t rsa_scratch_once = PTHREAD_ONCE_INIT;
+
+static void rsa_wipe(mpz_t value) {
+    // Overwrite every allocated limb, stale high limbs of an earlier value included;
+    mp_size_t size = value->_mp_alloc;
+    mpn_zero(mpz_limbs_modify(value, size), size);
+    mpz_limbs_finish(value, 0);
+}
+
+static void rsa_scratch_free(void* arg) {
+    rsa_scratch* scratch = arg;
+    mpz_ptr values[] = { scratch->value, scratch->signature, scratch->check, scratch->h, scratch->term, scratch->modulus,
+        scratch->blind, scratch->unblind };
+    for (size_t i = 0; i < sizeof values / sizeof values[0]; i++) {
+        rsa_wipe(values[i]);
+        mpz_clear(values[i]);
+    }
+    for (size_t i = 0; i < RSA_MAX_PRIMES; i++) {
+        rsa_wipe(scratch->results[i]);
+        mpz_clear(scratch->results[i]);
+    }
+    free(scratch);
+}
+
+static void rsa_init_scratch_key(void) {
+    if (pthread_key_create(&rsa_scratch_key, rsa_scratch_free) != 0) {
+        fprintf(stderr, "Could not create the RSA scratch key. Proceeding to crash. Cleaning up...");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static rsa_scratch* rsa_scratch_get(void) {
+    rsa_scratch* scratch = NULL;
+    pthread_once(&rsa_scratch_once, rsa_init_scratch_key);
+    scratch = pthread_getspecific(rsa_scratch_key);
+    if (scratch != NULL) {
+        return scratch;
+    }
+    // The integers grow to the largest key the thread uses and keep their limbs from then on;
+    scratch = safe_malloc(sizeof *scratch);
+    mpz_inits(scratch->value, scratch->signature, scratch->check, scratch->h, scratch->term, scratch->modulus,
+        scratch->blind, scratch->unblind, NULL);
+    for (size_t i = 0; i < RSA_MAX_PRIMES; i++) {
+        mpz_init(scratch->results[i]);
+    }
+    pthread_setspecific(rsa_scratch_key, scratch);
+    return scratch;
+}
+
+void rsa_public_key_init(rsa_public_key* key) {
+    mpz_inits(key->n, key->e, NULL);
+}
+
+void rsa_public_key_clear(rsa_public_key* key) {
+    mpz_clears(key->n, key->e, NULL);
+}
+
+void rsa_private_key_init(rsa_private_key* key) {
+    mpz_inits(key->n, key->e, key->d, key->p, key->q, key->dp, key->dq, key->q_inv, NULL);
+    key->nr_primes = 2;
+    for (size_t i = 0; i < RSA_MAX_PRIMES - 2; i++) {
+        mpz_inits(key->r[i], key->dr[i], key->t[i], NULL);
+    }
+    mont_init(&key->mont_n);
+    key->blinding = safe_malloc(sizeof *key->blinding);
+    pthread_mutex_init(&key->blinding->mutex, NULL);
+    mpz_inits(key->blinding->blind, key->blinding->unblind, NULL);
+    key->blinding->ready = 0;
+}
+
+void rsa_private_key_clear(rsa_private_key* key) {
+    // Overwrite the secret integers before their limbs are released;
+    rsa_wipe(key->d);
+    rsa_wipe(key->p);
+    rsa_wipe(key->q);
+    rsa_wipe(key->dp);
+    rsa_wipe(key->dq);
+    rsa_wipe(key->q_inv);
+    mpz_clears(key->n, key->e, key->d, key->p, key->q, key->dp, key->dq, key->q_inv, NULL);
+    for (size_t i = 0; i < RSA_MAX_PRIMES - 2; i++) {
+        rsa_wipe(key->r[i]);
+        rsa_wipe(key->dr[i]);
+        rsa_wipe(key->t[i]);
+        mpz_clears(key->r[i], key->dr[i], key->t[i], NULL);
+    }
+    mont_clear(&key->mont_n);
+    rsa_wipe(key->blinding->blind);
+    rsa_wipe(key->blinding->unblind);
+    mpz_clears(key->blinding->blind, key->blinding->unblind, NULL);
+    pthread_mutex_destroy(&key->blinding->mutex);
+    free(key->blinding);
+    key->blinding = NULL;
+}
+
+int rsa_private_key_precompute(rsa_private_key* key) {
+    size_t k = rsa_modulus_len(key->n);
+    uint8_t bytes[k];
+    rsa_blinding* blinding = key->blinding;
+    mpz_t r;
+    if (mont_set(&key->mont_n, key->n) != 0) {
+        return -1;
+    }
+    mpz_init(r);
+    pthread_mutex_lock(&blinding->mutex);
+    // Draw r in [1, n) until it is invertible, which fails only if r shares a factor with n;
+    do {
+        seed_bytes("rsa.blinding", bytes, k);
+        mpz_import(r, k, 1, 1, 1, 0, bytes);
+        mpz_mod(r, r, key->n);
+    } while ((mpz_sgn(r) == 0) || (mpz_invert(blinding->unblind, r, key->n) == 0));
+    mpz_powm(blinding->blind, r, key->e, key->n);
+    mont_to(&key->mont_n, blinding->blind, blinding->blind);
+    mont_to(&key->mont_n, blinding->unblind, blinding->unblind);
+    // Released, so a thread that sees the flag without the mutex also sees the pair and the Montgomery constants;
+    __atomic_store_n(&blinding->ready, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&blinding->mutex);
+    secure_zero(bytes, k);
+    rsa_wipe(r);
+    mpz_clear(r);
+    return 0;
+}
+
+int rsa_generate_decryption_key(const mpz_t p, const mpz_t q, const mpz_t enc_key, rsa_private_key* key) {
+    mpz_srcptr primes[2] = { p, q };
+    return rsa_generate_multiprime_key(primes, 2, enc_key, key);
+}
+
+int rsa_generate_multiprime_key(const mpz_srcptr* primes, size_t nr_primes, const mpz_t enc_key, rsa_private_key* key) {
+    int status = 0;
+    mpz_t prime_temp, lambda, gcd, product;
+    if ((nr_primes < 2) || (nr_primes > RSA_MAX_PRIMES)) {
+        return -1;
+    }
     // Initialize mpz_t variables to 0;
-    mpz_inits(temp, p_temp, q_temp, lambda, gcd, product, NULL);
+    mpz_inits(prime_temp, lambda, gcd, product, NULL);
     // Compute the Carmichael totient - lambda(n);
-    // Since n = pq => lambda(n) = lcm(lambda(p), lambda(q));
-    // If x is prime => lambda(x) = phi(x) = x - 1 => lambda(n) = lcm(p - 1, q - 1);
-    mpz_sub_ui(p_temp, p, 1);
-    mpz_sub_ui(q_temp, q, 1);
-    mpz_lcm(lambda, p_temp, q_temp);
+    // Since n = p * q * r_3 * ... => lambda(n) = lcm(lambda(p), lambda(q), lambda(r_3), ...);
+    // If x is prime => lambda(x) = phi(x) = x - 1 => lambda(n) = lcm(p - 1, q - 1, r_3 - 1, ...);
+    mpz_set_ui(lambda, 1);
+    for (size_t i = 0; i < nr_primes; i++) {
+        mpz_sub_ui(prime_temp, primes[i], 1);
+        mpz_lcm(lambda, lambda, prime_temp);
+        // The primes must be distinct;
+        for (size_t j = 0; j < i; j++) {
+            if (mpz_cmp(primes[i], primes[j]) == 0) {
+                status = -1;
+            }
+        }
+    }
     // The encryption key is co-prime to lambda and 3 < enc < lambda(n);
-    assert(mpz_cmp_ui(enc_key, 3) > 0);
-    assert(mpz_cmp(lambda, enc_key));
     mpz_gcd(gcd, enc_key, lambda);
-    assert(mpz_cmp_ui(gcd, 1) == 0);
-    // The decryption key is the modular inverse of the encryption key modulo lambda(n);
-    // That means (e * d) % lambda(n) = 1,  d - rop, e - op1, lambda(n) - op2;
-    mpz_invert(dec_key, enc_key, lambda);
-    // Check if (e * d) % lambda(n) = 1;
-    mpz_mul(product, dec_key, enc_key);
-    mpz_mod(temp, product, lambda);
-    assert(mpz_cmp_ui(temp, 1) == 0);
-    mpz_clears(temp, p_temp, q_temp, lambda, gcd, product, NULL);
-}
-
-static void rsa_encrypt(const mpz_t plain, const mpz_t enc_key, const mpz_t n, mpz_t cipher) {
+    if ((status != 0) || (mpz_cmp_ui(enc_key, 3) <= 0) || (mpz_cmp(enc_key, lambda) >= 0) || (mpz_cmp_ui(gcd, 1) != 0)) {
+        status = -1;
+    } else {
+        mpz_set(key->e, enc_key);
+        mpz_set(key->p, primes[0]);
+        mpz_set(key->q, primes[1]);
+        // The decryption key is the modular inverse of the encryption key modulo lambda(n);
+        // That means (e * d) % lambda(n) = 1,  d - rop, e - op1, lambda(n) - op2;
+        mpz_invert(key->d, enc_key, lambda);
+        // Precompute the CRT exponents and coefficient once, so every private operation can use them;
+        mpz_sub_ui(prime_temp, key->p, 1);
+        mpz_mod(key->dp, key->d, prime_temp);
+        mpz_sub_ui(prime_temp, key->q, 1);
+        mpz_mod(key->dq, key->d, prime_temp);
+        if (mpz_invert(key->q_inv, key->q, key->p) == 0) {
+            status = -1;
+        }
+        // Every additional prime gets d_i = d mod (r_i - 1) and t_i = (p * q * ... * r_(i-1))^-1 mod r_i;
+        mpz_mul(product, key->p, key->q);
+        for (size_t i = 2; i < nr_primes; i++) {
+            mpz_set(key->r[i - 2], primes[i]);
+            mpz_sub_ui(prime_temp, primes[i], 1);
+            mpz_mod(key->dr[i - 2], key->d, prime_temp);
+            if (mpz_invert(key->t[i - 2], product, primes[i]) == 0) {
+                status = -1;
+            }
+            mpz_mul(product, product, primes[i]);
+        }
+        // The modulus (n) is the product of all the primes;
+        mpz_set(key->n, product);
+        key->nr_primes = nr_primes;
+        if ((status == 0) && (rsa_private_key_precompute(key) != 0)) {
+            status = -1;
+        }
+    }
+    rsa_wipe(prime_temp);
+    rsa_wipe(lambda);
+    rsa_wipe(gcd);
+    rsa_wipe(product);
+    mpz_clears(prime_temp, lambda, gcd, product, NULL);
+    return status;
+}
+
+static void rsa_init_small_primes(void) {
+    // Sieve of Eratosthenes over the odd numbers up to the limit of the table;
+    static uint8_t composite[RSA_SIEVE_PRIMES * 10];
+    size_t count = 0;
+    for (size_t i = 3; (i < sizeof composite) && (count < RSA_SIEVE_PRIMES); i += 2) {
+        if (composite[i]) {
+            continue;
+        }
+        rsa_small_primes[count++] = (uint32_t)i;
+        for (size_t j = i * i; j < sizeof composite; j += 2 * i) {
+            composite[j] = 1;
+        }
+    }
+}
+
+static void rsa_random_candidate(drbg_state* drbg, size_t bits, mpz_t candidate) {
+    size_t bytes_len = (bits + 7) / 8;
+    uint8_t bytes[bytes_len];
+    drbg_generate(drbg, bytes, bytes_len);
+    mpz_import(candidate, bytes_len, 1, 1, 1, 0, bytes);
+    secure_zero(bytes, bytes_len);
+    // Keep exactly bits bits and set the two top bits, so the product of two primes has 2 * bits bits;
+    mpz_fdiv_r_2exp(candidate, candidate, bits);
+    mpz_setbit(candidate, bits - 1);
+    mpz_setbit(candidate, bits - 2);
+    mpz_setbit(candidate, 0);
+}
+
+static void rsa_find_prime(drbg_state* drbg, size_t bits, unsigned long enc_key, mpz_t prime) {
+    // sieve[j] = 1 marks base + 2j as divisible by one of the small primes;
+    uint8_t sieve[RSA_SIEVE_SPAN];
+    uint32_t residue = 0;
+    uint32_t small_prime = 0;
+    uint64_t offset = 0;
+    mpz_t base, candidate, gcd;
+    mpz_inits(base, candidate, gcd, NULL);
+    rsa_random_candidate(drbg, bits, base);
+    for (;;) {
+        // Walking past the top of the range (or over the two top bits) restarts from a fresh draw;
+        if ((mpz_sizeinbase(base, 2) != bits) || (mpz_tstbit(base, bits - 2) == 0)) {
+            rsa_random_candidate(drbg, bits, base);
+        }
+        memset(sieve, 0, RSA_SIEVE_SPAN);
+        for (size_t i = 0; i < RSA_SIEVE_PRIMES; i++) {
+            small_prime = rsa_small_primes[i];
+            residue = (uint32_t)mpz_fdiv_ui(base, small_prime);
+            // base + 2j = 0 (mod small_prime) <=> j = -residue * 2^-1 (mod small_prime);
+            offset = (uint64_t)((small_prime - residue) % small_prime) * ((small_prime + 1) / 2) % small_prime;
+            for (; offset < RSA_SIEVE_SPAN; offset += small_prime) {
+                sieve[offset] = 1;
+            }
+        }
+        for (size_t j = 0; j < RSA_SIEVE_SPAN; j++) {
+            if (sieve[j]) {
+                continue;
+            }
+            mpz_add_ui(candidate, base, 2 * j);
+            // The public exponent must be invertible modulo p - 1;
+            mpz_sub_ui(gcd, candidate, 1);
+            if (mpz_gcd_ui(NULL, gcd, enc_key) != 1) {
+                continue;
+            }
+            if (mpz_probab_prime_p(candidate, RSA_PRIME_REPS) != 0) {
+                mpz_set(prime, candidate);
+                rsa_wipe(base);
+                rsa_wipe(candidate);
+                rsa_wipe(gcd);
+                mpz_clears(base, candidate, gcd, NULL);
+                return;
+            }
+        }
+        // Move the window forward instead of drawing a fresh candidate;
+        mpz_add_ui(base, base, 2 * RSA_SIEVE_SPAN);
+    }
+}
+
+static void rsa_prime_worker(rsa_prime_job* job) {
+    drbg_state drbg;
+    drbg_init(&drbg, job->domain, job->chaos, RSA_CHAOS_LEN);
+    rsa_find_prime(&drbg, job->bits, job->enc_key, job->prime);
+    drbg_clear(&drbg);
+}
+
+static void rsa_prime_range(void* context, size_t start, size_t end) {
+    rsa_prime_search* search = context;
+    for (size_t i = start; i < end; i++) {
+        if (search->pending[i]) {
+            rsa_prime_worker(&search->jobs[i]);
+        }
+    }
+}
+
+static void rsa_search_primes(rsa_prime_job* jobs, const uint8_t* pending, size_t nr_primes) {
+    rsa_prime_search search = { .jobs = jobs, .pending = pending };
+    // Every prime is a range of its own, the searches take long enough to be worth a thread each;
+    parallel_for(nr_primes, 1, rsa_prime_range, &search);
+}
+
+int rsa_keygen(size_t bits, unsigned long enc_key, rsa_private_key* key) {
+    return rsa_keygen_multiprime(bits, 2, enc_key, key);
+}
+
+int rsa_keygen_multiprime(size_t bits, size_t nr_primes, unsigned long enc_key, rsa_private_key* key) {
+    // Every prime draws its candidates from a DRBG of its own domain;
+    static const char* domains[RSA_MAX_PRIMES] = { "rsa.keygen.p", "rsa.keygen.q", "rsa.keygen.r3", "rsa.keygen.r4" };
+    int status = 0;
+    uint8_t chaos[RSA_CHAOS_LEN];
+    uint8_t pending[RSA_MAX_PRIMES];
+    uint8_t searching = 0;
+    rsa_prime_job jobs[RSA_MAX_PRIMES];
+    mpz_srcptr primes[RSA_MAX_PRIMES];
+    mpz_t e, distance, product;
+    if ((bits < RSA_MIN_BITS) || (nr_primes < 2) || (nr_primes > RSA_MAX_PRIMES) || (bits / nr_primes < RSA_MIN_PRIME_BITS) ||
+        (enc_key <= 3) || (enc_key % 2 == 0)) {
+        return -1;
+    }
+    STATS_PROBE2(rsa_keygen, bits, nr_primes);
+    STATS_BEGIN(scope, STATS_EXACT_BYTES);
+    pthread_once(&rsa_small_primes_once, rsa_init_small_primes);
+    generate_entropy(chaos, RSA_CHAOS_LEN);
+    mpz_init_set_ui(e, enc_key);
+    mpz_inits(distance, product, NULL);
+    // The first bits % nr_primes primes take one extra bit, so the sizes add up to bits;
+    for (size_t i = 0; i < nr_primes; i++) {
+        jobs[i] = (rsa_prime_job){ .bits = bits / nr_primes + (i < bits % nr_primes), .enc_key = enc_key, .domain = domains[i], .chaos = chaos };
+        mpz_init(jobs[i].prime);
+        primes[i] = jobs[i].prime;
+        pending[i] = 1;
+    }
+    do {
+        rsa_search_primes(jobs, pending, nr_primes);
+        memset(pending, 0, RSA_MAX_PRIMES);
+        searching = 0;
+        // FIPS 186-5 requires |p - q| > 2^(bits / 2 - 100), which fails with negligible probability;
+        // Multi-prime keys apply it to every pair, with the size of the smaller prime;
+        for (size_t i = 0; i < nr_primes; i++) {
+            for (size_t j = i + 1; j < nr_primes; j++) {
+                mpz_sub(distance, jobs[i].prime, jobs[j].prime);
+                mpz_abs(distance, distance);
+                if (mpz_sizeinbase(distance, 2) <= jobs[j].bits - 100) {
+                    pending[j] = 1;
+                    searching = 1;
+                }
+            }
+        }
+        // Two top bits per prime only guarantee the size of a product of two primes => redraw them all otherwise,
+        // the other primes alone may be too small for any last prime to make up the size;
+        mpz_set_ui(product, 1);
+        for (size_t i = 0; i < nr_primes; i++) {
+            mpz_mul(product, product, jobs[i].prime);
+        }
+        if (mpz_sizeinbase(product, 2) != bits) {
+            memset(pending, 1, nr_primes);
+            searching = 1;
+        }
+    } while (searching);
+    status = rsa_generate_multiprime_key(primes, nr_primes, e, key);
+    secure_zero(chaos, RSA_CHAOS_LEN);
+    for (size_t i = 0; i < nr_primes; i++) {
+        rsa_wipe(jobs[i].prime);
+        mpz_clear(jobs[i].prime);
+    }
+    rsa_wipe(distance);
+    rsa_wipe(product);
+    mpz_clears(e, distance, product, NULL);
+    STATS_ADD(STATS_RSA, STATS_KEY_SCHEDULES, 1);
+    STATS_END(scope, STATS_RSA, 0, 0, 0);
+    return status;
+}
+
+void rsa_public_key_from_private(const rsa_private_key* private_key, rsa_public_key* public_key) {
+    mpz_set(public_key->n, private_key->n);
+    mpz_set(public_key->e, private_key->e);
+}
+
+static size_t rsa_field_len(const mpz_t value) {
+    // mpz_sizeinbase() reports 1 byte for 0, which is stored as an empty field;
+    return (mpz_sgn(value) == 0) ? 0 : (mpz_sizeinbase(value, 2) + 7) / 8;
+}
+
+static size_t rsa_key_export(uint8_t type, const mpz_srcptr* fields, size_t nr_fields, uint8_t* buffer, size_t buffer_len) {
+    size_t total = RSA_KEY_HEADER_LEN;
+    size_t field_len = 0;
+    size_t offset = RSA_KEY_HEADER_LEN;
+    for (size_t i = 0; i < nr_fields; i++) {
+        total += RSA_KEY_FIELD_PREFIX + rsa_field_len(fields[i]);
+    }
+    if ((buffer == NULL) || (buffer_len < total)) {
+        return total;
+    }
+    memcpy(buffer, RSA_KEY_MAGIC, 4);
+    buffer[4] = RSA_KEY_VERSION;
+    buffer[5] = type;
+    endian_store_be16(buffer + 6, (uint16_t)nr_fields);
+    for (size_t i = 0; i < nr_fields; i++) {
+        field_len = rsa_field_len(fields[i]);
+        // The length prefix is a big-endian 32-bit value (RSA_KEY_FIELD_PREFIX bytes);
+        endian_store_be32(buffer + offset, (uint32_t)field_len);
+        offset += RSA_KEY_FIELD_PREFIX;
+        // Export the magnitude as big-endian bytes;
+        mpz_export(buffer + offset, NULL, 1, 1, 1, 0, fields[i]);
+        offset += field_len;
+    }
+    return total;
+}
+
+static int rsa_key_import(uint8_t type, mpz_ptr* fields, size_t nr_fields, const uint8_t* buffer, size_t buffer_len) {
+    size_t offset = RSA_KEY_HEADER_LEN;
+    size_t field_len = 0;
+    if ((buffer_len < RSA_KEY_HEADER_LEN) || (memcmp(buffer, RSA_KEY_MAGIC, 4) != 0) || (buffer[4] != RSA_KEY_VERSION) ||
+        (buffer[5] != type) || (endian_load_be16(buffer + 6) != nr_fields)) {
+        return -1;
+    }
+    for (size_t i = 0; i < nr_fields; i++) {
+        if (buffer_len - offset < RSA_KEY_FIELD_PREFIX) {
+            return -1;
+        }
+        field_len = endian_load_be32(buffer + offset);
+        offset += RSA_KEY_FIELD_PREFIX;
+        if (buffer_len - offset < field_len) {
+            return -1;
+        }
+        mpz_import(fields[i], field_len, 1, 1, 1, 0, buffer + offset);
+        offset += field_len;
+    }
+    return (offset == buffer_len) ? 0 : -1;
+}
+
+size_t rsa_public_key_export(const rsa_public_key* key, uint8_t* buffer, size_t buffer_len) {
+    mpz_srcptr fields[RSA_PUBLIC_FIELDS] = { key->n, key->e };
+    return rsa_key_export(RSA_KEY_TYPE_PUBLIC, fields, RSA_PUBLIC_FIELDS, buffer, buffer_len);
+}
+
+int rsa_public_key_import(rsa_public_key* key, const uint8_t* buffer, size_t buffer_len) {
+    mpz_ptr fields[RSA_PUBLIC_FIELDS] = { key->n, key->e };
+    if (rsa_key_import(RSA_KEY_TYPE_PUBLIC, fields, RSA_PUBLIC_FIELDS, buffer, buffer_len) != 0) {
+        return -1;
+    }
+    // The modulus must be odd and the exponent at least 3;
+    if ((mpz_cmp_ui(key->n, 1) <= 0) || mpz_even_p(key->n) || (mpz_cmp_ui(key->e, 3) < 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+size_t rsa_private_key_export(const rsa_private_key* key, uint8_t* buffer, size_t buffer_len) {
+    mpz_srcptr fields[RSA_PRIVATE_FIELDS + RSA_PRIME_FIELDS * (RSA_MAX_PRIMES - 2)] = {
+        key->n, key->e, key->d, key->p, key->q, key->dp, key->dq, key->q_inv
+    };
+    size_t nr_fields = RSA_PRIVATE_FIELDS;
+    // The triplets (r_i, d_i, t_i) of a multi-prime key follow the two-prime fields;
+    for (size_t i = 0; i < key->nr_primes - 2; i++) {
+        fields[nr_fields++] = key->r[i];
+        fields[nr_fields++] = key->dr[i];
+        fields[nr_fields++] = key->t[i];
+    }
+    return rsa_key_export(RSA_KEY_TYPE_PRIVATE, fields, nr_fields, buffer, buffer_len);
+}
+
+static int rsa_exponent_matches(const mpz_t exponent, const mpz_t d, const mpz_t prime, mpz_t temp) {
+    // A CRT exponent must be d mod (prime - 1), which also keeps it shorter than the prime;
+    mpz_sub_ui(temp, prime, 1);
+    mpz_mod(temp, d, temp);
+    return mpz_cmp(temp, exponent) == 0;
+}
+
+static int rsa_coefficient_matches(const mpz_t coefficient, const mpz_t product, const mpz_t prime, mpz_t temp) {
+    // A CRT coefficient must lie in (0, prime) and invert the product of the earlier primes modulo prime;
+    if ((mpz_sgn(coefficient) <= 0) || (mpz_cmp(coefficient, prime) >= 0)) {
+        return 0;
+    }
+    mpz_mul(temp, coefficient, product);
+    mpz_mod(temp, temp, prime);
+    return mpz_cmp_ui(temp, 1) == 0;
+}
+
+static int rsa_private_key_check(const rsa_private_key* key) {
+    // Every field the CRT uses must follow from the primes and d, or the private operations go wrong silently;
+    int status = 0;
+    mpz_srcptr primes[RSA_MAX_PRIMES] = { key->p, key->q };
+    mpz_srcptr exponents[RSA_MAX_PRIMES] = { key->dp, key->dq };
+    mpz_t product, temp;
+    for (size_t i = 2; i < key->nr_primes; i++) {
+        primes[i] = key->r[i - 2];
+        exponents[i] = key->dr[i - 2];
+    }
+    if (mpz_cmp_ui(key->e, 3) < 0) {
+        return -1;
+    }
+    mpz_inits(product, temp, NULL);
+    mpz_set_ui(product, 1);
+    for (size_t i = 0; (status == 0) && (i < key->nr_primes); i++) {
+        // The primes must be odd and above 1 for mpn_sec_powm();
+        if ((mpz_cmp_ui(primes[i], 1) <= 0) || mpz_even_p(primes[i]) ||
+            !rsa_exponent_matches(exponents[i], key->d, primes[i], temp)) {
+            status = -1;
+        } else if ((i >= 2) && !rsa_coefficient_matches(key->t[i - 2], product, primes[i], temp)) {
+            status = -1;
+        }
+        mpz_mul(product, product, primes[i]);
+    }
+    // qInv = q^-1 mod p and the primes multiply to the modulus;
+    if ((status == 0) && (!rsa_coefficient_matches(key->q_inv, key->q, key->p, temp) || (mpz_cmp(product, key->n) != 0))) {
+        status = -1;
+    }
+    rsa_wipe(product);
+    rsa_wipe(temp);
+    mpz_clears(product, temp, NULL);
+    return status;
+}
+
+int rsa_private_key_import(rsa_private_key* key, const uint8_t* buffer, size_t buffer_len) {
+    size_t nr_fields = 0;
+    size_t nr_primes = 0;
+    mpz_ptr fields[RSA_PRIVATE_FIELDS + RSA_PRIME_FIELDS * (RSA_MAX_PRIMES - 2)] = {
+        key->n, key->e, key->d, key->p, key->q, key->dp, key->dq, key->q_inv
+    };
+    // The field count tells how many additional primes follow the two-prime fields;
+    if (buffer_len < RSA_KEY_HEADER_LEN) {
+        return -1;
+    }
+    nr_fields = endian_load_be16(buffer + 6);
+    if ((nr_fields < RSA_PRIVATE_FIELDS) || ((nr_fields - RSA_PRIVATE_FIELDS) % RSA_PRIME_FIELDS != 0)) {
+        return -1;
+    }
+    nr_primes = 2 + (nr_fields - RSA_PRIVATE_FIELDS) / RSA_PRIME_FIELDS;
+    if (nr_primes > RSA_MAX_PRIMES) {
+        return -1;
+    }
+    for (size_t i = 0; i < nr_primes - 2; i++) {
+        fields[RSA_PRIVATE_FIELDS + RSA_PRIME_FIELDS * i] = key->r[i];
+        fields[RSA_PRIVATE_FIELDS + RSA_PRIME_FIELDS * i + 1] = key->dr[i];
+        fields[RSA_PRIVATE_FIELDS + RSA_PRIME_FIELDS * i + 2] = key->t[i];
+    }
+    if (rsa_key_import(RSA_KEY_TYPE_PRIVATE, fields, nr_fields, buffer, buffer_len) != 0) {
+        return -1;
+    }
+    key->nr_primes = nr_primes;
+    if ((rsa_private_key_check(key) != 0) || (rsa_private_key_precompute(key) != 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+void rsa_encrypt(const mpz_t plain, const rsa_public_key* key, mpz_t cipher) {
+    STATS_PROBE1(rsa_public, key);
+    STATS_BEGIN(scope, STATS_EXACT_BYTES);
     // Let m represent the plaintext => the ciphertext is c = m^e mod(n);
-    mpz_powm(cipher, plain, enc_key, n);
+    mpz_powm(cipher, plain, key->e, key->n);
+    STATS_END(scope, STATS_RSA, rsa_modulus_len(key->n), rsa_modulus_len(key->n), 1);
+}
+
+static void rsa_sec_powm(mpz_t result, const mpz_t base, const mpz_t exponent, const mpz_t modulus) {
+    // The exponent is passed as as many bits as the modulus, so its length is not revealed;
+    mp_size_t size = mpz_size(modulus);
+    mp_size_t base_size = mpz_size(base);
+    // A well-formed exponent is below the modulus, a longer one must not run past the limbs below;
+    mp_size_t exponent_size = ((mp_size_t)mpz_size(exponent) < size) ? (mp_size_t)mpz_size(exponent) : size;
+    mp_size_t reduce_size = (base_size >= size) ? base_size : size;
+    mp_bitcnt_t exponent_bits = (mp_bitcnt_t)size * GMP_NUMB_BITS;
+    mp_size_t powm_itch = mpn_sec_powm_itch(size, exponent_bits, size);
+    mp_size_t div_itch = mpn_sec_div_r_itch(reduce_size, size);
+    mp_limb_t base_limbs[reduce_size];
+    mp_limb_t exponent_limbs[size];
+    mp_limb_t scratch[(powm_itch > div_itch) ? powm_itch : div_itch];
+    // Reduce the base in place with the constant-time division, the base is never negative here;
+    mpn_zero(base_limbs, reduce_size);
+    if (base_size > 0) {
+        mpn_copyi(base_limbs, mpz_limbs_read(base), base_size);
+    }
+    if (base_size >= size) {
+        mpn_sec_div_r(base_limbs, reduce_size, mpz_limbs_read(modulus), size, scratch);
+    }
+    mpn_zero(exponent_limbs, size);
+    mpn_copyi(exponent_limbs, mpz_limbs_read(exponent), exponent_size);
+    // mpn_sec_powm() needs a non-zero base, and 0^d = 0;
+    if (mpn_zero_p(base_limbs, size)) {
+        mpz_set_ui(result, 0);
+    } else {
+        mpn_sec_powm(mpz_limbs_write(result, size), base_limbs, size, exponent_limbs, exponent_bits, mpz_limbs_read(modulus), size,
+            scratch);
+        mpz_limbs_finish(result, size);
+    }
+    secure_zero(base_limbs, sizeof base_limbs);
+    secure_zero(exponent_limbs, sizeof exponent_limbs);
+    secure_zero(scratch, sizeof scratch);
+}
+
+static void rsa_crt_range(void* context, size_t start, size_t end) {
+    rsa_crt_job* jobs = context;
+    for (size_t i = start; i < end; i++) {
+        rsa_sec_powm(jobs[i].result, jobs[i].base, jobs[i].exponent, jobs[i].modulus);
+    }
+}
+
+static void rsa_crt(const mpz_t input, const rsa_private_key* key, mpz_t output) {
+    rsa_scratch* scratch = rsa_scratch_get();
+    rsa_blinding* blinding = key->blinding;
+    size_t nr_primes = key->nr_primes;
+    uint8_t blinded = 0;
+    rsa_crt_job jobs[RSA_MAX_PRIMES];
+    // The temporaries live in the thread's scratch, so a private operation allocates nothing once it is warm;
+    mpz_ptr h = scratch->h;
+    mpz_ptr term = scratch->term;
+    mpz_ptr modulus = scratch->modulus;
+    mpz_ptr blind = scratch->blind;
+    mpz_ptr unblind = scratch->unblind;
+    STATS_PROBE2(rsa_private, key, nr_primes);
+    STATS_BEGIN(scope, STATS_EXACT_BYTES);
+    mpz_mod(h, input, key->n);
+    if (__atomic_load_n(&blinding->ready, __ATOMIC_ACQUIRE) && mont_ready(&key->mont_n)) {
+        // Take the current pair and square it for the next operation: (r^e)^2 = (r^2)^e;
+        pthread_mutex_lock(&blinding->mutex);
+        mpz_set(blind, blinding->blind);
+        mpz_set(unblind, blinding->unblind);
+        mont_mulmod(&key->mont_n, blinding->blind, blinding->blind, blinding->blind);
+        mont_mulmod(&key->mont_n, blinding->unblind, blinding->unblind, blinding->unblind);
+        pthread_mutex_unlock(&blinding->mutex);
+        // c' = c * r^e mod n => c'^d = m * r;
+        mont_mulmod(&key->mont_n, h, h, blind);
+        blinded = 1;
+    }
+    // One constant-time exponentiation per prime: m1 = c^dP mod p, m2 = c^dQ mod q and m_i = c^d_i mod r_i;
+    jobs[0] = (rsa_crt_job){ .result = scratch->results[0], .base = h, .exponent = key->dp, .modulus = key->p };
+    jobs[1] = (rsa_crt_job){ .result = scratch->results[1], .base = h, .exponent = key->dq, .modulus = key->q };
+    for (size_t i = 2; i < nr_primes; i++) {
+        jobs[i] = (rsa_crt_job){ .result = scratch->results[i], .base = h, .exponent = key->dr[i - 2], .modulus = key->r[i - 2] };
+    }
+    // The exponentiations are independent => with threads to spare, each runs on its own;
+    parallel_for(nr_primes, 1, rsa_crt_range, jobs);
+    // Garner's recombination: h = qInv * (m1 - m2) mod p and m = m2 + h * q;
+    mpz_sub(h, jobs[0].result, jobs[1].result);
+    mpz_mul(h, h, key->q_inv);
+    mpz_mod(h, h, key->p);
+    mpz_mul(h, h, key->q);
+    mpz_add(h, jobs[1].result, h);
+    // Every additional prime: h_i = t_i * (m_i - m) mod r_i and m = m + R * h_i, where R = p * q * ... * r_(i-1);
+    mpz_mul(modulus, key->p, key->q);
+    for (size_t i = 2; i < nr_primes; i++) {
+        mpz_sub(term, jobs[i].result, h);
+        mpz_mul(term, term, key->t[i - 2]);
+        mpz_mod(term, term, key->r[i - 2]);
+        mpz_mul(term, term, modulus);
+        mpz_add(h, h, term);
+        mpz_mul(modulus, modulus, key->r[i - 2]);
+    }
+    // Remove the blinding factor: m = (m * r) * r^-1 mod n;
+    if (blinded) {
+        mont_mulmod(&key->mont_n, h, h, unblind);
+    }
+    mpz_set(output, h);
+    for (size_t i = 0; i < nr_primes; i++) {
+        rsa_wipe(jobs[i].result);
+    }
+    rsa_wipe(h);
+    rsa_wipe(term);
+    rsa_wipe(blind);
+    rsa_wipe(unblind);
+    // Decryption and signing both end up here, the fault check of rsa_sign() is not counted;
+    STATS_END(scope, STATS_RSA, rsa_modulus_len(key->n), rsa_modulus_len(key->n), 1);
+}
+
+void rsa_decrypt(const mpz_t cipher, const rsa_private_key* key, mpz_t plain) {
+    // Let c represent the ciphertext => the plaintext is m = c^d mod(n), computed via the CRT;
+    rsa_crt(cipher, key, plain);
+}
+
+int rsa_sign(const mpz_t message, const rsa_private_key* key, mpz_t signature, uint8_t verify) {
+    mpz_ptr check = NULL;
+    // Let m represent the message => the signature is s = m^d mod(n), computed via the CRT;
+    rsa_crt(message, key, signature);
+    if (!verify) {
+        return 0;
+    }
+    // A fault in one of the exponentiations modulo a prime would leak a factor of n => check s^e = m;
+    check = rsa_scratch_get()->check;
+    mpz_powm(check, signature, key->e, key->n);
+    if (mpz_cmp(check, message) != 0) {
+        mpz_set_ui(signature, 0);
+        return -1;
+    }
+    return 0;
+}
+
+int rsa_verify(const mpz_t message, const mpz_t signature, const rsa_public_key* key) {
+    mpz_ptr check = NULL;
+    if ((mpz_sgn(signature) < 0) || (mpz_cmp(signature, key->n) >= 0)) {
+        return -1;
+    }
+    STATS_PROBE1(rsa_public, key);
+    STATS_BEGIN(scope, STATS_EXACT_BYTES);
+    check = rsa_scratch_get()->check;
+    mpz_powm(check, signature, key->e, key->n);
+    STATS_END(scope, STATS_RSA, rsa_modulus_len(key->n), rsa_modulus_len(key->n), 1);
+    return (mpz_cmp(check, message) == 0) ? 0 : -1;
+}
+
+size_t rsa_modulus_len(const mpz_t n) {
+    return (mpz_sizeinbase(n, 2) + 7) / 8;
+}
+
+static void rsa_i2osp(const mpz_t value, uint8_t* bytes, size_t bytes_len) {
+    // I2OSP: the big-endian magnitude is left-padded with zeros to exactly bytes_len bytes;
+    size_t value_len = rsa_field_len(value);
+    memset(bytes, 0, bytes_len - value_len);
+    mpz_export(bytes + bytes_len - value_len, NULL, 1, 1, 1, 0, value);
+}
+
+int rsa_encrypt_bytes(const rsa_public_key* key, const uint8_t* plain, size_t plain_len, uint8_t* cipher) {
+    size_t k = rsa_modulus_len(key->n);
+    mpz_ptr value = rsa_scratch_get()->value;
+    if (plain_len != k) {
+        return -1;
+    }
+    // OS2IP straight into the thread's scratch, which keeps its limbs between calls;
+    mpz_import(value, k, 1, 1, 1, 0, plain);
+    if (mpz_cmp(value, key->n) >= 0) {
+        return -1;
+    }
+    rsa_encrypt(value, key, value);
+    rsa_i2osp(value, cipher, k);
+    return 0;
+}
+
+int rsa_decrypt_bytes(const rsa_private_key* key, const uint8_t* cipher, size_t cipher_len, uint8_t* plain) {
+    size_t k = rsa_modulus_len(key->n);
+    mpz_ptr value = rsa_scratch_get()->value;
+    if (cipher_len != k) {
+        return -1;
+    }
+    mpz_import(value, k, 1, 1, 1, 0, cipher);
+    if (mpz_cmp(value, key->n) >= 0) {
+        return -1;
+    }
+    rsa_decrypt(value, key, value);
+    rsa_i2osp(value, plain, k);
+    rsa_wipe(value);
+    return 0;
+}
+
+// Constant-time helpers returning all ones (true) or all zeros (false);
+static uint32_t rsa_ct_is_zero(uint32_t x) {
+    return (uint32_t)(((uint64_t)x - 1) >> 32);
+}
+
+static uint32_t rsa_ct_eq(uint32_t x, uint32_t y) {
+    return rsa_ct_is_zero(x ^ y);
+}
+
+static size_t rsa_ct_select(uint32_t mask, size_t x, size_t y) {
+    size_t wide_mask = (size_t)0 - (size_t)(mask & 1);
+    return (x & wide_mask) | (y & ~wide_mask);
+}
+
+static void rsa_mgf1_xor(const uint8_t* seed, size_t seed_len, uint8_t* data, size_t data_len) {
+    sha256_ctx seed_ctx, ctx;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    uint8_t counter[4];
+    size_t chunk_len = 0;
+    // Hash the seed once => every block only costs the counter and the final padding;
+    sha256_init(&seed_ctx);
+    sha256_update(&seed_ctx, seed, seed_len);
+    for (uint32_t block = 0; (size_t)block * SHA256_DIGEST_SIZE < data_len; block++) {
+        endian_store_be32(counter, block);
+        ctx = seed_ctx;
+        sha256_update(&ctx, counter, 4);
+        sha256_final(&ctx, digest);
+        chunk_len = (data_len - block * SHA256_DIGEST_SIZE < SHA256_DIGEST_SIZE) ? data_len - block * SHA256_DIGEST_SIZE : SHA256_DIGEST_SIZE;
+        for (size_t i = 0; i < chunk_len; i++) {
+            data[block * SHA256_DIGEST_SIZE + i] ^= digest[i];
+        }
+    }
+    secure_zero(digest, SHA256_DIGEST_SIZE);
+    secure_zero(&seed_ctx, sizeof seed_ctx);
+    secure_zero(&ctx, sizeof ctx);
+}
+
+static void rsa_digest(const uint8_t* label, size_t label_len, uint8_t* label_hash) {
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, label, label_len);
+    sha256_final(&ctx, label_hash);
+}
+
+int rsa_oaep_encode(const uint8_t* message, size_t message_len, const uint8_t* label, size_t label_len,
+    const uint8_t* seed, uint8_t* encoded, size_t k) {
+    // EM = 0x00 || maskedSeed || maskedDB, where DB = lHash || PS || 0x01 || M;
+    uint8_t* masked_seed = encoded + 1;
+    uint8_t* data_block = encoded + 1 + RSA_OAEP_HASH_LEN;
+    size_t data_block_len = k - RSA_OAEP_HASH_LEN - 1;
+    size_t ps_len = 0;
+    if ((k < RSA_OAEP_OVERHEAD) || (message_len > k - RSA_OAEP_OVERHEAD)) {
+        return -1;
+    }
+    ps_len = k - message_len - RSA_OAEP_OVERHEAD;
+    encoded[0] = 0x00;
+    rsa_digest(label, label_len, data_block);
+    memset(data_block + RSA_OAEP_HASH_LEN, 0x00, ps_len);
+    data_block[RSA_OAEP_HASH_LEN + ps_len] = 0x01;
+    memcpy(data_block + RSA_OAEP_HASH_LEN + ps_len + 1, message, message_len);
+    // maskedDB = DB ^ MGF1(seed) and maskedSeed = seed ^ MGF1(maskedDB);
+    memcpy(masked_seed, seed, RSA_OAEP_HASH_LEN);
+    rsa_mgf1_xor(seed, RSA_OAEP_HASH_LEN, data_block, data_block_len);
+    rsa_mgf1_xor(data_block, data_block_len, masked_seed, RSA_OAEP_HASH_LEN);
+    return 0;
+}
+
+int rsa_oaep_decode(const uint8_t* encoded, size_t k, const uint8_t* label, size_t label_len,
+    uint8_t* message, size_t* message_len) {
+    uint8_t label_hash[RSA_OAEP_HASH_LEN];
+    uint8_t seed[RSA_OAEP_HASH_LEN];
+    size_t data_block_len = (k > RSA_OAEP_HASH_LEN + 1) ? k - RSA_OAEP_HASH_LEN - 1 : 0;
+    uint8_t data_block[data_block_len + 1];
+    uint32_t good = 0, found = 0, invalid = 0, is_one = 0, is_zero = 0;
+    uint32_t difference = 0;
+    size_t separator = 0;
+    // The length of the modulus is public, so it may be checked with a branch;
+    if (k < RSA_OAEP_OVERHEAD) {
+        return -1;
+    }
+    memcpy(seed, encoded + 1, RSA_OAEP_HASH_LEN);
+    memcpy(data_block, encoded + 1 + RSA_OAEP_HASH_LEN, data_block_len);
+    // seed = maskedSeed ^ MGF1(maskedDB) and DB = maskedDB ^ MGF1(seed);
+    rsa_mgf1_xor(data_block, data_block_len, seed, RSA_OAEP_HASH_LEN);
+    rsa_mgf1_xor(seed, RSA_OAEP_HASH_LEN, data_block, data_block_len);
+    rsa_digest(label, label_len, label_hash);
+    // Y must be 0 and the first hLen bytes of DB must equal lHash;
+    good = rsa_ct_is_zero(encoded[0]);
+    for (size_t i = 0; i < RSA_OAEP_HASH_LEN; i++) {
+        difference |= data_block[i] ^ label_hash[i];
+    }
+    good &= rsa_ct_is_zero(difference);
+    // Find the first 0x01 after lHash without branching on the bytes, every earlier byte must be 0x00;
+    for (size_t i = RSA_OAEP_HASH_LEN; i < data_block_len; i++) {
+        is_one = rsa_ct_eq(data_block[i], 0x01);
+        is_zero = rsa_ct_is_zero(data_block[i]);
+        separator = rsa_ct_select(~found & is_one, i, separator);
+        invalid |= ~found & ~is_one & ~is_zero;
+        found |= is_one;
+    }
+    good &= found & ~invalid;
+    if (good) {
+        *message_len = data_block_len - separator - 1;
+        memcpy(message, data_block + separator + 1, *message_len);
+    }
+    secure_zero(data_block, data_block_len);
+    secure_zero(seed, RSA_OAEP_HASH_LEN);
+    return good ? 0 : -1;
+}
+
+int rsa_oaep_encrypt(const rsa_public_key* key, const uint8_t* message, size_t message_len,
+    const uint8_t* label, size_t label_len, uint8_t* cipher) {
+    size_t k = rsa_modulus_len(key->n);
+    uint8_t seed[RSA_OAEP_HASH_LEN];
+    uint8_t encoded[k];
+    int status = 0;
+    seed_bytes("rsa.oaep", seed, RSA_OAEP_HASH_LEN);
+    if (rsa_oaep_encode(message, message_len, label, label_len, seed, encoded, k) != 0) {
+        return -1;
+    }
+    // The leading zero byte keeps the encoded message below n;
+    status = rsa_encrypt_bytes(key, encoded, k, cipher);
+    secure_zero(encoded, k);
+    secure_zero(seed, RSA_OAEP_HASH_LEN);
+    return status;
+}
+
+int rsa_oaep_decrypt(const rsa_private_key* key, const uint8_t* cipher, size_t cipher_len,
+    const uint8_t* label, size_t label_len, uint8_t* message, size_t* message_len) {
+    size_t k = rsa_modulus_len(key->n);
+    uint8_t encoded[k];
+    int status = -1;
+    if ((cipher_len != k) || (k < RSA_OAEP_OVERHEAD)) {
+        return -1;
+    }
+    if (rsa_decrypt_bytes(key, cipher, cipher_len, encoded) == 0) {
+        status = rsa_oaep_decode(encoded, k, label, label_len, message, message_len);
+        secure_zero(encoded, k);
+    }
+    return status;
+}
+
+static void rsa_verify_ctx_init(rsa_verify_ctx* ctx, const rsa_public_key* key) {
+    ctx->key = key;
+    ctx->k = rsa_modulus_len(key->n);
+    // emBits = modBits - 1 keeps the encoded message below the modulus;
+    ctx->em_bits = mpz_sizeinbase(key->n, 2) - 1;
+    ctx->em_len = (ctx->em_bits + 7) / 8;
+}
+
+static void rsa_pss_hash(const uint8_t* message_hash, const uint8_t* salt, uint8_t* hash) {
+    // H = SHA2-256(0x00 * 8 || mHash || salt);
+    static const uint8_t zeros[8] = { 0 };
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, zeros, 8);
+    sha256_update(&ctx, message_hash, SHA256_DIGEST_SIZE);
+    sha256_update(&ctx, salt, RSA_PSS_SALT_LEN);
+    sha256_final(&ctx, hash);
+}
+
+static int rsa_pss_encode(const uint8_t* message, size_t message_len, const uint8_t* salt, uint8_t* encoded, size_t em_bits) {
+    size_t em_len = (em_bits + 7) / 8;
+    size_t data_block_len = em_len - SHA256_DIGEST_SIZE - 1;
+    size_t ps_len = 0;
+    uint8_t message_hash[SHA256_DIGEST_SIZE];
+    if (em_len < SHA256_DIGEST_SIZE + RSA_PSS_SALT_LEN + 2) {
+        return -1;
+    }
+    ps_len = em_len - SHA256_DIGEST_SIZE - RSA_PSS_SALT_LEN - 2;
+    rsa_digest(message, message_len, message_hash);
+    // EM = maskedDB || H || 0xbc, where DB = PS || 0x01 || salt;
+    rsa_pss_hash(message_hash, salt, encoded + data_block_len);
+    memset(encoded, 0x00, ps_len);
+    encoded[ps_len] = 0x01;
+    memcpy(encoded + ps_len + 1, salt, RSA_PSS_SALT_LEN);
+    rsa_mgf1_xor(encoded + data_block_len, SHA256_DIGEST_SIZE, encoded, data_block_len);
+    // Clear the leftmost 8 * emLen - emBits bits;
+    encoded[0] &= (uint8_t)(0xFF >> (8 * em_len - em_bits));
+    encoded[em_len - 1] = 0xbc;
+    return 0;
+}
+
+static int rsa_pss_decode(const uint8_t* message, size_t message_len, uint8_t* encoded, size_t em_bits) {
+    size_t em_len = (em_bits + 7) / 8;
+    size_t data_block_len = em_len - SHA256_DIGEST_SIZE - 1;
+    size_t ps_len = 0;
+    uint8_t top_mask = (uint8_t)(0xFF >> (8 * em_len - em_bits));
+    uint8_t message_hash[SHA256_DIGEST_SIZE];
+    uint8_t hash[SHA256_DIGEST_SIZE];
+    // Verification handles public data only, so it may return early;
+    if ((em_len < SHA256_DIGEST_SIZE + RSA_PSS_SALT_LEN + 2) || (encoded[em_len - 1] != 0xbc) || (encoded[0] & ~top_mask)) {
+        return -1;
+    }
+    ps_len = em_len - SHA256_DIGEST_SIZE - RSA_PSS_SALT_LEN - 2;
+    // Unmask DB in place;
+    rsa_mgf1_xor(encoded + data_block_len, SHA256_DIGEST_SIZE, encoded, data_block_len);
+    encoded[0] &= top_mask;
+    for (size_t i = 0; i < ps_len; i++) {
+        if (encoded[i] != 0x00) {
+            return -1;
+        }
+    }
+    if (encoded[ps_len] != 0x01) {
+        return -1;
+    }
+    rsa_digest(message, message_len, message_hash);
+    rsa_pss_hash(message_hash, encoded + ps_len + 1, hash);
+    return (memcmp(hash, encoded + data_block_len, SHA256_DIGEST_SIZE) == 0) ? 0 : -1;
+}
+
+int rsa_pss_sign(const rsa_private_key* key, const uint8_t* message, size_t message_len, uint8_t* signature) {
+    size_t k = rsa_modulus_len(key->n);
+    size_t em_bits = mpz_sizeinbase(key->n, 2) - 1;
+    size_t em_len = (em_bits + 7) / 8;
+    uint8_t salt[RSA_PSS_SALT_LEN];
+    uint8_t encoded[em_len];
+    int status = 0;
+    rsa_scratch* scratch = rsa_scratch_get();
+    seed_bytes("rsa.pss", salt, RSA_PSS_SALT_LEN);
+    if (rsa_pss_encode(message, message_len, salt, encoded, em_bits) != 0) {
+        return -1;
+    }
+    mpz_import(scratch->value, em_len, 1, 1, 1, 0, encoded);
+    // The fault check compares against the representative, so the signature needs its own integer;
+    status = rsa_sign(scratch->value, key, scratch->signature, 1);
+    if (status == 0) {
+        rsa_i2osp(scratch->signature, signature, k);
+    }
+    return status;
+}
+
+static int rsa_pss_verify_with(const rsa_verify_ctx* ctx, const uint8_t* message, size_t message_len,
+    const uint8_t* signature, size_t signature_len, mpz_t scratch, uint8_t* encoded) {
+    if (signature_len != ctx->k) {
+        return -1;
+    }
+    mpz_import(scratch, signature_len, 1, 1, 1, 0, signature);
+    if (mpz_cmp(scratch, ctx->key->n) >= 0) {
+        return -1;
+    }
+    STATS_PROBE1(rsa_public, ctx->key);
+    STATS_BEGIN(scope, STATS_EXACT_BYTES);
+    mpz_powm(scratch, scratch, ctx->key->e, ctx->key->n);
+    STATS_END(scope, STATS_RSA, ctx->k, ctx->k, 1);
+    // The representative must fit in emLen bytes;
+    if (rsa_field_len(scratch) > ctx->em_len) {
+        return -1;
+    }
+    rsa_i2osp(scratch, encoded, ctx->em_len);
+    return rsa_pss_decode(message, message_len, encoded, ctx->em_bits);
+}
+
+int rsa_pss_verify(const rsa_public_key* key, const uint8_t* message, size_t message_len,
+    const uint8_t* signature, size_t signature_len) {
+    rsa_verify_ctx ctx;
+    rsa_verify_ctx_init(&ctx, key);
+    uint8_t encoded[ctx.em_len];
+    return rsa_pss_verify_with(&ctx, message, message_len, signature, signature_len, rsa_scratch_get()->value, encoded);
+}
+
+static void rsa_batch_range(void* context, size_t start, size_t end) {
+    rsa_batch_job* job = context;
+    rsa_verify_ctx ctx = { 0 };
+    size_t max_em_len = 1;
+    size_t valid = 0;
+    mpz_t scratch;
+    // One buffer sized for the largest key and one integer serve every item of the range;
+    for (size_t i = start; i < end; i++) {
+        if (rsa_modulus_len(job->items[i].key->n) > max_em_len) {
+            max_em_len = rsa_modulus_len(job->items[i].key->n);
+        }
+    }
+    uint8_t encoded[max_em_len];
+    mpz_init2(scratch, 8 * max_em_len + GMP_NUMB_BITS);
+    for (size_t i = start; i < end; i++) {
+        // Consecutive items with the same key reuse its constants;
+        if (ctx.key != job->items[i].key) {
+            rsa_verify_ctx_init(&ctx, job->items[i].key);
+        }
+        job->results[i] = rsa_pss_verify_with(&ctx, job->items[i].message, job->items[i].message_len,
+            job->items[i].signature, job->items[i].signature_len, scratch, encoded);
+        valid += (job->results[i] == 0);
+    }
+    mpz_clear(scratch);
+    __atomic_fetch_add(&job->valid, valid, __ATOMIC_RELAXED);
 }
 
-static void rsa_decrypt(const mpz_t cipher, const mpz_t dec_key, const mpz_t n, mpz_t plain) {
-    // Let c represent the ciphertext => the plaintext is m = c^d mod(n);
-    mpz_powm(plain, cipher, dec_key, n);
+size_t rsa_verify_batch(const rsa_verify_item* items, size_t count, int* results) {
+    rsa_batch_job job = { .items = items, .results = results, .valid = 0 };
+    // Contiguous ranges keep items grouped by key on the same thread;
+    parallel_for(count, RSA_BATCH_MIN_PER_THREAD, rsa_batch_range, &job);
+    return job.valid;
 }
 
 void rsa(const uint8_t* data_string, const size_t data_len, const char* p_string, const char* q_string, const char* enc_key_string) {
-    mpz_t data, p, q, n, enc_key, dec_key, plain, cipher;
-    mpz_inits(n, dec_key, plain, cipher, NULL);
+    mpz_t data, p, q, enc_key, plain, cipher, signature;
+    rsa_private_key private_key;
+    rsa_public_key public_key;
+    rsa_private_key_init(&private_key);
+    rsa_public_key_init(&public_key);
+    mpz_inits(data, plain, cipher, signature, NULL);
     // The data passed to RSA will be a hex byte array => use base 16 to convert it to a integer;
-    // mpz_init_set_str(data, data_string, 16);
     mpz_import(data, data_len, 1, 1, 0, 0, data_string);
     mpz_init_set_str(p, p_string, 10);
     mpz_init_set_str(q, q_string, 10);
     mpz_init_set_str(enc_key, enc_key_string, 10);
-    // Generate the decryption key;
-    rsa_generate_decryption_key(p, q, enc_key, n, dec_key);
-    // Encrypt the data;
-    rsa_encrypt(data, enc_key, n, cipher);
-    // Decrypt the data;
-    rsa_decrypt(cipher, dec_key, n, plain);
-    printf("Public = (e: %s, n: %s)\n", mpz_get_str(NULL, 0, enc_key), mpz_get_str(NULL, 0, n));
-    printf("Private = (d: %s, n: %s)\n", mpz_get_str(NULL, 0, dec_key), mpz_get_str(NULL, 0, n));
-    printf("Original message: %s\n", mpz_get_str(NULL, 0, data));
-    printf("Encrypted message: %s\n", mpz_get_str(NULL, 0, cipher));
-    printf("Decrypted message: %s\n", mpz_get_str(NULL, 0, plain));
-    printf("\n");
-}
-
-// void rsa_oaep(const uint8_t* message, const size_t message_len, const uint8_t* parameter, const size_t param_len, uint8_t** em, const size_t em_len) {
-//     // Assume a modulo n with length nLen = 1024 bits = 128 bytes;
-//     // As such, the message representative em will have a max length of emMaxLen = 128 bytes;
-//     // Assume usage of SHA2-256 as the hash function => hLen = 256 bits = 32 bytes;
-//     // The minimum length of em, emMinLen = 2 * hLen + 1;
-//     // Therefore, the maximum length of the message m is mMaxLen = emMaxLen - 1 - 2 * hLen;
-//     // Inputs :
-//     //  - M     - the message to be padded;
-//     //          - if mLen > eMaxLen - 1 - 2 * hLen return error;
-//     //  - P     - the parameter string;
-//     //          - if P is too large for SHA2-256 ie. pLen > 2^64 - 1 bits long return error;
-//     //  - emLen - intented length of em in bytes;
-//     // Outputs :
-//     //  - EM    - the resulting message representative of length emLen;
-//     // Steps :
-//     //  - Generate a byte array PS of 0x00 and length psLen = emLen - mLen - 2 * hLen - 1 (can be 0);
-//     size_t ps_len = em_len - message_len - 2 * SHA256_DIGEST_SIZE - 1;
-//     //  - Let pHash = SHA2-256(P) a byte array of length hLen;
-//     uint8_t* p_hash = NULL;
-//     sha256(parameter, param_len, &p_hash);
-//     //  - Concatenate pHash, PS, M and other padding to form a data block DB = pHash || PS || 01 || M;
-//     //  - dbLen = hLen + psLen + 1 + mLen;
-//     size_t data_block_len = SHA256_DIGEST_SIZE + ps_len + 1 + message_len;
-//     uint8_t* data_block = safe_malloc(data_block_len * sizeof *data_block);
-//     // DB = pHash;
-//     memcpy(data_block, p_hash, SHA256_DIGEST_SIZE);
-//     // DB = pHash || PS;
-//     memset(data_block + SHA256_DIGEST_SIZE, 0, ps_len);
-//     // DB = pHash || PS || 01;
-//     memset(data_block + SHA256_DIGEST_SIZE + ps_len, 0x80, 1);
-//     // DB = pHash || PS || 01 || M;
-//     memcpy(data_block + SHA256_DIGEST_SIZE + ps_len + 1, message, message_len);
-//     //  - Generate a random byte array seed of length hLen;
-// }
-
-// void rsa_generate_mask(const uint8_t* seed, const size_t seed_len, uint8_t* mask, uint32_t mask_len) {
-//     uint32_t counter = 0;
-//     uint32_t current_mask_len = 0;
-//     uint8_t bytes[4];
-//     uint8_t* temp = safe_malloc((seed_len + 4) * sizeof *temp);
-//     uint8_t* digest = NULL;
-
-//     while (current_mask_len < mask_len) {
-//         // Convert the counter to a byte array of length 4;
-//         bytes[0] = (counter >> 24) & 0xFF;
-//         bytes[1] = (counter >> 16) & 0xFF;
-//         bytes[2] = (counter >> 8) & 0xFF;
-//         bytes[3] = counter & 0xFF;
-//         // Concatenate the seed and the counter byte array and hash the result;
-//         memcpy(temp, seed, seed_len);
-//         memcpy(temp + seed_len, bytes, 4);
-//         sha256(temp, seed_len + 4, &digest);
-//     }
-// }
\ No newline at end of file
+    // Generate the keys;
+    if (rsa_generate_decryption_key(p, q, enc_key, &private_key) != 0) {
+        fprintf(stderr, "Invalid RSA parameters.\n");
+    } else {
+        rsa_public_key_from_private(&private_key, &public_key);
+        // Encrypt the data;
+        rsa_encrypt(data, &public_key, cipher);
+        // Decrypt the data;
+        rsa_decrypt(cipher, &private_key, plain);
+        // Sign the data and check the signature;
+        rsa_sign(data, &private_key, signature, 1);
+        gmp_printf("Public = (e: %Zd, n: %Zd)\n", public_key.e, public_key.n);
+        gmp_printf("Private = (d: %Zd, n: %Zd)\n", private_key.d, private_key.n);
+        gmp_printf("CRT = (dP: %Zd, dQ: %Zd, qInv: %Zd)\n", private_key.dp, private_key.dq, private_key.q_inv);
+        gmp_printf("Original message: %Zd\n", data);
+        gmp_printf("Encrypted message: %Zd\n", cipher);
+        gmp_printf("Decrypted message: %Zd\n", plain);
+        gmp_printf("Signature: %Zd (%s)\n", signature, (rsa_verify(data, signature, &public_key) == 0) ? "valid" : "invalid");
+        printf("\n");
+    }
+    mpz_clears(data, p, q, enc_key, plain, cipher, signature, NULL);
+    rsa_public_key_clear(&public_key);
+    rsa_private_key_clear(&private_key);
+}
\ No newline at end of file
@@ -8,8 +8,374 @@
  * ---------------------------------------------------------------------------------------- **/
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <gmp.h>
 
+#include "mont.h"
+
+// The magic bytes and version of the binary key format;
+#define RSA_KEY_MAGIC "NHRK"
+#define RSA_KEY_VERSION 1
+#define RSA_KEY_TYPE_PUBLIC 1
+#define RSA_KEY_TYPE_PRIVATE 2
+// The smallest modulus rsa_keygen() will produce (in bits);
+#define RSA_MIN_BITS 512
+// Multi-prime keys (RFC 8017) have at most RSA_MAX_PRIMES primes of at least RSA_MIN_PRIME_BITS bits each;
+#define RSA_MAX_PRIMES 4
+#define RSA_MIN_PRIME_BITS 256
+// OAEP uses SHA2-256 for both the label hash and MGF1 => hLen = 32 bytes;
+#define RSA_OAEP_HASH_LEN 32
+// A modulus of k bytes carries OAEP messages of at most k - 2 * hLen - 2 bytes;
+#define RSA_OAEP_OVERHEAD (2 * RSA_OAEP_HASH_LEN + 2)
+// PSS uses SHA2-256 with a salt as long as the digest;
+#define RSA_PSS_SALT_LEN 32
+// rsa_verify_batch() never gives a thread less than this many signatures;
+#define RSA_BATCH_MIN_PER_THREAD 16
+
+typedef struct {
+    // The modulus and the public (encryption) exponent;
+    mpz_t n;
+    mpz_t e;
+} rsa_public_key;
+
+// The blinding state of a private key, shared by every thread using the key;
+typedef struct rsa_blinding rsa_blinding;
+
+typedef struct {
+    // The modulus and the public (encryption) exponent;
+    mpz_t n;
+    mpz_t e;
+    // The private (decryption) exponent;
+    mpz_t d;
+    // The CRT components: dP = d mod (p - 1), dQ = d mod (q - 1) and qInv = q^-1 mod p;
+    mpz_t p;
+    mpz_t q;
+    mpz_t dp;
+    mpz_t dq;
+    mpz_t q_inv;
+    // The number of primes, 2 unless the key is a multi-prime key;
+    size_t nr_primes;
+    // The additional primes r_i, their exponents d_i = d mod (r_i - 1) and the CRT coefficients
+    // t_i = (p * q * ... * r_(i-1))^-1 mod r_i, in the order of RFC 8017 (only nr_primes - 2 are used);
+    mpz_t r[RSA_MAX_PRIMES - 2];
+    mpz_t dr[RSA_MAX_PRIMES - 2];
+    mpz_t t[RSA_MAX_PRIMES - 2];
+    // The Montgomery constants of n, used for the constant-time blinding products;
+    mont_ctx mont_n;
+    rsa_blinding* blinding;
+} rsa_private_key;
+
+typedef struct {
+    // The key, message and signature of one item of a batch verification;
+    const rsa_public_key* key;
+    const uint8_t* message;
+    size_t message_len;
+    const uint8_t* signature;
+    size_t signature_len;
+} rsa_verify_item;
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Initialises the integers of a public key.
+ * @details The key owns its integers until rsa_public_key_clear() is called.
+ * @param   key         A pointer to the key to initialise.
+ * ---------------------------------------------------------------------------------------- **/
+void rsa_public_key_init(rsa_public_key* key);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Frees the integers of a public key.
+ * @param   key         A pointer to the key to clear.
+ * ---------------------------------------------------------------------------------------- **/
+void rsa_public_key_clear(rsa_public_key* key);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Initialises the integers of a private key.
+ * @details The key owns its integers until rsa_private_key_clear() is called.
+ * @param   key         A pointer to the key to initialise.
+ * ---------------------------------------------------------------------------------------- **/
+void rsa_private_key_init(rsa_private_key* key);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Frees the integers of a private key.
+ * @param   key         A pointer to the key to clear.
+ * ---------------------------------------------------------------------------------------- **/
+void rsa_private_key_clear(rsa_private_key* key);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Precomputes the Montgomery constants of n and a fresh blinding pair.
+ * @details Key generation and import call this already; it is only needed after the key
+ *          integers are set by hand. Private operations on a key without a blinding pair
+ *          are still constant-time, but unblinded.
+ * @param   key         A pointer to the key.
+ * @returns 0 on success, -1 if n is even.
+ * ---------------------------------------------------------------------------------------- **/
+int rsa_private_key_precompute(rsa_private_key* key);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Computes the private key (including the CRT components) from p, q and e.
+ * @details This is the only place where lambda(n) and the modular inverses are computed.
+ * @param   p           The first prime.
+ * @param   q           The second prime.
+ * @param   enc_key     The public exponent, 3 < e < lambda(n) and co-prime to lambda(n).
+ * @param   key         A pointer to an initialised key to hold the result.
+ * @returns 0 on success, -1 if the parameters do not form a valid key.
+ * ---------------------------------------------------------------------------------------- **/
+int rsa_generate_decryption_key(const mpz_t p, const mpz_t q, const mpz_t enc_key, rsa_private_key* key);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Computes a (multi-prime) private key from 2 to RSA_MAX_PRIMES distinct primes and e.
+ * @details primes[0] and primes[1] become p and q, the others the additional primes r_i.
+ * @param   primes      An array of nr_primes distinct primes.
+ * @param   nr_primes   The number of primes, 2 <= nr_primes <= RSA_MAX_PRIMES.
+ * @param   enc_key     The public exponent, 3 < e < lambda(n) and co-prime to lambda(n).
+ * @param   key         A pointer to an initialised key to hold the result.
+ * @returns 0 on success, -1 if the parameters do not form a valid key.
+ * ---------------------------------------------------------------------------------------- **/
+int rsa_generate_multiprime_key(const mpz_srcptr* primes, size_t nr_primes, const mpz_t enc_key, rsa_private_key* key);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Generates a fresh private key with a modulus of exactly the given size.
+ * @details p and q are searched concurrently, each on its own thread. Candidates are drawn
+ *          from a SHA2-256 DRBG seeded from the seed pool and the chaotic maps, and are
+ *          filtered with an incremental sieve of small primes before any probable-prime
+ *          test is run.
+ * @param   bits        The size of the modulus in bits, at least RSA_MIN_BITS.
+ * @param   enc_key     The public exponent, odd and greater than 3 (usually 65537).
+ * @param   key         A pointer to an initialised key to hold the result.
+ * @returns 0 on success, -1 if the parameters are invalid.
+ * ---------------------------------------------------------------------------------------- **/
+int rsa_keygen(size_t bits, unsigned long enc_key, rsa_private_key* key);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Generates a fresh multi-prime private key with a modulus of exactly the given size.
+ * @details Every prime is searched on its own thread, as in rsa_keygen(). Private operations
+ *          with the key run one exponentiation per prime, concurrently where CPUs allow.
+ * @param   bits        The size of the modulus in bits, at least RSA_MIN_BITS.
+ * @param   nr_primes   The number of primes, 2 <= nr_primes <= RSA_MAX_PRIMES, with at least
+ *                      RSA_MIN_PRIME_BITS bits per prime.
+ * @param   enc_key     The public exponent, odd and greater than 3 (usually 65537).
+ * @param   key         A pointer to an initialised key to hold the result.
+ * @returns 0 on success, -1 if the parameters are invalid.
+ * ---------------------------------------------------------------------------------------- **/
+int rsa_keygen_multiprime(size_t bits, size_t nr_primes, unsigned long enc_key, rsa_private_key* key);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Copies the public part of a private key.
+ * @param   private_key A pointer to the private key.
+ * @param   public_key  A pointer to an initialised public key to hold the result.
+ * ---------------------------------------------------------------------------------------- **/
+void rsa_public_key_from_private(const rsa_private_key* private_key, rsa_public_key* public_key);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Serialises a public key into the binary key format.
+ * @details The format is RSA_KEY_MAGIC || version || type || count (2 bytes) followed by
+ *          count fields, each a 4 byte big-endian length and a big-endian integer.
+ * @param   key         A pointer to the public key.
+ * @param   buffer      A buffer to hold the serialised key (can be NULL).
+ * @param   buffer_len  The length of the buffer in bytes.
+ * @returns The length of the serialised key. Nothing is written if it exceeds buffer_len.
+ * ---------------------------------------------------------------------------------------- **/
+size_t rsa_public_key_export(const rsa_public_key* key, uint8_t* buffer, size_t buffer_len);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Loads a public key from the binary key format.
+ * @param   key         A pointer to an initialised public key to hold the result.
+ * @param   buffer      A pointer to the serialised key.
+ * @param   buffer_len  The length of the serialised key in bytes.
+ * @returns 0 on success, -1 if the buffer does not hold a valid public key.
+ * ---------------------------------------------------------------------------------------- **/
+int rsa_public_key_import(rsa_public_key* key, const uint8_t* buffer, size_t buffer_len);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Serialises a private key (n, e, d, p, q, dP, dQ, qInv) into the binary format.
+ * @details Multi-prime keys append the triplet (r_i, d_i, t_i) of every additional prime.
+ * @param   key         A pointer to the private key.
+ * @param   buffer      A buffer to hold the serialised key (can be NULL).
+ * @param   buffer_len  The length of the buffer in bytes.
+ * @returns The length of the serialised key. Nothing is written if it exceeds buffer_len.
+ * ---------------------------------------------------------------------------------------- **/
+size_t rsa_private_key_export(const rsa_private_key* key, uint8_t* buffer, size_t buffer_len);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Loads a private key from the binary key format.
+ * @details The stored CRT components are checked against the primes and d, not recomputed:
+ *          every prime must be odd, dP, dQ and d_i must equal d mod (prime - 1), qInv and t_i
+ *          must invert q and the product of the earlier primes, and the primes must multiply
+ *          to n.
+ * @param   key         A pointer to an initialised private key to hold the result.
+ * @param   buffer      A pointer to the serialised key.
+ * @param   buffer_len  The length of the serialised key in bytes.
+ * @returns 0 on success, -1 if the buffer does not hold a valid private key.
+ * ---------------------------------------------------------------------------------------- **/
+int rsa_private_key_import(rsa_private_key* key, const uint8_t* buffer, size_t buffer_len);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Encrypts a message representative: c = m^e mod n.
+ * @param   plain       The message representative, 0 <= plain < n.
+ * @param   key         A pointer to the public key.
+ * @param   cipher      An initialised integer to hold the ciphertext.
+ * ---------------------------------------------------------------------------------------- **/
+void rsa_encrypt(const mpz_t plain, const rsa_public_key* key, mpz_t cipher);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Decrypts a ciphertext using the CRT: m = c^d mod n.
+ * @details The ciphertext is blinded with the cached pair (r^e, r^-1), the exponentiations
+ *          modulo every prime run in constant time with mpn_sec_powm(), concurrently if there
+ *          is more than one CPU, and are recombined using Garner's formula. Signing goes
+ *          through the same path.
+ * @param   cipher      The ciphertext, 0 <= cipher < n.
+ * @param   key         A pointer to the private key.
+ * @param   plain       An initialised integer to hold the message representative.
+ * ---------------------------------------------------------------------------------------- **/
+void rsa_decrypt(const mpz_t cipher, const rsa_private_key* key, mpz_t plain);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Signs a message representative using the CRT: s = m^d mod n.
+ * @details With verify set, the signature is checked against the public key before it is
+ *          released, which catches faults injected into any of the exponentiations modulo a prime.
+ * @param   message     The message representative, 0 <= message < n.
+ * @param   key         A pointer to the private key.
+ * @param   signature   An initialised integer to hold the signature (0 on failure).
+ * @param   verify      Check the signature before returning it (1) or not (0).
+ * @returns 0 if the signature was produced, -1 if the fault check failed.
+ * ---------------------------------------------------------------------------------------- **/
+int rsa_sign(const mpz_t message, const rsa_private_key* key, mpz_t signature, uint8_t verify);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Verifies a signature on a message representative: s^e mod n = m.
+ * @param   message     The message representative.
+ * @param   signature   The signature to check.
+ * @param   key         A pointer to the public key.
+ * @returns 0 if the signature is valid, -1 otherwise.
+ * ---------------------------------------------------------------------------------------- **/
+int rsa_verify(const mpz_t message, const mpz_t signature, const rsa_public_key* key);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Computes the length of a modulus in bytes (k in RFC 8017).
+ * @param   n           The modulus.
+ * @returns The number of bytes needed to hold n.
+ * ---------------------------------------------------------------------------------------- **/
+size_t rsa_modulus_len(const mpz_t n);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Encrypts a big-endian byte buffer of exactly modulus length.
+ * @details The bytes are imported into a per-thread scratch integer that keeps its limbs
+ *          between calls, so no strings or temporary integers are created.
+ * @param   key         A pointer to the public key.
+ * @param   plain       A pointer to the message representative as k big-endian bytes.
+ * @param   plain_len   The length of the representative, which must be k bytes.
+ * @param   cipher      An array of k bytes to hold the ciphertext (may be plain).
+ * @returns 0 on success, -1 if the length is wrong or the representative is not below n.
+ * ---------------------------------------------------------------------------------------- **/
+int rsa_encrypt_bytes(const rsa_public_key* key, const uint8_t* plain, size_t plain_len, uint8_t* cipher);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Decrypts a big-endian byte buffer of exactly modulus length.
+ * @details Goes through the same blinded, constant-time CRT path as rsa_decrypt(), with all
+ *          of its temporaries in per-thread scratch.
+ * @param   key         A pointer to the private key.
+ * @param   cipher      A pointer to the ciphertext as k big-endian bytes.
+ * @param   cipher_len  The length of the ciphertext, which must be k bytes.
+ * @param   plain       An array of k bytes to hold the message representative (may be cipher).
+ * @returns 0 on success, -1 if the length is wrong or the ciphertext is not below n.
+ * ---------------------------------------------------------------------------------------- **/
+int rsa_decrypt_bytes(const rsa_private_key* key, const uint8_t* cipher, size_t cipher_len, uint8_t* plain);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Encodes a message with EME-OAEP (RFC 8017, section 7.1.1) using SHA2-256.
+ * @param   message     A pointer to the message.
+ * @param   message_len The length of the message, at most k - RSA_OAEP_OVERHEAD bytes.
+ * @param   label       A pointer to the label (may be NULL if label_len is 0).
+ * @param   label_len   The length of the label in bytes.
+ * @param   seed        RSA_OAEP_HASH_LEN random bytes.
+ * @param   encoded     An array of k bytes to hold the encoded message.
+ * @param   k           The length of the modulus in bytes.
+ * @returns 0 on success, -1 if the message is too long for the modulus.
+ * ---------------------------------------------------------------------------------------- **/
+int rsa_oaep_encode(const uint8_t* message, size_t message_len, const uint8_t* label, size_t label_len,
+    const uint8_t* seed, uint8_t* encoded, size_t k);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Decodes an EME-OAEP encoded message in constant time.
+ * @details Every malformed input takes the same path and yields the same error, so the
+ *          position of the failure is not revealed.
+ * @param   encoded     A pointer to the k bytes of the encoded message.
+ * @param   k           The length of the modulus in bytes.
+ * @param   label       A pointer to the label (may be NULL if label_len is 0).
+ * @param   label_len   The length of the label in bytes.
+ * @param   message     An array of at least k - RSA_OAEP_OVERHEAD bytes to hold the message.
+ * @param   message_len A pointer to hold the length of the message.
+ * @returns 0 on success, -1 on a decoding error.
+ * ---------------------------------------------------------------------------------------- **/
+int rsa_oaep_decode(const uint8_t* encoded, size_t k, const uint8_t* label, size_t label_len,
+    uint8_t* message, size_t* message_len);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Encrypts a message with RSAES-OAEP using a fresh seed from the seed pool.
+ * @param   key         A pointer to the public key.
+ * @param   message     A pointer to the message.
+ * @param   message_len The length of the message, at most k - RSA_OAEP_OVERHEAD bytes.
+ * @param   label       A pointer to the label (may be NULL if label_len is 0).
+ * @param   label_len   The length of the label in bytes.
+ * @param   cipher      An array of k bytes to hold the ciphertext.
+ * @returns 0 on success, -1 if the message is too long for the modulus.
+ * ---------------------------------------------------------------------------------------- **/
+int rsa_oaep_encrypt(const rsa_public_key* key, const uint8_t* message, size_t message_len,
+    const uint8_t* label, size_t label_len, uint8_t* cipher);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Decrypts an RSAES-OAEP ciphertext.
+ * @param   key         A pointer to the private key.
+ * @param   cipher      A pointer to the ciphertext.
+ * @param   cipher_len  The length of the ciphertext, which must be k bytes.
+ * @param   label       A pointer to the label (may be NULL if label_len is 0).
+ * @param   label_len   The length of the label in bytes.
+ * @param   message     An array of at least k - RSA_OAEP_OVERHEAD bytes to hold the message.
+ * @param   message_len A pointer to hold the length of the message.
+ * @returns 0 on success, -1 if the ciphertext is invalid.
+ * ---------------------------------------------------------------------------------------- **/
+int rsa_oaep_decrypt(const rsa_private_key* key, const uint8_t* cipher, size_t cipher_len,
+    const uint8_t* label, size_t label_len, uint8_t* message, size_t* message_len);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Signs a message with RSASSA-PSS (RFC 8017, section 8.1) using SHA2-256.
+ * @details The salt is drawn from the seed pool and the signature is checked against the
+ *          public key before it is released.
+ * @param   key         A pointer to the private key.
+ * @param   message     A pointer to the message.
+ * @param   message_len The length of the message in bytes.
+ * @param   signature   An array of k bytes to hold the signature.
+ * @returns 0 on success, -1 if the modulus is too small or the fault check failed.
+ * ---------------------------------------------------------------------------------------- **/
+int rsa_pss_sign(const rsa_private_key* key, const uint8_t* message, size_t message_len, uint8_t* signature);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Verifies an RSASSA-PSS signature made with SHA2-256.
+ * @param   key             A pointer to the public key.
+ * @param   message         A pointer to the message.
+ * @param   message_len     The length of the message in bytes.
+ * @param   signature       A pointer to the signature.
+ * @param   signature_len   The length of the signature, which must be k bytes.
+ * @returns 0 if the signature is valid, -1 otherwise.
+ * ---------------------------------------------------------------------------------------- **/
+int rsa_pss_verify(const rsa_public_key* key, const uint8_t* message, size_t message_len,
+    const uint8_t* signature, size_t signature_len);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Verifies a batch of RSASSA-PSS signatures on the shared thread pool.
+ * @details Every range reuses its integers and buffers for all of its items and keeps the
+ *          per-key constants while consecutive items share a key, so batches grouped by
+ *          key are the cheapest.
+ * @param   items       A pointer to the items to verify.
+ * @param   count       The number of items.
+ * @param   results     An array of count integers to hold 0 (valid) or -1 (invalid) per item.
+ * @returns The number of valid signatures.
+ * ---------------------------------------------------------------------------------------- **/
+size_t rsa_verify_batch(const rsa_verify_item* items, size_t count, int* results);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Generates a key from decimal p, q and e, then encrypts, decrypts and signs data.
+ * @details Kept as a demonstration; applications should hold on to the key objects instead.
+ * ---------------------------------------------------------------------------------------- **/
 void rsa(const uint8_t* data_string, const size_t data_len, const char* p_string, const char* q_string, const char* enc_key_string);
 
 #endif
\ No newline at end of file
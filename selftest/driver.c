@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include <unistd.h>
+
+#include "selftest.h"
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [-a algorithm] [-b backend] [-c] [-d vector directory] [-l] [-q]\n", program);
+}
+
+int main(int argc, char* argv[]) {
+    const char* algorithm = NULL;
+    const char* backend = NULL;
+    // The vector paths are relative to the repository root;
+    const char* vector_dir = "..";
+    FILE* report = stdout;
+    int option = 0;
+    while ((option = getopt(argc, argv, "a:b:cd:lq")) != -1) {
+        switch (option) {
+        case 'a':
+            algorithm = optarg;
+            break;
+        case 'b':
+            backend = optarg;
+            break;
+        case 'c':
+            selftest_report_cpu(stdout);
+            return EXIT_SUCCESS;
+        case 'd':
+            vector_dir = optarg;
+            break;
+        case 'l':
+            selftest_list(stdout);
+            return EXIT_SUCCESS;
+        case 'q':
+            report = NULL;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    return (selftest_run(vector_dir, algorithm, backend, report) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
\ No newline at end of file
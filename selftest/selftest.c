@@ -0,0 +1,270 @@
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "selftest.h"
+#include "../aes/aes.h"
+#include "../sha256/sha256.h"
+#include "../utils/general.h"
+#include "../utils/cpu_features.h"
+#include "../utils/threadpool.h"
+
+// The number of bytes every thread starts out with for its outputs;
+#define SELFTEST_SCRATCH_SIZE 4096
+#define SELFTEST_MC_ITERATIONS 1000
+
+// The progress of one selected suite;
+typedef struct {
+    const selftest_suite* suite;
+    char path[SELFTEST_MAX_PATH];
+    int missing;
+    // Set when the CPU cannot run the backend, the suite then neither passes nor fails;
+    int unsupported;
+    size_t passed;
+    size_t failed;
+} selftest_state;
+
+// Every stride-th record of a file, starting with the slot-th one;
+typedef struct {
+    selftest_state* state;
+    size_t slot;
+    size_t stride;
+} selftest_unit;
+
+typedef struct {
+    selftest_unit* units;
+    size_t nr_units;
+    FILE* report;
+} selftest_pool;
+
+static void selftest_reserve(selftest_scratch* scratch, size_t len) {
+    if (len > scratch->data_cap) {
+        free(scratch->data);
+        scratch->data = safe_malloc(len);
+        scratch->data_cap = len;
+    }
+}
+
+// Checks both directions of a record, whichever section it comes from;
+static int selftest_aes_cbc(rsp_reader* reader, const char* backend, selftest_scratch* scratch) {
+    size_t key_len = 0, iv_len = 0, plain_len = 0, cipher_len = 0;
+    const uint8_t* key = rsp_hex(reader, "KEY", &key_len);
+    const uint8_t* iv = rsp_hex(reader, "IV", &iv_len);
+    const uint8_t* plain = rsp_hex(reader, "PLAINTEXT", &plain_len);
+    const uint8_t* cipher = rsp_hex(reader, "CIPHERTEXT", &cipher_len);
+    uint8_t chain_iv[AES_BLOCK_SIZE];
+    aes_ctx ctx;
+    int status = 1;
+    if ((key == NULL) || (iv == NULL) || (iv_len != AES_BLOCK_SIZE) || (plain == NULL) || (cipher == NULL) ||
+        (plain_len != cipher_len) || (plain_len % AES_BLOCK_SIZE != 0) || (aes_init_backend(&ctx, key, key_len, backend) != 0)) {
+        return -1;
+    }
+    selftest_reserve(scratch, plain_len);
+    memcpy(chain_iv, iv, AES_BLOCK_SIZE);
+    aes_cbc_encrypt_blocks(&ctx, chain_iv, plain, scratch->data, plain_len);
+    if (memcmp(scratch->data, cipher, plain_len) != 0) {
+        status = -1;
+    }
+    memcpy(chain_iv, iv, AES_BLOCK_SIZE);
+    aes_cbc_decrypt_blocks(&ctx, chain_iv, cipher, scratch->data, cipher_len);
+    if (memcmp(scratch->data, plain, plain_len) != 0) {
+        status = -1;
+    }
+    aes_clear(&ctx);
+    return status;
+}
+
+static int selftest_sha256(const char* backend, const uint8_t* data, size_t data_len, uint8_t* digest) {
+    sha256_ctx ctx;
+    if (sha256_init_backend(&ctx, backend) != 0) {
+        return -1;
+    }
+    sha256_update(&ctx, data, data_len);
+    sha256_final(&ctx, digest);
+    return 0;
+}
+
+static int selftest_sha256_msg(rsp_reader* reader, const char* backend, selftest_scratch* scratch) {
+    size_t bits = 0, message_len = 0, md_len = 0;
+    const uint8_t* message = rsp_hex(reader, "Msg", &message_len);
+    const uint8_t* md = rsp_hex(reader, "MD", &md_len);
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    if ((rsp_size(reader, "Len", &bits) != 0) || (message == NULL) || (md == NULL) || (md_len != SHA256_DIGEST_SIZE) ||
+        (bits % 8 != 0) || (bits / 8 > message_len)) {
+        return -1;
+    }
+    if (selftest_sha256(backend, message, bits / 8, digest) != 0) {
+        return -1;
+    }
+    return (memcmp(digest, md, SHA256_DIGEST_SIZE) == 0) ? 1 : -1;
+}
+
+// Every checkpoint hashes 1000 times over the last three digests, starting from the previous one;
+static int selftest_sha256_monte(rsp_reader* reader, const char* backend, selftest_scratch* scratch) {
+    size_t seed_len = 0, md_len = 0;
+    const uint8_t* seed = rsp_hex(reader, "Seed", &seed_len);
+    const uint8_t* md = NULL;
+    uint8_t message[3 * SHA256_DIGEST_SIZE];
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    if (seed != NULL) {
+        if (seed_len != SHA256_DIGEST_SIZE) {
+            return -1;
+        }
+        memcpy(scratch->chain, seed, SHA256_DIGEST_SIZE);
+        return 0;
+    }
+    md = rsp_hex(reader, "MD", &md_len);
+    if ((md == NULL) || (md_len != SHA256_DIGEST_SIZE)) {
+        return -1;
+    }
+    for (size_t i = 0; i < 3; i++) {
+        memcpy(message + i * SHA256_DIGEST_SIZE, scratch->chain, SHA256_DIGEST_SIZE);
+    }
+    for (size_t i = 0; i < SELFTEST_MC_ITERATIONS; i++) {
+        if (selftest_sha256(backend, message, sizeof message, digest) != 0) {
+            return -1;
+        }
+        memmove(message, message + SHA256_DIGEST_SIZE, 2 * SHA256_DIGEST_SIZE);
+        memcpy(message + 2 * SHA256_DIGEST_SIZE, digest, SHA256_DIGEST_SIZE);
+    }
+    memcpy(scratch->chain, digest, SHA256_DIGEST_SIZE);
+    return (memcmp(digest, md, SHA256_DIGEST_SIZE) == 0) ? 1 : -1;
+}
+
+static const selftest_suite selftest_suites[] = {
+    { "aes", "aesni", "cbc-128", "aes/test_vectors/AESCBC128LongMsg.rsp", selftest_aes_cbc, 0 },
+    { "aes", "aesni", "cbc-192", "aes/test_vectors/AESCBC192LongMsg.rsp", selftest_aes_cbc, 0 },
+    { "aes", "aesni", "cbc-256", "aes/test_vectors/AESCBC256LongMsg.rsp", selftest_aes_cbc, 0 },
+    { "aes", "generic", "cbc-128", "aes/test_vectors/AESCBC128LongMsg.rsp", selftest_aes_cbc, 0 },
+    { "aes", "generic", "cbc-192", "aes/test_vectors/AESCBC192LongMsg.rsp", selftest_aes_cbc, 0 },
+    { "aes", "generic", "cbc-256", "aes/test_vectors/AESCBC256LongMsg.rsp", selftest_aes_cbc, 0 },
+    { "sha256", "shani", "short", "sha256/test_vectors/SHA256ShortMsg.rsp", selftest_sha256_msg, 0 },
+    { "sha256", "shani", "long", "sha256/test_vectors/SHA256LongMsg.rsp", selftest_sha256_msg, 0 },
+    { "sha256", "shani", "monte", "sha256/test_vectors/SHA256Monte.rsp", selftest_sha256_monte, 1 },
+    { "sha256", "generic", "short", "sha256/test_vectors/SHA256ShortMsg.rsp", selftest_sha256_msg, 0 },
+    { "sha256", "generic", "long", "sha256/test_vectors/SHA256LongMsg.rsp", selftest_sha256_msg, 0 },
+    { "sha256", "generic", "monte", "sha256/test_vectors/SHA256Monte.rsp", selftest_sha256_monte, 1 },
+};
+
+#define SELFTEST_NR_SUITES (sizeof selftest_suites / sizeof selftest_suites[0])
+
+void selftest_list(FILE* stream) {
+    for (size_t i = 0; i < SELFTEST_NR_SUITES; i++) {
+        fprintf(stream, "%-8s %-8s %-8s %s\n", selftest_suites[i].algorithm, selftest_suites[i].backend,
+            selftest_suites[i].name, selftest_suites[i].path);
+    }
+}
+
+void selftest_report_cpu(FILE* stream) {
+    cpu_report(stream);
+}
+
+static void selftest_run_unit(const selftest_unit* unit, selftest_scratch* scratch, FILE* report) {
+    const selftest_suite* suite = unit->state->suite;
+    rsp_reader reader;
+    size_t index = 0, passed = 0, failed = 0;
+    int status = 0;
+    rsp_open(&reader, unit->state->path);
+    memset(scratch->chain, 0, sizeof scratch->chain);
+    while (rsp_next(&reader)) {
+        if (index++ % unit->stride != unit->slot) {
+            continue;
+        }
+        status = suite->check(&reader, suite->backend, scratch);
+        if (status > 0) {
+            passed++;
+        } else if (status < 0) {
+            failed++;
+            if (report != NULL) {
+                fprintf(report, "FAIL %s %s %s: %s line %zu\n", suite->algorithm, suite->backend, suite->name,
+                    unit->state->path, reader.record_line);
+            }
+        }
+    }
+    rsp_close(&reader);
+    __atomic_fetch_add(&unit->state->passed, passed, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&unit->state->failed, failed, __ATOMIC_RELAXED);
+}
+
+static void selftest_range(void* context, size_t start, size_t end) {
+    selftest_pool* pool = context;
+    selftest_scratch scratch = { .data = safe_malloc(SELFTEST_SCRATCH_SIZE), .data_cap = SELFTEST_SCRATCH_SIZE };
+    for (size_t i = start; i < end; i++) {
+        selftest_run_unit(&pool->units[i], &scratch, pool->report);
+    }
+    free(scratch.data);
+}
+
+static size_t selftest_nr_threads(void) {
+    size_t nr_threads = threadpool_size();
+    return (nr_threads > SELFTEST_MAX_THREADS) ? SELFTEST_MAX_THREADS : nr_threads;
+}
+
+size_t selftest_run(const char* vector_dir, const char* algorithm, const char* backend, FILE* report) {
+    selftest_state states[SELFTEST_NR_SUITES];
+    selftest_unit units[SELFTEST_NR_SUITES * SELFTEST_MAX_THREADS];
+    selftest_pool pool = { .units = units, .nr_units = 0, .report = report };
+    size_t nr_states = 0, nr_threads = selftest_nr_threads();
+    size_t passed = 0, failed = 0, stride = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < SELFTEST_NR_SUITES; i++) {
+        if (((algorithm != NULL) && (strcmp(algorithm, selftest_suites[i].algorithm) != 0)) ||
+            ((backend != NULL) && (strcmp(backend, selftest_suites[i].backend) != 0))) {
+            continue;
+        }
+        selftest_state* state = &states[nr_states++];
+        *state = (selftest_state){ .suite = &selftest_suites[i] };
+        snprintf(state->path, SELFTEST_MAX_PATH, "%s/%s", vector_dir, selftest_suites[i].path);
+        if (!cpu_backend_supported(selftest_suites[i].algorithm, selftest_suites[i].backend)) {
+            state->unsupported = 1;
+            continue;
+        }
+        if (access(state->path, R_OK) != 0) {
+            state->missing = 1;
+            continue;
+        }
+        // Chained suites stay on one thread, the others give every thread a share of the records;
+        stride = selftest_suites[i].chained ? 1 : nr_threads;
+        for (size_t j = 0; j < stride; j++) {
+            units[pool.nr_units++] = (selftest_unit){ .state = state, .slot = j, .stride = stride };
+        }
+    }
+    if (nr_states == 0) {
+        if (report != NULL) {
+            fprintf(report, "No suite matches algorithm %s and backend %s\n", (algorithm != NULL) ? algorithm : "*",
+                (backend != NULL) ? backend : "*");
+        }
+        return 1;
+    }
+    if (nr_threads > pool.nr_units) {
+        nr_threads = (pool.nr_units > 0) ? pool.nr_units : 1;
+    }
+    // Every unit is a range of its own, the pool hands them out as threads become free;
+    parallel_for(pool.nr_units, 1, selftest_range, &pool);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    for (size_t i = 0; i < nr_states; i++) {
+        if (states[i].unsupported) {
+            if (report != NULL) {
+                fprintf(report, "%-8s %-8s %-8s skipped (not supported by this CPU)\n", states[i].suite->algorithm,
+                    states[i].suite->backend, states[i].suite->name);
+            }
+            continue;
+        }
+        // A file without a single vector proves nothing;
+        if ((states[i].missing) || (states[i].passed + states[i].failed == 0)) {
+            states[i].failed++;
+        }
+        passed += states[i].passed;
+        failed += states[i].failed;
+        if (report != NULL) {
+            fprintf(report, "%-8s %-8s %-8s %6zu passed %6zu failed%s\n", states[i].suite->algorithm, states[i].suite->backend,
+                states[i].suite->name, states[i].passed, states[i].failed, states[i].missing ? " (missing vector file)" : "");
+        }
+    }
+    if (report != NULL) {
+        fprintf(report, "%zu passed, %zu failed in %.3f s on %zu threads\n", passed, failed,
+            (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) * 1e-9, nr_threads);
+    }
+    return failed;
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#ifndef SELFTEST_H
+#define SELFTEST_H
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   This file implements a self-test runner over the NIST test vectors.
+ * @details Every suite pairs a vector file with an algorithm and a backend, suites of backends
+ *          the CPU cannot run are skipped (see cpu_features.h). The records of a
+ *          file are spread over all CPUs and checked in-process against the expected values,
+ *          so only a summary and the mismatches are reported. Chained suites (Monte Carlo)
+ *          run on a single thread, next to the others. The runner can be called at start-up
+ *          as a power-on self-test.
+ * @author  Murea Cosmin Alexandru
+ * @date    01.03.2024
+ * ---------------------------------------------------------------------------------------- **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "../utils/rsp.h"
+
+#define SELFTEST_MAX_THREADS 64
+#define SELFTEST_MAX_PATH 4096
+
+// Holds the buffers a thread reuses from one record to the next;
+typedef struct {
+    uint8_t* data;
+    size_t data_cap;
+    // The value carried between the records of a chained suite;
+    uint8_t chain[64];
+} selftest_scratch;
+
+/*
+ * Checks one record with the named backend: returns 1 if it passed, -1 if it failed and 0 if
+ * the record holds no vector (a seed or a parameter record);
+ */
+typedef int (*selftest_check)(rsp_reader* reader, const char* backend, selftest_scratch* scratch);
+
+typedef struct {
+    const char* algorithm;
+    const char* backend;
+    const char* name;
+    // The path of the vector file, relative to the vector directory;
+    const char* path;
+    selftest_check check;
+    // Set when every record depends on the previous one, so the file is checked in order;
+    int chained;
+} selftest_suite;
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Writes the algorithm, backend and name of every suite, one per line.
+ * @param   stream      The stream to write to.
+ * ---------------------------------------------------------------------------------------- **/
+void selftest_list(FILE* stream);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Writes the detected CPU features and the backend every module uses by default.
+ * @param   stream      The stream to write to.
+ * ---------------------------------------------------------------------------------------- **/
+void selftest_report_cpu(FILE* stream);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Runs every suite that matches the filters.
+ * @details A missing vector file counts as a failure, and so does a filter that matches no
+ *          suite.
+ * @param   vector_dir  The directory the vector paths are relative to (the repository root).
+ * @param   algorithm   The algorithm to run (NULL for all).
+ * @param   backend     The backend to run (NULL for all).
+ * @param   report      The stream for the summary and the mismatches (NULL to stay quiet).
+ * @returns The number of failed vectors (0 if everything passed).
+ * ---------------------------------------------------------------------------------------- **/
+size_t selftest_run(const char* vector_dir, const char* algorithm, const char* backend, FILE* report);
+
+#endif
\ No newline at end of file
@@ -1,15 +1,23 @@
 #include <string.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SHA256_HAVE_X86 1
+#endif
+
 #include "sha256.h"
 #include "../utils/general.h"
+#include "../utils/rsp.h"
+#include "../utils/cpu_features.h"
+#include "../utils/stats.h"
+#include "../utils/endian.h"
+#include "../utils/threadpool.h"
 
-#define SHA256_MAX_TEST_MSG_LENGTH 13000
 #define SHA256_MC_ITERATIONS 100001
-#define SHA256_MC_MAX_TEST_MSG_LENGTH 100
 #define SHA256_MC_POOL_INTERVAL 1000
 
 // The first 32 bits of the fractional parts of the cube roots of the first 64 primes;
-const uint32_t round_constants[64] = {
+static const uint32_t round_constants[64] = {
     0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
 	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
 	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
@@ -50,32 +58,6 @@ static uint32_t delta1(uint32_t x) {
     return (right_rotate(x, 17) ^ right_rotate(x, 19) ^ (x >> 10));
 }
 
-static void sha256_padding(const uint8_t* data, size_t data_len, uint8_t** padded, size_t* padded_len) {
-    size_t total_zeros = 0;
-    uint64_t bit_length = 0;
-
-    // When the message is 9 bytes short of a block multiple there is no additional block added;
-    if ((data_len + 9) % SHA256_BLOCK_SIZE == 0) {
-        *padded_len = data_len + 9;
-    } else {
-        *padded_len = ((data_len + 9 + SHA256_BLOCK_SIZE) / SHA256_BLOCK_SIZE) * SHA256_BLOCK_SIZE;
-    }
-    *padded = safe_malloc((*padded_len * sizeof **padded));
-    memcpy(*padded, data, data_len);
-
-    // Add the 1 bit as big-endian using the byte 0x80 = 0b10000000;
-    (*padded)[data_len] = 0x80;
-    // Compute and add the needed amount of 0 bits to reach congruence modulo 448;
-    total_zeros = *padded_len - data_len - 9;
-    memset((*padded + data_len + 1), 0x00, total_zeros);
-
-    // Add the length of the message in bits as a big-endian 64-bit value;
-    bit_length = (uint64_t)data_len * 8;
-    for (size_t i = 0; i < 8; i++) {
-        (*padded)[*padded_len - 8 + i] = (uint8_t)(bit_length >> (56 - i * 8));
-    }
-}
-
 static void sha256_compression(const uint8_t* block, uint32_t* hash) {
     uint32_t a = hash[0];
     uint32_t b = hash[1];
@@ -88,10 +70,9 @@ static void sha256_compression(const uint8_t* block, uint32_t* hash) {
     uint32_t temp1, temp2;
     uint32_t msg_schedule[SHA256_BLOCK_SIZE];
 
-    // The 64 bytes in the block are used as the first 16 words of the message schedule;
-    for (size_t i = 0, j = 0; i < 16; i++, j += 4) {
-        // Interpret 4 bytes as a 32 bit value;
-        msg_schedule[i] = (block[j] << 24) | (block[j + 1] << 16) | (block[j + 2] << 8) | (block[j + 3]);
+    // The 64 bytes in the block are used as the first 16 words of the message schedule (big-endian);
+    for (size_t i = 0; i < 16; i++) {
+        msg_schedule[i] = endian_load_be32(block + 4 * i);
     }
 
     // Use the S-Box functions to generate another 48 message schedule words;
@@ -124,102 +105,256 @@ static void sha256_compression(const uint8_t* block, uint32_t* hash) {
     hash[7] += h;
 }
 
-void sha256(const uint8_t* data, size_t data_len, uint8_t** digest) {
-    uint8_t* padded = NULL;
-    size_t padded_len = 0;
+static void sha256_compress_generic(uint32_t* hash, const uint8_t* blocks, size_t nr_blocks) {
+    for (size_t i = 0; i < nr_blocks; i++) {
+        sha256_compression(blocks + i * SHA256_BLOCK_SIZE, hash);
+    }
+}
 
+#ifdef SHA256_HAVE_X86
+
+/*
+ * The SHA extensions keep the state as ABEF and CDGH and run two rounds per sha256rnds2,
+ * taking the message words plus round constants four at a time. sha256msg1/sha256msg2
+ * extend the message schedule four words at a time, in place in a ring of four vectors;
+ */
+__attribute__((target("sha,sse4.1")))
+static void sha256_compress_shani(uint32_t* hash, const uint8_t* blocks, size_t nr_blocks) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+    __m128i state0, state1, abef, cdgh, words, schedule[4];
+    __m128i dcba = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)hash), 0xB1);
+    __m128i hgfe = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(hash + 4)), 0x1B);
+    state0 = _mm_alignr_epi8(dcba, hgfe, 8);
+    state1 = _mm_blend_epi16(hgfe, dcba, 0xF0);
+    for (; nr_blocks > 0; nr_blocks--, blocks += SHA256_BLOCK_SIZE) {
+        abef = state0;
+        cdgh = state1;
+        for (size_t i = 0; i < 4; i++) {
+            schedule[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(blocks + 16 * i)), byte_swap);
+        }
+        for (size_t i = 0; i < 16; i++) {
+            words = _mm_add_epi32(schedule[i % 4], _mm_loadu_si128((const __m128i*)(round_constants + 4 * i)));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, words);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(words, 0x0E));
+            // Words 4i + 16 to 4i + 19 replace words 4i to 4i + 3, which are no longer needed;
+            if (i < 12) {
+                words = _mm_sha256msg1_epu32(schedule[i % 4], schedule[(i + 1) % 4]);
+                words = _mm_add_epi32(words, _mm_alignr_epi8(schedule[(i + 3) % 4], schedule[(i + 2) % 4], 4));
+                schedule[i % 4] = _mm_sha256msg2_epu32(words, schedule[(i + 3) % 4]);
+            }
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+    // Back from ABEF / CDGH to the order of the hash words;
+    abef = _mm_shuffle_epi32(state0, 0x1B);
+    cdgh = _mm_shuffle_epi32(state1, 0xB1);
+    _mm_storeu_si128((__m128i*)hash, _mm_blend_epi16(abef, cdgh, 0xF0));
+    _mm_storeu_si128((__m128i*)(hash + 4), _mm_alignr_epi8(cdgh, abef, 8));
+}
+
+#endif
+
+typedef struct {
+    sha256_compress_fn compress;
+} sha256_ops;
+
+static const sha256_ops sha256_generic_ops = { sha256_compress_generic };
+#ifdef SHA256_HAVE_X86
+static const sha256_ops sha256_shani_ops = { sha256_compress_shani };
+#endif
+
+static const cpu_backend sha256_backends[] = {
+#ifdef SHA256_HAVE_X86
+    { "shani", CPU_FEATURE_SHA | CPU_FEATURE_SSE41, &sha256_shani_ops },
+#endif
+    { "generic", 0, &sha256_generic_ops }
+};
+
+static cpu_dispatch sha256_dispatch = { "sha256", sha256_backends, sizeof sha256_backends / sizeof sha256_backends[0], NULL };
+
+__attribute__((constructor))
+static void sha256_register(void) {
+    cpu_dispatch_register(&sha256_dispatch);
+}
+
+void sha256_init(sha256_ctx* ctx) {
     // The first 32 bits of the fractional parts of the square roots of the first 8 primes;
-    uint32_t hash[8] = {
+    static const uint32_t initial_hash[8] = {
         0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
     };
+    memcpy(ctx->hash, initial_hash, sizeof initial_hash);
+    ctx->block_len = 0;
+    ctx->total_len = 0;
+    ctx->compress = ((const sha256_ops*)cpu_dispatch_active(&sha256_dispatch)->ops)->compress;
+}
 
-    // Store the final value on the heap;
-    *digest = safe_malloc(SHA256_DIGEST_SIZE * sizeof **digest);
-    // Pad the message to a multiple of 512 bits;
-    sha256_padding(data, data_len, &padded, &padded_len);
+int sha256_init_backend(sha256_ctx* ctx, const char* backend) {
+    const cpu_backend* found = cpu_dispatch_find(&sha256_dispatch, backend);
+    if (found == NULL) {
+        return -1;
+    }
+    sha256_init(ctx);
+    ctx->compress = ((const sha256_ops*)found->ops)->compress;
+    return 0;
+}
 
-    // Apply the compression function on every block;
-    for (size_t i = 0; i < padded_len / SHA256_BLOCK_SIZE; i++) {
-        sha256_compression((padded + i * SHA256_BLOCK_SIZE), hash);
+static void sha256_absorb(sha256_ctx* ctx, const uint8_t* data, size_t data_len) {
+    size_t chunk_len = 0;
+    ctx->total_len += data_len;
+    // Complete the buffered block first;
+    if (ctx->block_len > 0) {
+        chunk_len = (data_len < SHA256_BLOCK_SIZE - ctx->block_len) ? data_len : SHA256_BLOCK_SIZE - ctx->block_len;
+        memcpy(ctx->block + ctx->block_len, data, chunk_len);
+        ctx->block_len += chunk_len;
+        data += chunk_len;
+        data_len -= chunk_len;
+        if (ctx->block_len < SHA256_BLOCK_SIZE) {
+            return;
+        }
+        ctx->compress(ctx->hash, ctx->block, 1);
+        ctx->block_len = 0;
     }
+    // Compress whole blocks straight from the input, all in one call;
+    chunk_len = data_len / SHA256_BLOCK_SIZE;
+    if (chunk_len > 0) {
+        ctx->compress(ctx->hash, data, chunk_len);
+        data += chunk_len * SHA256_BLOCK_SIZE;
+        data_len -= chunk_len * SHA256_BLOCK_SIZE;
+    }
+    memcpy(ctx->block, data, data_len);
+    ctx->block_len = data_len;
+}
 
-    // Convert the digest to a byte array before returning it;
-    le_to_be_v32(hash, SHA256_DIGEST_SIZE / 4);
-    memcpy(*digest, hash, SHA256_DIGEST_SIZE);
+void sha256_update(sha256_ctx* ctx, const uint8_t* data, size_t data_len) {
+    if (data_len == 0) {
+        return;
+    }
+    STATS_PROBE2(sha256_update, data, data_len);
+    STATS_BEGIN(scope, data_len);
+    sha256_absorb(ctx, data, data_len);
+    // Every block boundary the message crossed took one compression;
+    STATS_END(scope, STATS_SHA256, data_len, 0, ctx->total_len / SHA256_BLOCK_SIZE - (ctx->total_len - data_len) / SHA256_BLOCK_SIZE);
+}
 
-    free(padded);
+void sha256_final(sha256_ctx* ctx, uint8_t* digest) {
+    uint64_t bit_length = ctx->total_len * 8;
+    STATS_PROBE1(sha256_final, ctx->total_len);
+    STATS_BEGIN(scope, SHA256_BLOCK_SIZE);
+    // Add the 1 bit as big-endian using the byte 0x80 = 0b10000000;
+    ctx->block[ctx->block_len++] = 0x80;
+    // If the 64-bit length does not fit in this block, pad it with zeros and start another one;
+    if (ctx->block_len > SHA256_BLOCK_SIZE - 8) {
+        memset(ctx->block + ctx->block_len, 0x00, SHA256_BLOCK_SIZE - ctx->block_len);
+        ctx->compress(ctx->hash, ctx->block, 1);
+        ctx->block_len = 0;
+    }
+    // Add the needed amount of 0 bits to reach congruence modulo 448;
+    memset(ctx->block + ctx->block_len, 0x00, SHA256_BLOCK_SIZE - 8 - ctx->block_len);
+    // Add the length of the message in bits as a big-endian 64-bit value;
+    endian_store_be64(ctx->block + SHA256_BLOCK_SIZE - 8, bit_length);
+    ctx->compress(ctx->hash, ctx->block, 1);
+    // Convert the digest to a big-endian byte array;
+    for (size_t i = 0; i < 8; i++) {
+        endian_store_be32(digest + 4 * i, ctx->hash[i]);
+    }
+    // The 0x80 byte and the length take a second block when fewer than 9 bytes are left;
+    STATS_END(scope, STATS_SHA256, 0, SHA256_DIGEST_SIZE, (ctx->total_len % SHA256_BLOCK_SIZE > SHA256_BLOCK_SIZE - 9) ? 2 : 1);
 }
 
-void sha256_testing(const char* test_file) {
-    FILE* file_ptr = safe_fopen(test_file, "rb");
-    char buffer[SHA256_MAX_TEST_MSG_LENGTH] = {0};
-    uint8_t* hex_message = NULL;
-    size_t message_length = 0;
-    uint8_t* digest = NULL;
+void sha256(const uint8_t* data, size_t data_len, uint8_t** digest, arena* arena) {
+    sha256_ctx ctx;
+    // Store the final value in the arena or on the heap;
+    *digest = arena_or_malloc(arena, SHA256_DIGEST_SIZE * sizeof **digest);
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, data_len);
+    sha256_final(&ctx, *digest);
+}
 
-    // Skip the first 7 lines of the file;
-    for (size_t i = 0; i < 7; i++) {
-        fgets(buffer, SHA256_MAX_TEST_MSG_LENGTH, file_ptr);
-    }
-    memset(buffer, 0, SHA256_MAX_TEST_MSG_LENGTH);
+// Hashes into a caller buffer, the harnesses hash hundreds of thousands of messages;
+static void sha256_digest(const uint8_t* data, size_t data_len, uint8_t* digest) {
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, data_len);
+    sha256_final(&ctx, digest);
+}
 
-    // Read the file in groups of 4 lines;
-    while (fgets(buffer, SHA256_MAX_TEST_MSG_LENGTH, file_ptr)) {
-        // Read the length L in bits (line 1);
-        sscanf(buffer, "Len = %zu", &message_length);
-        printf("Length : \t%zu bytes.\n", message_length / 8);
-        memset(buffer, 0, SHA256_MAX_TEST_MSG_LENGTH);
+typedef struct {
+    const uint8_t* const* data;
+    const size_t* data_len;
+    uint8_t* digests;
+} sha256_batch_job;
 
-        // Read the message as a string of hex characters (line 2);
-        fgets(buffer, SHA256_MAX_TEST_MSG_LENGTH, file_ptr);
-        sscanf(buffer, "Msg = %s", buffer);
-        // Turn the hex string into a byte array;
-        hex_message = hex_to_byte_array(buffer, message_length / 4);
-        memset(buffer, 0, SHA256_MAX_TEST_MSG_LENGTH);
+static void sha256_batch_range(void* context, size_t start, size_t end) {
+    sha256_batch_job* job = context;
+    for (size_t i = start; i < end; i++) {
+        sha256_digest(job->data[i], job->data_len[i], job->digests + i * SHA256_DIGEST_SIZE);
+    }
+}
 
-        // Read the NIST provided digest (line 3);
-        fgets(buffer, SHA256_MAX_TEST_MSG_LENGTH, file_ptr);
-        sscanf(buffer, "MD = %s", buffer);
-        printf("NIST Digest : \t%s\n", buffer);
-        memset(buffer, 0, SHA256_MAX_TEST_MSG_LENGTH);
+void sha256_batch(const uint8_t* const* data, const size_t* data_len, size_t count, uint8_t* digests) {
+    sha256_batch_job job = { .data = data, .data_len = data_len, .digests = digests };
+    size_t total_len = 0;
+    for (size_t i = 0; i < count; i++) {
+        total_len += data_len[i];
+    }
+    // Give every range about THREADPOOL_MIN_BYTES of input, a batch of short messages runs inline;
+    parallel_for(count, (total_len > 0) ? (count * THREADPOOL_MIN_BYTES + total_len - 1) / total_len : count,
+        sha256_batch_range, &job);
+}
 
-        // Every fourth line is empty => read and discard;
-        fgets(buffer, SHA256_MAX_TEST_MSG_LENGTH, file_ptr);
-        memset(buffer, 0, SHA256_MAX_TEST_MSG_LENGTH);
+static void sha256_malformed(const rsp_reader* reader) {
+    fprintf(stderr, "Malformed test vector on line %zu. Proceeding to crash. Cleaning up...", reader->record_line);
+    exit(EXIT_FAILURE);
+}
 
+void sha256_testing(const char* test_file) {
+    rsp_reader reader;
+    const uint8_t* message = NULL;
+    size_t message_length = 0;
+    size_t message_bytes = 0;
+    const rsp_field* nist_digest = NULL;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    rsp_open(&reader, test_file);
+    // Every record holds the length L in bits, the message and the NIST digest;
+    while (rsp_next(&reader)) {
+        message = rsp_hex(&reader, "Msg", &message_bytes);
+        nist_digest = rsp_find(&reader, "MD");
+        if ((rsp_size(&reader, "Len", &message_length) != 0) || (message == NULL) || (nist_digest == NULL) ||
+            (message_length / 8 > message_bytes)) {
+            sha256_malformed(&reader);
+        }
+        printf("Length : \t%zu bytes.\n", message_length / 8);
+        printf("NIST Digest : \t%.*s\n", (int)nist_digest->value.len, nist_digest->value.data);
         // Compute and print the local digest;
         printf("Local Digest : \t");
-        sha256(hex_message, message_length / 8, &digest);
+        sha256_digest(message, message_length / 8, digest);
         print_byte_array(digest, SHA256_DIGEST_SIZE);
     }
-    fclose(file_ptr);
-    free(hex_message);
-    free(digest);
+    rsp_close(&reader);
 }
 
 void sha256_monte_carlo(const char* test_file) {
-    FILE* file_ptr = safe_fopen(test_file, "rb");
-    char buffer[SHA256_MC_MAX_TEST_MSG_LENGTH] = { 0 };
-    uint8_t temp[SHA256_MC_MAX_TEST_MSG_LENGTH] = { 0 };
-    uint8_t* seed = NULL;
-    uint8_t* digest = NULL;
+    rsp_reader reader;
+    const uint8_t* seed = NULL;
+    size_t seed_len = 0;
+    const rsp_field* seed_hex = NULL;
+    const rsp_field* nist_digest = NULL;
+    uint8_t temp[3 * SHA256_DIGEST_SIZE] = { 0 };
+    uint8_t digest[SHA256_DIGEST_SIZE];
     size_t count = 0;
+    rsp_open(&reader, test_file);
 
-    // Skip the first 7 lines of the file;
-    for (size_t i = 0; i < 7; i++) {
-        fgets(buffer, SHA256_MC_MAX_TEST_MSG_LENGTH, file_ptr);
+    // The first record holds the initial seed;
+    if (!rsp_next(&reader)) {
+        sha256_malformed(&reader);
     }
-
-    // Read the initial seed;
-    fgets(buffer, SHA256_MC_MAX_TEST_MSG_LENGTH, file_ptr);
-    sscanf(buffer, "Seed = %s", buffer);
-    printf("Seed : \t\t%s\n", buffer);
-    seed = hex_to_byte_array(buffer, SHA256_BLOCK_SIZE);
-    memset(buffer, 0, SHA256_MC_MAX_TEST_MSG_LENGTH);
-
-    // The next line is empty => read and discard;
-    fgets(buffer, SHA256_MC_MAX_TEST_MSG_LENGTH, file_ptr);
-    memset(buffer, 0, SHA256_MC_MAX_TEST_MSG_LENGTH);
+    seed = rsp_hex(&reader, "Seed", &seed_len);
+    seed_hex = rsp_find(&reader, "Seed");
+    if ((seed == NULL) || (seed_len != SHA256_DIGEST_SIZE)) {
+        sha256_malformed(&reader);
+    }
+    printf("Seed : \t\t%.*s\n", (int)seed_hex->value.len, seed_hex->value.data);
 
     // Concatenate the seed three times to create the initial message;
     for (size_t i = 0; i < 3; i++) {
@@ -229,25 +364,19 @@ void sha256_monte_carlo(const char* test_file) {
     // Compute 100.000 iterations;
     for (size_t i = 1; i < SHA256_MC_ITERATIONS; i++) {
         // Hash the current message;
-        sha256(temp, 96, &digest);
+        sha256_digest(temp, sizeof temp, digest);
 
-        // Every 1000th iteration compare to the values in the file;
+        // Every 1000th iteration compare to the next record of the file;
         if ((i % SHA256_MC_POOL_INTERVAL == 0) && (i != 0)) {
-            // Read and print the count (line 1);
-            fgets(buffer, SHA256_MC_MAX_TEST_MSG_LENGTH, file_ptr);
-            sscanf(buffer, "COUNT = %zu", &count);
+            if (!rsp_next(&reader)) {
+                sha256_malformed(&reader);
+            }
+            nist_digest = rsp_find(&reader, "MD");
+            if ((rsp_size(&reader, "COUNT", &count) != 0) || (nist_digest == NULL)) {
+                sha256_malformed(&reader);
+            }
             printf("COUNT : \t%zu\n", count);
-            memset(buffer, 0, SHA256_MC_MAX_TEST_MSG_LENGTH);
-
-            // Read and print the NIST provided digest (line 2);
-            fgets(buffer, SHA256_MC_MAX_TEST_MSG_LENGTH, file_ptr);
-            sscanf(buffer, "MD = %s", buffer);
-            printf("NIST Digest : \t%s\n", buffer);
-            memset(buffer, 0, SHA256_MC_MAX_TEST_MSG_LENGTH);
-
-            // Every third line is empty => read and discard;
-            fgets(buffer, SHA256_MC_MAX_TEST_MSG_LENGTH, file_ptr);
-            memset(buffer, 0, SHA256_MC_MAX_TEST_MSG_LENGTH);
+            printf("NIST Digest : \t%.*s\n", (int)nist_digest->value.len, nist_digest->value.data);
 
             //// Print the message for debugging purposes;
             // printf("Current Message : \t");
@@ -273,7 +402,5 @@ void sha256_monte_carlo(const char* test_file) {
             memcpy(temp + 2 * SHA256_DIGEST_SIZE, digest, SHA256_DIGEST_SIZE);
         }
     }
-    fclose(file_ptr);
-    free(seed);
-    free(digest);
+    rsp_close(&reader);
 }
\ No newline at end of file
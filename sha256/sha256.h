@@ -11,17 +11,79 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "../utils/arena.h"
+
 #define SHA256_BLOCK_SIZE 64
 #define SHA256_DIGEST_SIZE 32
 
+// Compresses whole blocks into the intermediate hash value;
+typedef void (*sha256_compress_fn)(uint32_t* hash, const uint8_t* blocks, size_t nr_blocks);
+
+typedef struct {
+    // The intermediate hash value (the midstate after every complete block);
+    uint32_t hash[8];
+    // The bytes of the current, incomplete block;
+    uint8_t block[SHA256_BLOCK_SIZE];
+    size_t block_len;
+    // The total number of bytes hashed so far;
+    uint64_t total_len;
+    // The compression function of the backend the context was initialised for;
+    sha256_compress_fn compress;
+} sha256_ctx;
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Initialises a streaming SHA2-256 context.
+ * @details The context only points to static code, so it can be copied to save and reuse a
+ *          midstate. The backend is the one cpu_features selects for the "sha256" module.
+ * @param   ctx         A pointer to the context to initialise.
+ * ---------------------------------------------------------------------------------------- **/
+void sha256_init(sha256_ctx* ctx);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Initialises a streaming SHA2-256 context that uses a given backend.
+ * @param   ctx         A pointer to the context to initialise.
+ * @param   backend     The name of the backend, "shani" or "generic".
+ * @returns 0 on success, -1 if there is no such backend or the CPU cannot run it.
+ * ---------------------------------------------------------------------------------------- **/
+int sha256_init_backend(sha256_ctx* ctx, const char* backend);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Hashes the next part of a message.
+ * @param   ctx         A pointer to an initialised context.
+ * @param   data        A pointer to the data.
+ * @param   data_len    The length of the data in bytes.
+ * ---------------------------------------------------------------------------------------- **/
+void sha256_update(sha256_ctx* ctx, const uint8_t* data, size_t data_len);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Pads the message and writes its digest.
+ * @details The context must be initialised again before it is reused.
+ * @param   ctx         A pointer to the context.
+ * @param   digest      An array of SHA256_DIGEST_SIZE bytes to hold the digest.
+ * ---------------------------------------------------------------------------------------- **/
+void sha256_final(sha256_ctx* ctx, uint8_t* digest);
+
 /** ---------------------------------------------------------------------------------------
  * @brief   Hashes an array of bytes using SHA2-256.
- * @details The caller is responsible for freeing the memory allocated for the digest.
+ * @details The caller is responsible for freeing the memory allocated for the digest unless
+ *          it comes from an arena.
  * @param   data        A pointer to the data.
  * @param   data_len    The length of the data in bytes.
  * @param   digest      A NULL pointer for storing the digest as a byte array.
+ * @param   arena       The arena to allocate the digest from (NULL for the heap).
+ * ---------------------------------------------------------------------------------------- **/
+void sha256(const uint8_t* data, size_t data_len, uint8_t** digest, arena* arena);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Hashes many independent messages on the shared thread pool.
+ * @details Every thread takes a run of consecutive messages; batches shorter than
+ *          THREADPOOL_MIN_BYTES in total are hashed on the calling thread.
+ * @param   data        An array of count pointers to the messages.
+ * @param   data_len    An array of the count message lengths in bytes.
+ * @param   count       The number of messages.
+ * @param   digests     An array of count * SHA256_DIGEST_SIZE bytes to hold the digests in order.
  * ---------------------------------------------------------------------------------------- **/
-void sha256(const uint8_t* data, size_t data_len, uint8_t** digest);
+void sha256_batch(const uint8_t* const* data, const size_t* data_len, size_t count, uint8_t* digests);
 
 /** ---------------------------------------------------------------------------------------
  * @brief   Test the SHA2-256 implementation using the NIST short and long messages.
@@ -0,0 +1,80 @@
+#include <string.h>
+
+#include "arena.h"
+#include "general.h"
+
+// The block header is padded so the first allocation of a block is aligned as well;
+#define ARENA_HEADER_SIZE ((sizeof(arena_block) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+static size_t arena_round(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+static arena_block* arena_new_block(arena* arena, size_t size) {
+    arena_block* block = safe_aligned_malloc(ARENA_ALIGNMENT, ARENA_HEADER_SIZE + size);
+    block->size = size;
+    block->used = 0;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->nr_blocks++;
+    return block;
+}
+
+void arena_init(arena* arena, size_t block_size) {
+    memset(arena, 0, sizeof *arena);
+    arena->block_size = arena_round((block_size > 0) ? block_size : ARENA_DEFAULT_BLOCK_SIZE);
+}
+
+void* arena_alloc(arena* arena, size_t size) {
+    arena_block* block = arena->blocks;
+    void* ptr = NULL;
+    size = arena_round((size > 0) ? size : 1);
+    if ((block == NULL) || (block->size - block->used < size)) {
+        block = arena_new_block(arena, (size > arena->block_size) ? size : arena->block_size);
+    }
+    ptr = (uint8_t*)block + ARENA_HEADER_SIZE + block->used;
+    block->used += size;
+    arena->used += size;
+    arena->nr_allocs++;
+    if (arena->used > arena->high_water) {
+        arena->high_water = arena->used;
+    }
+    return ptr;
+}
+
+void* arena_or_malloc(arena* arena, size_t size) {
+    return (arena != NULL) ? arena_alloc(arena, size) : safe_malloc(size);
+}
+
+void arena_reset(arena* arena) {
+    arena_block* block = arena->blocks;
+    size_t total = 0;
+    arena->nr_resets++;
+    if (block == NULL) {
+        return;
+    }
+    // More than one block => replace them with one that holds everything the last request needed;
+    if (block->next != NULL) {
+        while (block != NULL) {
+            arena_block* next = block->next;
+            total += block->size;
+            free(block);
+            block = next;
+        }
+        arena->blocks = NULL;
+        block = arena_new_block(arena, total);
+    }
+    block->used = 0;
+    arena->used = 0;
+}
+
+void arena_free(arena* arena) {
+    arena_block* block = arena->blocks;
+    while (block != NULL) {
+        arena_block* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+    arena->used = 0;
+}
\ No newline at end of file
@@ -0,0 +1,81 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+/** ----------------------------------------------------------------------------------
+ * @brief   The functions defined in this file implement a bump allocator.
+ * @details Allocations are carved out of large blocks and are never freed one by one;
+ *          the whole arena is reset once a request is done. A reset folds all the blocks
+ *          used since the previous one into a single block big enough for all of them,
+ *          so a workload that repeats itself stops calling malloc() after its first run.
+ *          An arena is not thread-safe, every thread (or request) uses its own.
+ *
+ *          Functions that take an optional arena allocate their results from it when it
+ *          is not NULL, the caller then must not free() them. With a NULL arena they fall
+ *          back to safe_malloc() and the caller frees the results as before.
+ * @author  Murea Cosmin Alexandru
+ * @date    01.03.2024
+ * ----------------------------------------------------------------------------------- **/
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// Every allocation is aligned to this many bytes (enough for any SIMD load used in the tree);
+#define ARENA_ALIGNMENT 32
+#define ARENA_DEFAULT_BLOCK_SIZE 65536
+
+typedef struct arena_block {
+    struct arena_block* next;
+    size_t size;
+    size_t used;
+} arena_block;
+
+typedef struct {
+    // The block allocations are carved from, followed by the older ones;
+    arena_block* blocks;
+    // The smallest block the arena allocates;
+    size_t block_size;
+    // The bytes handed out since the last reset;
+    size_t used;
+    // The counters, which only ever grow;
+    size_t nr_allocs;
+    size_t nr_blocks;
+    size_t nr_resets;
+    size_t high_water;
+} arena;
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Initialises an empty arena, no memory is allocated until it is first used.
+ * @param   arena       A pointer to the arena to initialise.
+ * @param   block_size  The smallest block to allocate (0 for ARENA_DEFAULT_BLOCK_SIZE).
+ * ----------------------------------------------------------------------------------- **/
+void arena_init(arena* arena, size_t block_size);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Allocates memory that lives until the next reset of the arena.
+ * @param   arena       A pointer to the arena.
+ * @param   size        The number of bytes to allocate.
+ * @returns A pointer to ARENA_ALIGNMENT aligned memory.
+ * ----------------------------------------------------------------------------------- **/
+void* arena_alloc(arena* arena, size_t size);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Allocates from an arena, or with safe_malloc() if there is none.
+ * @param   arena       A pointer to the arena (can be NULL).
+ * @param   size        The number of bytes to allocate.
+ * @returns A pointer to the memory, to be freed by the caller only if arena is NULL.
+ * ----------------------------------------------------------------------------------- **/
+void* arena_or_malloc(arena* arena, size_t size);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Releases every allocation of the arena at once while keeping its memory.
+ * @param   arena       A pointer to the arena.
+ * ----------------------------------------------------------------------------------- **/
+void arena_reset(arena* arena);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Frees all the memory of an arena.
+ * @param   arena       A pointer to the arena.
+ * ----------------------------------------------------------------------------------- **/
+void arena_free(arena* arena);
+
+#endif
\ No newline at end of file
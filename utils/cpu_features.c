@@ -0,0 +1,192 @@
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define CPU_HAVE_X86 1
+#endif
+
+#include "cpu_features.h"
+
+// Set once the features have been read, so a CPU without any of them is not probed again;
+#define CPU_FEATURES_READY (1u << 31)
+
+static const char* const cpu_feature_names[CPU_NR_FEATURES] = {
+    "ssse3", "sse4.1", "aesni", "pclmul", "sha", "avx2", "bmi2", "avx512"
+};
+
+static uint32_t cpu_feature_mask = 0;
+static cpu_dispatch* cpu_registry[CPU_MAX_DISPATCH];
+static size_t cpu_nr_registered = 0;
+
+#ifdef CPU_HAVE_X86
+
+// The register state the OS saves on context switches (xgetbv is only valid with OSXSAVE);
+static uint64_t cpu_xcr0(void) {
+    uint32_t eax = 0, edx = 0;
+    __asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+}
+
+static uint32_t cpu_detect(void) {
+    uint32_t eax = 0, ebx = 0, ecx = 0, edx = 0;
+    uint32_t features = 0;
+    uint64_t xcr0 = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    features |= (ecx & bit_SSSE3) ? CPU_FEATURE_SSSE3 : 0;
+    features |= (ecx & bit_SSE4_1) ? CPU_FEATURE_SSE41 : 0;
+    features |= (ecx & bit_AES) ? CPU_FEATURE_AESNI : 0;
+    features |= (ecx & bit_PCLMUL) ? CPU_FEATURE_PCLMUL : 0;
+    xcr0 = (ecx & bit_OSXSAVE) ? cpu_xcr0() : 0;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return features;
+    }
+    features |= (ebx & bit_SHA) ? CPU_FEATURE_SHA : 0;
+    features |= (ebx & bit_BMI2) ? CPU_FEATURE_BMI2 : 0;
+    // The vector extensions also need the OS to save the wider registers (XMM | YMM, then opmask | ZMM);
+    if ((ebx & bit_AVX2) && ((xcr0 & 0x06) == 0x06)) {
+        features |= CPU_FEATURE_AVX2;
+    }
+    if ((ebx & bit_AVX512F) && (ebx & bit_AVX512BW) && (ebx & bit_AVX512VL) && ((xcr0 & 0xE6) == 0xE6)) {
+        features |= CPU_FEATURE_AVX512;
+    }
+    return features;
+}
+
+#else
+
+static uint32_t cpu_detect(void) {
+    return 0;
+}
+
+#endif
+
+uint32_t cpu_features(void) {
+    uint32_t features = __atomic_load_n(&cpu_feature_mask, __ATOMIC_ACQUIRE);
+    if (features == 0) {
+        features = cpu_detect() | CPU_FEATURES_READY;
+        __atomic_store_n(&cpu_feature_mask, features, __ATOMIC_RELEASE);
+    }
+    return features & ~CPU_FEATURES_READY;
+}
+
+const char* cpu_feature_name(uint32_t feature) {
+    for (size_t i = 0; i < CPU_NR_FEATURES; i++) {
+        if (feature == (1u << i)) {
+            return cpu_feature_names[i];
+        }
+    }
+    return "unknown";
+}
+
+void cpu_dispatch_register(cpu_dispatch* dispatch) {
+    if (cpu_nr_registered == CPU_MAX_DISPATCH) {
+        fprintf(stderr, "Too many dispatch tables. Proceeding to crash. Cleaning up...");
+        exit(EXIT_FAILURE);
+    }
+    cpu_registry[cpu_nr_registered++] = dispatch;
+}
+
+const cpu_backend* cpu_dispatch_find(const cpu_dispatch* dispatch, const char* name) {
+    uint32_t features = cpu_features();
+    for (size_t i = 0; i < dispatch->nr_backends; i++) {
+        if (strcmp(dispatch->backends[i].name, name) == 0) {
+            return ((dispatch->backends[i].features & ~features) == 0) ? &dispatch->backends[i] : NULL;
+        }
+    }
+    return NULL;
+}
+
+static int cpu_has_backend(const cpu_dispatch* dispatch, const char* name) {
+    for (size_t i = 0; i < dispatch->nr_backends; i++) {
+        if (strcmp(dispatch->backends[i].name, name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Returns the backend CPU_BACKEND_ENV forces for a module, or NULL if it forces none;
+static const cpu_backend* cpu_forced(const cpu_dispatch* dispatch) {
+    const char* list = getenv(CPU_BACKEND_ENV);
+    const cpu_backend* forced = NULL;
+    char entry[64];
+    char* name = NULL;
+    size_t entry_len = 0;
+    while ((list != NULL) && (*list != '\0')) {
+        entry_len = strcspn(list, ",");
+        if (entry_len < sizeof entry) {
+            memcpy(entry, list, entry_len);
+            entry[entry_len] = '\0';
+            name = strchr(entry, '=');
+            if (name != NULL) {
+                *name++ = '\0';
+            }
+            // A plain name only applies to the modules that have a backend of that name;
+            if (((name != NULL) && (strcmp(entry, dispatch->module) == 0)) ||
+                ((name == NULL) && cpu_has_backend(dispatch, entry))) {
+                name = (name != NULL) ? name : entry;
+                forced = cpu_dispatch_find(dispatch, name);
+                if (forced != NULL) {
+                    return forced;
+                }
+                fprintf(stderr, "%s: backend %s of %s is unknown or not supported by this CPU, ignoring it\n",
+                    CPU_BACKEND_ENV, name, dispatch->module);
+            }
+        }
+        list += entry_len + (list[entry_len] == ',');
+    }
+    return NULL;
+}
+
+const cpu_backend* cpu_dispatch_active(cpu_dispatch* dispatch) {
+    const cpu_backend* active = __atomic_load_n(&dispatch->active, __ATOMIC_ACQUIRE);
+    uint32_t features = 0;
+    if (active != NULL) {
+        return active;
+    }
+    active = cpu_forced(dispatch);
+    if (active == NULL) {
+        features = cpu_features();
+        for (size_t i = 0; (i < dispatch->nr_backends) && (active == NULL); i++) {
+            if ((dispatch->backends[i].features & ~features) == 0) {
+                active = &dispatch->backends[i];
+            }
+        }
+    }
+    __atomic_store_n(&dispatch->active, active, __ATOMIC_RELEASE);
+    return active;
+}
+
+const char* cpu_backend_active(const char* module) {
+    for (size_t i = 0; i < cpu_nr_registered; i++) {
+        if (strcmp(cpu_registry[i]->module, module) == 0) {
+            return cpu_dispatch_active(cpu_registry[i])->name;
+        }
+    }
+    return NULL;
+}
+
+int cpu_backend_supported(const char* module, const char* backend) {
+    for (size_t i = 0; i < cpu_nr_registered; i++) {
+        if (strcmp(cpu_registry[i]->module, module) == 0) {
+            return cpu_dispatch_find(cpu_registry[i], backend) != NULL;
+        }
+    }
+    return 0;
+}
+
+void cpu_report(FILE* stream) {
+    uint32_t features = cpu_features();
+    fprintf(stream, "features:");
+    for (size_t i = 0; i < CPU_NR_FEATURES; i++) {
+        if (features & (1u << i)) {
+            fprintf(stream, " %s", cpu_feature_names[i]);
+        }
+    }
+    fprintf(stream, "\n");
+    for (size_t i = 0; i < cpu_nr_registered; i++) {
+        fprintf(stream, "%-8s %s\n", cpu_registry[i]->module, cpu_dispatch_active(cpu_registry[i])->name);
+    }
+}
\ No newline at end of file
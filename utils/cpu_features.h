@@ -0,0 +1,112 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+/** ----------------------------------------------------------------------------------
+ * @brief   The functions defined in this file pick an implementation by CPU capability.
+ * @details CPUID is read once. Every module with several implementations describes them
+ *          in a cpu_dispatch table, fastest first and ending with a backend that needs no
+ *          features, and registers the table at start-up. The first call that needs the
+ *          table selects the fastest backend the CPU supports and caches it.
+ *
+ *          The CPU_BACKEND_ENV environment variable forces backends for testing, as a
+ *          comma separated list of module=backend pairs or plain backend names that apply
+ *          to every module which has a backend of that name, e.g.
+ *          NIGHTHAWK_BACKEND=generic or NIGHTHAWK_BACKEND=aes=generic,sha256=shani.
+ *          A forced backend the CPU cannot run is reported and ignored.
+ * @author  Murea Cosmin Alexandru
+ * @date    01.03.2024
+ * ----------------------------------------------------------------------------------- **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#define CPU_FEATURE_SSSE3 (1u << 0)
+#define CPU_FEATURE_SSE41 (1u << 1)
+#define CPU_FEATURE_AESNI (1u << 2)
+#define CPU_FEATURE_PCLMUL (1u << 3)
+#define CPU_FEATURE_SHA (1u << 4)
+#define CPU_FEATURE_AVX2 (1u << 5)
+#define CPU_FEATURE_BMI2 (1u << 6)
+// AVX-512 F, BW and VL, with the OS saving the opmask and upper ZMM registers;
+#define CPU_FEATURE_AVX512 (1u << 7)
+#define CPU_NR_FEATURES 8
+
+#define CPU_BACKEND_ENV "NIGHTHAWK_BACKEND"
+#define CPU_MAX_DISPATCH 16
+
+typedef struct {
+    const char* name;
+    // The CPU_FEATURE_* bits the backend needs;
+    uint32_t features;
+    // The functions of the backend, in a struct of the module's own;
+    const void* ops;
+} cpu_backend;
+
+typedef struct {
+    const char* module;
+    // Fastest first, the last backend must need no features;
+    const cpu_backend* backends;
+    size_t nr_backends;
+    // The selected backend (NULL until the first cpu_dispatch_active() call);
+    const cpu_backend* active;
+} cpu_dispatch;
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Reports the features of the CPU, detected on the first call.
+ * @returns A mask of CPU_FEATURE_* bits (0 on other architectures than x86).
+ * ----------------------------------------------------------------------------------- **/
+uint32_t cpu_features(void);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Names a single feature bit.
+ * @param   feature     One of the CPU_FEATURE_* bits.
+ * @returns A lower case name, e.g. "aesni", or "unknown".
+ * ----------------------------------------------------------------------------------- **/
+const char* cpu_feature_name(uint32_t feature);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Makes a dispatch table visible to cpu_backend_active() and cpu_report().
+ * @details Modules call it from a constructor, before any thread is started.
+ * @param   dispatch    A pointer to the table, which must outlive the program.
+ * ----------------------------------------------------------------------------------- **/
+void cpu_dispatch_register(cpu_dispatch* dispatch);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Returns the backend in use, selecting it on the first call.
+ * @details Racing first calls all select the same backend, so no lock is needed.
+ * @param   dispatch    A pointer to the table of the module.
+ * @returns A pointer to the selected backend.
+ * ----------------------------------------------------------------------------------- **/
+const cpu_backend* cpu_dispatch_active(cpu_dispatch* dispatch);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Looks a backend up by name, e.g. to test every backend in one process.
+ * @param   dispatch    A pointer to the table of the module.
+ * @param   name        The name of the backend.
+ * @returns A pointer to the backend, or NULL if there is none or the CPU cannot run it.
+ * ----------------------------------------------------------------------------------- **/
+const cpu_backend* cpu_dispatch_find(const cpu_dispatch* dispatch, const char* name);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Reports the backend a registered module uses.
+ * @param   module      The name of the module, e.g. "aes".
+ * @returns The name of the backend, or NULL if no such module is registered.
+ * ----------------------------------------------------------------------------------- **/
+const char* cpu_backend_active(const char* module);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Tells whether a registered module has a backend the CPU can run.
+ * @param   module      The name of the module, e.g. "aes".
+ * @param   backend     The name of the backend, e.g. "aesni".
+ * @returns 1 if the backend can run, 0 otherwise.
+ * ----------------------------------------------------------------------------------- **/
+int cpu_backend_supported(const char* module, const char* backend);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Writes the detected features and the backend of every registered module.
+ * @param   stream      The stream to write to.
+ * ----------------------------------------------------------------------------------- **/
+void cpu_report(FILE* stream);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include <string.h>
+#include <pthread.h>
+
+#include "drbg.h"
+#include "seed.h"
+#include "general.h"
+#include "endian.h"
+#include "../sha256/sha256.h"
+
+// The labels separating the output, key update and reseed hashes;
+#define DRBG_OUTPUT 0x00
+#define DRBG_UPDATE 0x01
+#define DRBG_RESEED 0x02
+
+// Incremented in the child after fork(), so inherited states notice and reseed;
+static volatile uint64_t drbg_generation = 0;
+static pthread_once_t drbg_once = PTHREAD_ONCE_INIT;
+
+static void drbg_fork_child(void) {
+    drbg_generation++;
+}
+
+static void drbg_register_fork(void) {
+    pthread_atfork(NULL, NULL, drbg_fork_child);
+}
+
+static void drbg_hash(const uint8_t* key, uint8_t label, uint64_t counter, const uint8_t* seed, size_t seed_len,
+    const uint8_t* extra, size_t extra_len, uint8_t* digest) {
+    sha256_ctx ctx;
+    // The counter is big-endian, so every host derives the same stream from the same key;
+    uint8_t counter_bytes[sizeof counter];
+    endian_store_be64(counter_bytes, counter);
+    // The input is key || label || counter || seed || extra;
+    sha256_init(&ctx);
+    sha256_update(&ctx, key, DRBG_KEY_LEN);
+    sha256_update(&ctx, &label, 1);
+    sha256_update(&ctx, counter_bytes, sizeof counter_bytes);
+    sha256_update(&ctx, seed, seed_len);
+    sha256_update(&ctx, extra, extra_len);
+    sha256_final(&ctx, digest);
+    secure_zero(&ctx, sizeof ctx);
+}
+
+void drbg_init(drbg_state* state, const char* domain, const uint8_t* additional, size_t additional_len) {
+    pthread_once(&drbg_once, drbg_register_fork);
+    memset(state, 0, sizeof *state);
+    state->domain = domain;
+    drbg_reseed(state, additional, additional_len);
+}
+
+void drbg_reseed(drbg_state* state, const uint8_t* additional, size_t additional_len) {
+    uint8_t seed[DRBG_KEY_LEN];
+    // The fresh seed and the caller's input are absorbed one after the other, whatever the input length;
+    seed_bytes(state->domain, seed, DRBG_KEY_LEN);
+    drbg_hash(state->key, DRBG_RESEED, state->counter, seed, DRBG_KEY_LEN, additional, additional_len, state->key);
+    secure_zero(seed, DRBG_KEY_LEN);
+    state->requests = 0;
+    state->generation = drbg_generation;
+}
+
+void drbg_generate(drbg_state* state, uint8_t* output, size_t output_len) {
+    uint8_t block[SHA256_DIGEST_SIZE];
+    size_t chunk_len = 0;
+    if ((state->generation != drbg_generation) || (state->requests >= DRBG_RESEED_INTERVAL)) {
+        drbg_reseed(state, NULL, 0);
+    }
+    for (size_t i = 0; i < output_len; i += chunk_len) {
+        chunk_len = (output_len - i < SHA256_DIGEST_SIZE) ? output_len - i : SHA256_DIGEST_SIZE;
+        drbg_hash(state->key, DRBG_OUTPUT, state->counter++, NULL, 0, NULL, 0, block);
+        memcpy(output + i, block, chunk_len);
+    }
+    // Replace the key, so the output of this request cannot be recomputed from the state;
+    drbg_hash(state->key, DRBG_UPDATE, state->counter++, NULL, 0, NULL, 0, state->key);
+    secure_zero(block, SHA256_DIGEST_SIZE);
+    state->requests++;
+}
+
+void drbg_clear(drbg_state* state) {
+    secure_zero(state, sizeof *state);
+}
\ No newline at end of file
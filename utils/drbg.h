@@ -0,0 +1,62 @@
+#ifndef DRBG_H
+#define DRBG_H
+
+/** ----------------------------------------------------------------------------------
+ * @brief   The functions defined in this file implement a hash-based random bit generator.
+ * @details The generator is seeded from the shared seed pool and expands its 32-byte key
+ *          with SHA2-256 in counter mode. The key is replaced after every request, so
+ *          earlier output cannot be recovered from the state. The generator reseeds on
+ *          its own after DRBG_RESEED_INTERVAL requests and in the child after fork().
+ * @author  Murea Cosmin Alexandru
+ * @date    01.03.2024
+ * ----------------------------------------------------------------------------------- **/
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define DRBG_KEY_LEN 32
+// The number of requests served before fresh seed material is drawn from the pool;
+#define DRBG_RESEED_INTERVAL 65536
+
+typedef struct {
+    uint8_t key[DRBG_KEY_LEN];
+    uint64_t counter;
+    uint64_t requests;
+    // The fork generation the state was seeded in;
+    uint64_t generation;
+    // The seed pool domain, which must outlive the state (usually a string literal);
+    const char* domain;
+} drbg_state;
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Seeds a generator from the seed pool.
+ * @param   state           A pointer to the state to seed.
+ * @param   domain          A NUL-terminated label naming the consumer of the generator.
+ * @param   additional      Optional bytes mixed into the seed (may be NULL).
+ * @param   additional_len  The length of the additional bytes.
+ * ----------------------------------------------------------------------------------- **/
+void drbg_init(drbg_state* state, const char* domain, const uint8_t* additional, size_t additional_len);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Mixes fresh seed material and optional additional bytes into the key.
+ * @param   state           A pointer to the generator state.
+ * @param   additional      Optional bytes mixed into the key (may be NULL).
+ * @param   additional_len  The length of the additional bytes.
+ * ----------------------------------------------------------------------------------- **/
+void drbg_reseed(drbg_state* state, const uint8_t* additional, size_t additional_len);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Fills a buffer with pseudorandom bytes.
+ * @param   state       A pointer to the generator state.
+ * @param   output      An array to hold the output.
+ * @param   output_len  The number of bytes to generate.
+ * ----------------------------------------------------------------------------------- **/
+void drbg_generate(drbg_state* state, uint8_t* output, size_t output_len);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Wipes the state of a generator.
+ * @param   state       A pointer to the generator state.
+ * ----------------------------------------------------------------------------------- **/
+void drbg_clear(drbg_state* state);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,132 @@
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ENDIAN_HAVE_X86 1
+#endif
+
+#include "endian.h"
+#include "cpu_features.h"
+
+typedef struct {
+    // Reverse every word of count words, the buffers hold bytes so any alignment works;
+    void (*swap32)(uint8_t* dst, const uint8_t* src, size_t count);
+    void (*swap64)(uint8_t* dst, const uint8_t* src, size_t count);
+} endian_ops;
+
+static void endian_swap32_generic(uint8_t* dst, const uint8_t* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        endian_store_be32(dst + 4 * i, endian_load_le32(src + 4 * i));
+    }
+}
+
+static void endian_swap64_generic(uint8_t* dst, const uint8_t* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        endian_store_be64(dst + 8 * i, endian_load_le64(src + 8 * i));
+    }
+}
+
+#ifdef ENDIAN_HAVE_X86
+
+__attribute__((target("ssse3")))
+static void endian_swap_ssse3(uint8_t* dst, const uint8_t* src, size_t len, __m128i mask) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i)), mask));
+    }
+}
+
+__attribute__((target("ssse3")))
+static void endian_swap32_ssse3(uint8_t* dst, const uint8_t* src, size_t count) {
+    const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t done = count - count % 4;
+    endian_swap_ssse3(dst, src, 4 * done, mask);
+    endian_swap32_generic(dst + 4 * done, src + 4 * done, count - done);
+}
+
+__attribute__((target("ssse3")))
+static void endian_swap64_ssse3(uint8_t* dst, const uint8_t* src, size_t count) {
+    const __m128i mask = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    size_t done = count - count % 2;
+    endian_swap_ssse3(dst, src, 8 * done, mask);
+    endian_swap64_generic(dst + 8 * done, src + 8 * done, count - done);
+}
+
+// Two vectors per step keep two loads in flight, the conversion is bound by memory either way;
+__attribute__((target("avx2")))
+static void endian_swap_avx2(uint8_t* dst, const uint8_t* src, size_t len, __m256i mask) {
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m256i first = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i second = _mm256_loadu_si256((const __m256i*)(src + i + 32));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(first, mask));
+        _mm256_storeu_si256((__m256i*)(dst + i + 32), _mm256_shuffle_epi8(second, mask));
+    }
+    for (; i + 32 <= len; i += 32) {
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src + i)), mask));
+    }
+}
+
+// PSHUFB works per 128 bit lane => the masks repeat for both lanes;
+__attribute__((target("avx2")))
+static void endian_swap32_avx2(uint8_t* dst, const uint8_t* src, size_t count) {
+    const __m256i mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t done = count - count % 8;
+    endian_swap_avx2(dst, src, 4 * done, mask);
+    endian_swap32_ssse3(dst + 4 * done, src + 4 * done, count - done);
+}
+
+__attribute__((target("avx2")))
+static void endian_swap64_avx2(uint8_t* dst, const uint8_t* src, size_t count) {
+    const __m256i mask = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+        7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    size_t done = count - count % 4;
+    endian_swap_avx2(dst, src, 8 * done, mask);
+    endian_swap64_ssse3(dst + 8 * done, src + 8 * done, count - done);
+}
+
+#endif
+
+static const endian_ops endian_generic_ops = { endian_swap32_generic, endian_swap64_generic };
+#ifdef ENDIAN_HAVE_X86
+static const endian_ops endian_ssse3_ops = { endian_swap32_ssse3, endian_swap64_ssse3 };
+static const endian_ops endian_avx2_ops = { endian_swap32_avx2, endian_swap64_avx2 };
+#endif
+
+static const cpu_backend endian_backends[] = {
+#ifdef ENDIAN_HAVE_X86
+    { "avx2", CPU_FEATURE_AVX2, &endian_avx2_ops },
+    { "ssse3", CPU_FEATURE_SSSE3, &endian_ssse3_ops },
+#endif
+    { "generic", 0, &endian_generic_ops }
+};
+
+static cpu_dispatch endian_dispatch = { "endian", endian_backends, sizeof endian_backends / sizeof endian_backends[0], NULL };
+
+__attribute__((constructor))
+static void endian_register(void) {
+    cpu_dispatch_register(&endian_dispatch);
+}
+
+void endian_bswap32_array(uint32_t* dst, const uint32_t* src, size_t count) {
+    ((const endian_ops*)cpu_dispatch_active(&endian_dispatch)->ops)->swap32((uint8_t*)dst, (const uint8_t*)src, count);
+}
+
+void endian_bswap64_array(uint64_t* dst, const uint64_t* src, size_t count) {
+    ((const endian_ops*)cpu_dispatch_active(&endian_dispatch)->ops)->swap64((uint8_t*)dst, (const uint8_t*)src, count);
+}
+
+void endian_load_be32_array(uint32_t* words, const uint8_t* bytes, size_t count) {
+#ifdef ENDIAN_HOST_BIG
+    memmove(words, bytes, 4 * count);
+#else
+    ((const endian_ops*)cpu_dispatch_active(&endian_dispatch)->ops)->swap32((uint8_t*)words, bytes, count);
+#endif
+}
+
+void endian_store_be32_array(uint8_t* bytes, const uint32_t* words, size_t count) {
+#ifdef ENDIAN_HOST_BIG
+    memmove(bytes, words, 4 * count);
+#else
+    ((const endian_ops*)cpu_dispatch_active(&endian_dispatch)->ops)->swap32(bytes, (const uint8_t*)words, count);
+#endif
+}
\ No newline at end of file
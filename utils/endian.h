@@ -0,0 +1,183 @@
+#ifndef ENDIAN_H
+#define ENDIAN_H
+
+/** ----------------------------------------------------------------------------------
+ * @brief   The functions defined in this file load and store words in a fixed byte order.
+ * @details The loads and stores go through memcpy(), so they accept any alignment and
+ *          compile to a single move plus a bswap on x86. The _aligned variants promise a
+ *          naturally aligned pointer, which only matters on targets without unaligned
+ *          loads. The array conversions have AVX2 and SSSE3 kernels that swap 32 or 16
+ *          bytes per PSHUFB and a bswap fallback, registered as the "endian" module of
+ *          cpu_features.
+ * @author  Murea Cosmin Alexandru
+ * @date    01.03.2024
+ * ----------------------------------------------------------------------------------- **/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define ENDIAN_HOST_BIG 1
+#endif
+
+static inline uint16_t endian_bswap16(uint16_t value) {
+    return __builtin_bswap16(value);
+}
+
+static inline uint32_t endian_bswap32(uint32_t value) {
+    return __builtin_bswap32(value);
+}
+
+static inline uint64_t endian_bswap64(uint64_t value) {
+    return __builtin_bswap64(value);
+}
+
+// Convert between the host order and big-endian (the same operation in both directions);
+#ifdef ENDIAN_HOST_BIG
+#define ENDIAN_BE16(value) (value)
+#define ENDIAN_BE32(value) (value)
+#define ENDIAN_BE64(value) (value)
+#define ENDIAN_LE16(value) endian_bswap16(value)
+#define ENDIAN_LE32(value) endian_bswap32(value)
+#define ENDIAN_LE64(value) endian_bswap64(value)
+#else
+#define ENDIAN_BE16(value) endian_bswap16(value)
+#define ENDIAN_BE32(value) endian_bswap32(value)
+#define ENDIAN_BE64(value) endian_bswap64(value)
+#define ENDIAN_LE16(value) (value)
+#define ENDIAN_LE32(value) (value)
+#define ENDIAN_LE64(value) (value)
+#endif
+
+static inline uint16_t endian_load_be16(const void* bytes) {
+    uint16_t value;
+    memcpy(&value, bytes, sizeof value);
+    return ENDIAN_BE16(value);
+}
+
+static inline uint32_t endian_load_be32(const void* bytes) {
+    uint32_t value;
+    memcpy(&value, bytes, sizeof value);
+    return ENDIAN_BE32(value);
+}
+
+static inline uint64_t endian_load_be64(const void* bytes) {
+    uint64_t value;
+    memcpy(&value, bytes, sizeof value);
+    return ENDIAN_BE64(value);
+}
+
+static inline uint16_t endian_load_le16(const void* bytes) {
+    uint16_t value;
+    memcpy(&value, bytes, sizeof value);
+    return ENDIAN_LE16(value);
+}
+
+static inline uint32_t endian_load_le32(const void* bytes) {
+    uint32_t value;
+    memcpy(&value, bytes, sizeof value);
+    return ENDIAN_LE32(value);
+}
+
+static inline uint64_t endian_load_le64(const void* bytes) {
+    uint64_t value;
+    memcpy(&value, bytes, sizeof value);
+    return ENDIAN_LE64(value);
+}
+
+static inline void endian_store_be16(void* bytes, uint16_t value) {
+    value = ENDIAN_BE16(value);
+    memcpy(bytes, &value, sizeof value);
+}
+
+static inline void endian_store_be32(void* bytes, uint32_t value) {
+    value = ENDIAN_BE32(value);
+    memcpy(bytes, &value, sizeof value);
+}
+
+static inline void endian_store_be64(void* bytes, uint64_t value) {
+    value = ENDIAN_BE64(value);
+    memcpy(bytes, &value, sizeof value);
+}
+
+static inline void endian_store_le16(void* bytes, uint16_t value) {
+    value = ENDIAN_LE16(value);
+    memcpy(bytes, &value, sizeof value);
+}
+
+static inline void endian_store_le32(void* bytes, uint32_t value) {
+    value = ENDIAN_LE32(value);
+    memcpy(bytes, &value, sizeof value);
+}
+
+static inline void endian_store_le64(void* bytes, uint64_t value) {
+    value = ENDIAN_LE64(value);
+    memcpy(bytes, &value, sizeof value);
+}
+
+static inline uint32_t endian_load_be32_aligned(const void* bytes) {
+    return ENDIAN_BE32(*(const uint32_t*)__builtin_assume_aligned(bytes, sizeof(uint32_t)));
+}
+
+static inline uint64_t endian_load_be64_aligned(const void* bytes) {
+    return ENDIAN_BE64(*(const uint64_t*)__builtin_assume_aligned(bytes, sizeof(uint64_t)));
+}
+
+static inline uint32_t endian_load_le32_aligned(const void* bytes) {
+    return ENDIAN_LE32(*(const uint32_t*)__builtin_assume_aligned(bytes, sizeof(uint32_t)));
+}
+
+static inline uint64_t endian_load_le64_aligned(const void* bytes) {
+    return ENDIAN_LE64(*(const uint64_t*)__builtin_assume_aligned(bytes, sizeof(uint64_t)));
+}
+
+static inline void endian_store_be32_aligned(void* bytes, uint32_t value) {
+    *(uint32_t*)__builtin_assume_aligned(bytes, sizeof(uint32_t)) = ENDIAN_BE32(value);
+}
+
+static inline void endian_store_be64_aligned(void* bytes, uint64_t value) {
+    *(uint64_t*)__builtin_assume_aligned(bytes, sizeof(uint64_t)) = ENDIAN_BE64(value);
+}
+
+static inline void endian_store_le32_aligned(void* bytes, uint32_t value) {
+    *(uint32_t*)__builtin_assume_aligned(bytes, sizeof(uint32_t)) = ENDIAN_LE32(value);
+}
+
+static inline void endian_store_le64_aligned(void* bytes, uint64_t value) {
+    *(uint64_t*)__builtin_assume_aligned(bytes, sizeof(uint64_t)) = ENDIAN_LE64(value);
+}
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Reverses the bytes of every 32-bit word of an array.
+ * @param   dst         A pointer to the output words (may be equal to src, not overlap it otherwise).
+ * @param   src         A pointer to the input words.
+ * @param   count       The number of words.
+ * ----------------------------------------------------------------------------------- **/
+void endian_bswap32_array(uint32_t* dst, const uint32_t* src, size_t count);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Reverses the bytes of every 64-bit word of an array.
+ * @param   dst         A pointer to the output words (may be equal to src, not overlap it otherwise).
+ * @param   src         A pointer to the input words.
+ * @param   count       The number of words.
+ * ----------------------------------------------------------------------------------- **/
+void endian_bswap64_array(uint64_t* dst, const uint64_t* src, size_t count);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Reads big-endian 32-bit words, e.g. a list of digests or a message block.
+ * @param   words       A pointer to the output words.
+ * @param   bytes       A pointer to 4 * count bytes, with any alignment.
+ * @param   count       The number of words.
+ * ----------------------------------------------------------------------------------- **/
+void endian_load_be32_array(uint32_t* words, const uint8_t* bytes, size_t count);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Writes 32-bit words as big-endian bytes.
+ * @param   bytes       A pointer to 4 * count output bytes, with any alignment.
+ * @param   words       A pointer to the input words.
+ * @param   count       The number of words.
+ * ----------------------------------------------------------------------------------- **/
+void endian_store_be32_array(uint8_t* bytes, const uint32_t* words, size_t count);
+
+#endif
\ No newline at end of file
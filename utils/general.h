@@ -9,9 +9,13 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+
+#include "arena.h"
 
 /** ----------------------------------------------------------------------------------
  * @brief   Prints an array of bytes to stdout in hex format.
+ * @details Use hex_print() to write to another stream.
  * @param   byte_array    A pointer to the array of bytes to print.
  * @param   size          The number of bytes to print.
  * ----------------------------------------------------------------------------------- **/
@@ -19,28 +23,57 @@ void print_byte_array(const uint8_t* byte_array, size_t size);
 
 /** ----------------------------------------------------------------------------------
  * @brief   Converts a hex string into an array of bytes.
- * @details If the length of the hex string is odd, a 0 nibble is prepended.
+ * @details If the length of the hex string is odd, a 0 nibble is prepended. Crashes on
+ *          characters that are not hex digits. Use hex_decode() to fill an existing buffer.
  * @param   hex_string  A pointer to the hex string to convert.
  * @param   hex_len     The number of hex digits in the string.
+ * @param   arena       The arena to allocate the byte array from (NULL for the heap).
  * @returns A pointer to the byte array.
  * ----------------------------------------------------------------------------------- **/
-uint8_t* hex_to_byte_array(const char* hex_string, size_t hex_len);
+uint8_t* hex_to_byte_array(const char* hex_string, size_t hex_len, arena* arena);
 
 /** ----------------------------------------------------------------------------------
  * @brief   Convert an array of byte into a uint64_t value.
- * @param   byte_array    A pointer to the array of bytes to convert.
- * @param   size          The size of the byte array.
+ * @details The bytes are read as little-endian, see endian.h for the other loads.
+ * @param   byte_array    A pointer to the 8 bytes to convert.
  * @returns A 64 bit value where each byte is an array element.
  * ----------------------------------------------------------------------------------- **/
 uint64_t byte_array_to_uint64(const uint8_t* byte_array);
 
 /** ----------------------------------------------------------------------------------
  * @brief   Wraps the malloc() function and handles memory allocation errors.
+ * @details Every call is counted, see safe_malloc_count().
  * @param   size        The amount of heap memory to allocate (in bytes).
  * @returns A pointer to the block of memory allocated (if no errors occurred).
  * ----------------------------------------------------------------------------------- **/
 void* safe_malloc(size_t size);
 
+/** ----------------------------------------------------------------------------------
+ * @brief   Allocates aligned heap memory and handles memory allocation errors.
+ * @details The memory is released with free().
+ * @param   alignment   The alignment in bytes (a power of two multiple of sizeof(void*)).
+ * @param   size        The amount of heap memory to allocate (in bytes).
+ * @returns A pointer to the block of memory allocated (if no errors occurred).
+ * ----------------------------------------------------------------------------------- **/
+void* safe_aligned_malloc(size_t alignment, size_t size);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Counts the heap allocations made through safe_malloc() and safe_aligned_malloc().
+ * @details The counter is shared by all threads. Sampling it around a workload shows
+ *          whether the workload still allocates once it has reached a steady state.
+ * @returns The number of allocations since the program started.
+ * ----------------------------------------------------------------------------------- **/
+uint64_t safe_malloc_count(void);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Overwrites a buffer with zeros in a way the compiler cannot optimise out.
+ * @details A memset() of memory that is not read again is a dead store, which -O3 and LTO
+ *          may drop. Use this for keys, seeds and every other secret.
+ * @param   buffer      A pointer to the buffer.
+ * @param   len         The length of the buffer in bytes.
+ * ----------------------------------------------------------------------------------- **/
+void secure_zero(void* buffer, size_t len);
+
 /** ----------------------------------------------------------------------------------
  * @brief   Wraps the fopen() function and handles file access errors.
  * @param   file_path   The path of the file to open.
@@ -54,12 +87,14 @@ FILE* safe_fopen(const char* file_path, const char* mode);
  * @param   file_path   The path of the file to read.
  * @param   buffer      A NULL pointer for storing the file data as a byte array.
  * @param   buffer_len  The length of the buffer in bytes.
+ * @param   arena       The arena to allocate the buffer from (NULL for the heap).
  * ----------------------------------------------------------------------------------- **/
-void file_to_byte_array(const char* file_path, uint8_t** buffer, size_t* buffer_len);
+void file_to_byte_array(const char* file_path, uint8_t** buffer, size_t* buffer_len, arena* arena);
 
 /** ----------------------------------------------------------------------------------
  * @brief   Converts a uint32_t array from little-endian to big-endian.
  * @details This function converts the array in-place. The data will be overwritten.
+ *          It swaps 8 words per instruction on AVX2, see endian_bswap32_array().
  * @param   array       A pointer to the array to be converted.
  * @param   array_len   The length in uint32_t elements of the array.
  * ----------------------------------------------------------------------------------- **/
@@ -0,0 +1,198 @@
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HEX_HAVE_X86 1
+#endif
+
+#include "hex.h"
+#include "cpu_features.h"
+
+typedef struct {
+    // Decodes an even number of hex digits, returns 0 or -1 on an invalid character;
+    int (*decode)(const char* hex, size_t hex_len, uint8_t* bytes);
+    void (*encode)(const uint8_t* bytes, size_t len, char* hex);
+} hex_ops;
+
+static const char hex_digits[16] = "0123456789ABCDEF";
+
+static int hex_nibble(char hex_char) {
+    if (hex_char >= '0' && hex_char <= '9') {
+        return hex_char - '0';
+    } else if (hex_char >= 'a' && hex_char <= 'f') {
+        return 10 + (hex_char - 'a');
+    } else if (hex_char >= 'A' && hex_char <= 'F') {
+        return 10 + (hex_char - 'A');
+    }
+    return -1;
+}
+
+static int hex_decode_scalar(const char* hex, size_t hex_len, uint8_t* bytes) {
+    int high_nibble = 0, low_nibble = 0;
+    for (size_t i = 0; i < hex_len; i += 2) {
+        high_nibble = hex_nibble(hex[i]);
+        low_nibble = hex_nibble(hex[i + 1]);
+        if ((high_nibble | low_nibble) < 0) {
+            return -1;
+        }
+        bytes[i / 2] = (uint8_t)((high_nibble << 4) | low_nibble);
+    }
+    return 0;
+}
+
+static void hex_encode_scalar(const uint8_t* bytes, size_t len, char* hex) {
+    for (size_t i = 0; i < len; i++) {
+        hex[2 * i] = hex_digits[bytes[i] >> 4];
+        hex[2 * i + 1] = hex_digits[bytes[i] & 0x0F];
+    }
+}
+
+#ifdef HEX_HAVE_X86
+
+/*
+ * Every character is checked against '0'-'9' and, once folded to lower case, 'a'-'f'. The
+ * nibble is then (c & 0x0F) for digits and (c & 0x0F) + 9 for letters, and maddubs merges
+ * every pair of nibbles into hi * 16 + lo. Bytes above 0x7F compare as negative and fail
+ * both ranges;
+ */
+__attribute__((target("ssse3")))
+static int hex_decode_ssse3(const char* hex, size_t hex_len, uint8_t* bytes) {
+    const __m128i low_mask = _mm_set1_epi8(0x0F);
+    const __m128i merge = _mm_set1_epi16(0x0110);
+    size_t i = 0;
+    for (; i + 32 <= hex_len; i += 32) {
+        __m128i chars[2], nibbles[2];
+        for (size_t j = 0; j < 2; j++) {
+            chars[j] = _mm_loadu_si128((const __m128i*)(hex + i + 16 * j));
+            __m128i lower = _mm_or_si128(chars[j], _mm_set1_epi8(0x20));
+            __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(chars[j], _mm_set1_epi8('0' - 1)),
+                _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), chars[j]));
+            __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                _mm_cmpgt_epi8(_mm_set1_epi8('f' + 1), lower));
+            if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xFFFF) {
+                return -1;
+            }
+            nibbles[j] = _mm_add_epi8(_mm_and_si128(chars[j], low_mask), _mm_and_si128(alpha, _mm_set1_epi8(9)));
+            nibbles[j] = _mm_maddubs_epi16(nibbles[j], merge);
+        }
+        _mm_storeu_si128((__m128i*)(bytes + i / 2), _mm_packus_epi16(nibbles[0], nibbles[1]));
+    }
+    return hex_decode_scalar(hex + i, hex_len - i, bytes + i / 2);
+}
+
+__attribute__((target("avx2")))
+static int hex_decode_avx2(const char* hex, size_t hex_len, uint8_t* bytes) {
+    const __m256i low_mask = _mm256_set1_epi8(0x0F);
+    const __m256i merge = _mm256_set1_epi16(0x0110);
+    size_t i = 0;
+    for (; i + 32 <= hex_len; i += 32) {
+        __m256i chars = _mm256_loadu_si256((const __m256i*)(hex + i));
+        __m256i lower = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('0' - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chars));
+        __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lower));
+        if (_mm256_movemask_epi8(_mm256_or_si256(digit, alpha)) != -1) {
+            return -1;
+        }
+        __m256i nibbles = _mm256_add_epi8(_mm256_and_si256(chars, low_mask), _mm256_and_si256(alpha, _mm256_set1_epi8(9)));
+        __m256i pairs = _mm256_maddubs_epi16(nibbles, merge);
+        // packus works per 128 bit lane => gather the low halves of both lanes;
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(pairs, pairs), 0xD8);
+        _mm_storeu_si128((__m128i*)(bytes + i / 2), _mm256_castsi256_si128(packed));
+    }
+    return hex_decode_scalar(hex + i, hex_len - i, bytes + i / 2);
+}
+
+// Splits every byte into its nibbles, interleaves them high first and maps them through pshufb;
+__attribute__((target("ssse3")))
+static void hex_encode_ssse3(const uint8_t* bytes, size_t len, char* hex) {
+    const __m128i low_mask = _mm_set1_epi8(0x0F);
+    const __m128i digits = _mm_loadu_si128((const __m128i*)hex_digits);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i value = _mm_loadu_si128((const __m128i*)(bytes + i));
+        __m128i high = _mm_and_si128(_mm_srli_epi16(value, 4), low_mask);
+        __m128i low = _mm_and_si128(value, low_mask);
+        _mm_storeu_si128((__m128i*)(hex + 2 * i), _mm_shuffle_epi8(digits, _mm_unpacklo_epi8(high, low)));
+        _mm_storeu_si128((__m128i*)(hex + 2 * i + 16), _mm_shuffle_epi8(digits, _mm_unpackhi_epi8(high, low)));
+    }
+    hex_encode_scalar(bytes + i, len - i, hex + 2 * i);
+}
+
+__attribute__((target("avx2")))
+static void hex_encode_avx2(const uint8_t* bytes, size_t len, char* hex) {
+    const __m256i low_mask = _mm256_set1_epi8(0x0F);
+    const __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)hex_digits));
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i value = _mm256_loadu_si256((const __m256i*)(bytes + i));
+        __m256i high = _mm256_and_si256(_mm256_srli_epi16(value, 4), low_mask);
+        __m256i low = _mm256_and_si256(value, low_mask);
+        // The unpacks work per 128 bit lane => lane 0 holds bytes 0-7 and 8-15, lane 1 bytes 16-23 and 24-31;
+        __m256i first = _mm256_shuffle_epi8(digits, _mm256_unpacklo_epi8(high, low));
+        __m256i second = _mm256_shuffle_epi8(digits, _mm256_unpackhi_epi8(high, low));
+        _mm256_storeu_si256((__m256i*)(hex + 2 * i), _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256((__m256i*)(hex + 2 * i + 32), _mm256_permute2x128_si256(first, second, 0x31));
+    }
+    hex_encode_ssse3(bytes + i, len - i, hex + 2 * i);
+}
+
+#endif
+
+static const hex_ops hex_scalar_ops = { hex_decode_scalar, hex_encode_scalar };
+#ifdef HEX_HAVE_X86
+static const hex_ops hex_ssse3_ops = { hex_decode_ssse3, hex_encode_ssse3 };
+static const hex_ops hex_avx2_ops = { hex_decode_avx2, hex_encode_avx2 };
+#endif
+
+static const cpu_backend hex_backends[] = {
+#ifdef HEX_HAVE_X86
+    { "avx2", CPU_FEATURE_AVX2, &hex_avx2_ops },
+    { "ssse3", CPU_FEATURE_SSSE3, &hex_ssse3_ops },
+#endif
+    { "generic", 0, &hex_scalar_ops }
+};
+
+static cpu_dispatch hex_dispatch = { "hex", hex_backends, sizeof hex_backends / sizeof hex_backends[0], NULL };
+
+__attribute__((constructor))
+static void hex_register(void) {
+    cpu_dispatch_register(&hex_dispatch);
+}
+
+int hex_decode(const char* hex, size_t hex_len, uint8_t* bytes) {
+    const hex_ops* ops = cpu_dispatch_active(&hex_dispatch)->ops;
+    int nibble = 0;
+    // Prepend a 0 nibble if the length of the hex string is odd;
+    if (hex_len % 2 != 0) {
+        nibble = hex_nibble(*hex++);
+        if (nibble < 0) {
+            return -1;
+        }
+        *bytes++ = (uint8_t)nibble;
+        hex_len--;
+    }
+    return ops->decode(hex, hex_len, bytes);
+}
+
+size_t hex_encode(const uint8_t* bytes, size_t len, char* hex) {
+    const hex_ops* ops = cpu_dispatch_active(&hex_dispatch)->ops;
+    ops->encode(bytes, len, hex);
+    return 2 * len;
+}
+
+void hex_print(FILE* stream, const uint8_t* bytes, size_t len) {
+    char line[2 * HEX_PRINT_CHUNK + 1];
+    size_t chunk_len = 0;
+    size_t line_len = 0;
+    do {
+        chunk_len = (len < HEX_PRINT_CHUNK) ? len : HEX_PRINT_CHUNK;
+        line_len = hex_encode(bytes, chunk_len, line);
+        bytes += chunk_len;
+        len -= chunk_len;
+        // The newline goes out with the last chunk;
+        if (len == 0) {
+            line[line_len++] = '\n';
+        }
+        fwrite(line, 1, line_len, stream);
+    } while (len > 0);
+}
\ No newline at end of file
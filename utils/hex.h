@@ -0,0 +1,50 @@
+#ifndef HEX_H
+#define HEX_H
+
+/** ----------------------------------------------------------------------------------
+ * @brief   The functions defined in this file convert between bytes and hex strings.
+ * @details Both directions have AVX2 and SSSE3 kernels that handle 32 hex digits per
+ *          step and a table driven scalar fallback for the tail and for older CPUs. The
+ *          kernels are registered as the "hex" module of cpu_features. Decoding accepts upper and lower
+ *          case digits and rejects anything else, encoding writes upper case digits.
+ * @author  Murea Cosmin Alexandru
+ * @date    01.03.2024
+ * ----------------------------------------------------------------------------------- **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+// The number of bytes hex_print() encodes into its stack buffer before writing them out;
+#define HEX_PRINT_CHUNK 4096
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Decodes a hex string into a caller provided array of bytes.
+ * @details If the length of the hex string is odd, a 0 nibble is prepended.
+ * @param   hex         A pointer to the hex digits (no NUL terminator is needed).
+ * @param   hex_len     The number of hex digits to decode.
+ * @param   bytes       An array of (hex_len + 1) / 2 bytes to hold the result.
+ * @returns 0 on success, -1 if any character is not a hex digit.
+ * ----------------------------------------------------------------------------------- **/
+int hex_decode(const char* hex, size_t hex_len, uint8_t* bytes);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Encodes an array of bytes into a caller provided buffer of hex digits.
+ * @details No NUL terminator is written.
+ * @param   bytes       A pointer to the bytes to encode.
+ * @param   len         The number of bytes to encode.
+ * @param   hex         An array of 2 * len characters to hold the hex digits.
+ * @returns The number of characters written.
+ * ----------------------------------------------------------------------------------- **/
+size_t hex_encode(const uint8_t* bytes, size_t len, char* hex);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Writes an array of bytes in hex format followed by a newline.
+ * @details Lines of up to HEX_PRINT_CHUNK bytes are written with a single fwrite().
+ * @param   stream      The stream to write to.
+ * @param   bytes       A pointer to the bytes to print.
+ * @param   len         The number of bytes to print.
+ * ----------------------------------------------------------------------------------- **/
+void hex_print(FILE* stream, const uint8_t* bytes, size_t len);
+
+#endif
\ No newline at end of file
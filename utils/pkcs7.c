@@ -5,43 +5,48 @@
 
 #define PKCS7_BLOCK_SIZE 16
 
-void pkcs7_pad(const uint8_t* data, size_t data_len, uint8_t** padded, size_t* padded_len) {
+void pkcs7_pad(const uint8_t* data, size_t data_len, uint8_t** padded, size_t* padded_len, arena* arena) {
+    size_t full_len = data_len - (data_len % PKCS7_BLOCK_SIZE);
+    *padded_len = full_len + PKCS7_BLOCK_SIZE;
+    // Allocate memory for the padded data, copy the whole blocks and pad the rest;
+    *padded = arena_or_malloc(arena, *padded_len * sizeof **padded);
+    memcpy(*padded, data, full_len);
+    pkcs7_pad_block(data + full_len, data_len - full_len, *padded + full_len);
+}
+
+void pkcs7_pad_block(const uint8_t* tail, size_t tail_len, uint8_t* block) {
     // Compute the padding byte;
-    uint8_t padding_byte = PKCS7_BLOCK_SIZE - (data_len % PKCS7_BLOCK_SIZE);
-    *padded_len = data_len + padding_byte;
-    // Allocate memory for the padded data and copy the initial data;
-    *padded = safe_malloc(*padded_len * sizeof **padded);
-    memcpy(*padded, data, data_len);
-    // Apply padding;
-    for (uint8_t i = 0; i < padding_byte; i++) {
-        (*padded)[data_len + i] = padding_byte;
-    }
+    uint8_t padding_byte = PKCS7_BLOCK_SIZE - tail_len;
+    memcpy(block, tail, tail_len);
+    memset(block + tail_len, padding_byte, padding_byte);
 }
 
-static uint8_t pkcs7_is_valid(const uint8_t* padded, size_t padded_len) {
-    uint8_t padding_byte = padded[padded_len - 1];
-    size_t data_len = padded_len - padding_byte;
-    // Check if 1 < last byte <= PKCS7_BLOCK_SIZE;
-    if (padding_byte < 1 || padding_byte > PKCS7_BLOCK_SIZE) {
-        return 0;
+int pkcs7_unpadded_len(const uint8_t* padded, size_t padded_len, size_t* data_len) {
+    uint8_t padding_byte = 0;
+    if (padded_len == 0) {
+        return -1;
+    }
+    padding_byte = padded[padded_len - 1];
+    // Check if 1 <= last byte <= PKCS7_BLOCK_SIZE and that the padding fits in the data;
+    if (padding_byte < 1 || padding_byte > PKCS7_BLOCK_SIZE || padding_byte > padded_len) {
+        return -1;
     }
     // Check if all padding bytes match;
-    for (uint8_t i = 0; i < padding_byte; i++) {
-        if (padded[data_len + i] != padding_byte) {
-            return 0;
+    for (uint8_t i = 1; i <= padding_byte; i++) {
+        if (padded[padded_len - i] != padding_byte) {
+            return -1;
         }
     }
-    return 1;
+    *data_len = padded_len - padding_byte;
+    return 0;
 }
 
-void pkcs7_unpad(const uint8_t* padded, size_t padded_len, uint8_t** data, size_t* data_len) {
+void pkcs7_unpad(const uint8_t* padded, size_t padded_len, uint8_t** data, size_t* data_len, arena* arena) {
     // Check if the padding is valid PKCS7;
-    if (!pkcs7_is_valid(padded, padded_len)) {
+    if (pkcs7_unpadded_len(padded, padded_len, data_len) != 0) {
         return;
     }
-    uint8_t padding_byte = padded[padded_len - 1];
-    *data_len = padded_len - padding_byte;
     // Allocate memory for the unpadded data;
-    *data = safe_malloc(*data_len * sizeof **data);
+    *data = arena_or_malloc(arena, *data_len * sizeof **data);
     memcpy(*data, padded, *data_len);
 }
\ No newline at end of file
@@ -10,24 +10,47 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "arena.h"
+
 /** ---------------------------------------------------------------------------------------
  * @brief   Pads data using the PKCS7 padding scheme.
- * @details The caller is responsible for freeing the memory allocated for the padded data.
+ * @details The caller is responsible for freeing the memory allocated for the padded data
+ *          unless it comes from an arena.
  * @param   data        A pointer to the unpadded data.
  * @param   data_len    The length of the unpadded data.
  * @param   padded      A NULL pointer for storing the padded data.
  * @param   padded_len  The length of the returned padded data.
+ * @param   arena       The arena to allocate the padded data from (NULL for the heap).
+ * ---------------------------------------------------------------------------------------- **/
+void pkcs7_pad(const uint8_t* data, size_t data_len, uint8_t** padded, size_t* padded_len, arena* arena);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Pads the last, partial block of a message without copying the message.
+ * @param   tail        A pointer to the bytes after the last whole block.
+ * @param   tail_len    The number of bytes after the last whole block (less than a block).
+ * @param   block       The block that receives the tail followed by the padding.
+ * ---------------------------------------------------------------------------------------- **/
+void pkcs7_pad_block(const uint8_t* tail, size_t tail_len, uint8_t* block);
+
+/** ---------------------------------------------------------------------------------------
+ * @brief   Checks the padding of data in place.
+ * @param   padded      A pointer to the padded data.
+ * @param   padded_len  The length of the padded data.
+ * @param   data_len    The length of the data without its padding (if it is valid).
+ * @returns 0 if the padding is valid, -1 otherwise.
  * ---------------------------------------------------------------------------------------- **/
-void pkcs7_pad(const uint8_t* data, size_t data_len, uint8_t** padded, size_t* padded_len);
+int pkcs7_unpadded_len(const uint8_t* padded, size_t padded_len, size_t* data_len);
 
 /** ---------------------------------------------------------------------------------------
  * @brief   Unpads data using the PKCS7 unpadding scheme.
- * @details The caller is responsible for freeing the memory allocated for the unpadded data.
+ * @details The caller is responsible for freeing the memory allocated for the unpadded data
+ *          unless it comes from an arena. Nothing is stored if the padding is invalid.
  * @param   padded      A pointer to the padded data.
  * @param   padded_len  The length of the padded data.
  * @param   data        A NULL pointer for storing the unpadded data.
  * @param   data_len    The length of the unpadded data.
+ * @param   arena       The arena to allocate the unpadded data from (NULL for the heap).
  * ---------------------------------------------------------------------------------------- **/
-void pkcs7_unpad(const uint8_t* padded, size_t padded_len, uint8_t** data, size_t* data_len);
+void pkcs7_unpad(const uint8_t* padded, size_t padded_len, uint8_t** data, size_t* data_len, arena* arena);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,56 @@
+#include <string.h>
+
+#include "pool.h"
+#include "general.h"
+
+void pool_init(pool* pool, size_t object_size, size_t per_slab) {
+    memset(pool, 0, sizeof *pool);
+    // Free objects hold the link of the free list => never smaller than a pointer;
+    object_size = (object_size < sizeof(void*)) ? sizeof(void*) : object_size;
+    pool->object_size = (object_size + POOL_ALIGNMENT - 1) & ~(size_t)(POOL_ALIGNMENT - 1);
+    pool->per_slab = (per_slab > 0) ? per_slab : POOL_DEFAULT_PER_SLAB;
+}
+
+static void pool_grow(pool* pool) {
+    // The first POOL_ALIGNMENT bytes of a slab link it to the previous one;
+    uint8_t* slab = safe_aligned_malloc(POOL_ALIGNMENT, POOL_ALIGNMENT + pool->per_slab * pool->object_size);
+    uint8_t* object = NULL;
+    *(void**)slab = pool->slabs;
+    pool->slabs = slab;
+    pool->nr_slabs++;
+    for (size_t i = pool->per_slab; i > 0; i--) {
+        object = slab + POOL_ALIGNMENT + (i - 1) * pool->object_size;
+        *(void**)object = pool->free_list;
+        pool->free_list = object;
+    }
+}
+
+void* pool_get(pool* pool) {
+    void* object = NULL;
+    if (pool->free_list == NULL) {
+        pool_grow(pool);
+    }
+    object = pool->free_list;
+    pool->free_list = *(void**)object;
+    pool->nr_gets++;
+    pool->nr_in_use++;
+    return object;
+}
+
+void pool_put(pool* pool, void* object) {
+    *(void**)object = pool->free_list;
+    pool->free_list = object;
+    pool->nr_in_use--;
+}
+
+void pool_free(pool* pool) {
+    void* slab = pool->slabs;
+    while (slab != NULL) {
+        void* previous = *(void**)slab;
+        free(slab);
+        slab = previous;
+    }
+    pool->slabs = NULL;
+    pool->free_list = NULL;
+    pool->nr_in_use = 0;
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef POOL_H
+#define POOL_H
+
+/** ----------------------------------------------------------------------------------
+ * @brief   The functions defined in this file implement a pool of fixed-size objects.
+ * @details Objects are cut from slabs of POOL_DEFAULT_PER_SLAB objects and returned to a
+ *          free list, so getting and putting back an object never calls malloc() once the
+ *          pool has grown to the number of objects in use. Unlike an arena, objects can be
+ *          released one by one and in any order. A pool is not thread-safe.
+ * @author  Murea Cosmin Alexandru
+ * @date    01.03.2024
+ * ----------------------------------------------------------------------------------- **/
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define POOL_ALIGNMENT 32
+#define POOL_DEFAULT_PER_SLAB 64
+
+typedef struct {
+    size_t object_size;
+    size_t per_slab;
+    // The objects put back or never handed out, linked through their first bytes;
+    void* free_list;
+    // Every slab starts with a pointer to the previous one;
+    void* slabs;
+    // The counters, nr_in_use goes down when objects are put back;
+    size_t nr_gets;
+    size_t nr_slabs;
+    size_t nr_in_use;
+} pool;
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Initialises an empty pool, no memory is allocated until it is first used.
+ * @param   pool        A pointer to the pool to initialise.
+ * @param   object_size The size of every object in bytes.
+ * @param   per_slab    The number of objects per slab (0 for POOL_DEFAULT_PER_SLAB).
+ * ----------------------------------------------------------------------------------- **/
+void pool_init(pool* pool, size_t object_size, size_t per_slab);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Takes an object from the pool.
+ * @param   pool        A pointer to the pool.
+ * @returns A pointer to POOL_ALIGNMENT aligned memory of the pool's object size.
+ * ----------------------------------------------------------------------------------- **/
+void* pool_get(pool* pool);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Gives an object back to the pool it was taken from.
+ * @param   pool        A pointer to the pool.
+ * @param   object      A pointer returned by pool_get() on the same pool.
+ * ----------------------------------------------------------------------------------- **/
+void pool_put(pool* pool, void* object);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Frees every slab of a pool, including the objects still in use.
+ * @param   pool        A pointer to the pool.
+ * ----------------------------------------------------------------------------------- **/
+void pool_free(pool* pool);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rsp.h"
+#include "hex.h"
+#include "general.h"
+
+// The number of fields and decoded bytes a reader makes room for up front;
+#define RSP_INITIAL_FIELDS 8
+#define RSP_INITIAL_ARENA 256
+
+static int rsp_is_space(char c) {
+    return (c == ' ') || (c == '\t') || (c == '\r');
+}
+
+static rsp_slice rsp_trim(const char* data, size_t len) {
+    rsp_slice slice = { data, len };
+    while ((slice.len > 0) && rsp_is_space(slice.data[0])) {
+        slice.data++;
+        slice.len--;
+    }
+    while ((slice.len > 0) && rsp_is_space(slice.data[slice.len - 1])) {
+        slice.len--;
+    }
+    return slice;
+}
+
+void rsp_open(rsp_reader* reader, const char* file_path) {
+    struct stat file_info;
+    void* data = NULL;
+    int fd = open(file_path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "Could not open the file. Proceeding to crash. Cleaning up...");
+        exit(EXIT_FAILURE);
+    }
+    if (fstat(fd, &file_info) < 0) {
+        fprintf(stderr, "Could not obtain file details. Proceeding to crash. Cleaning up...");
+        exit(EXIT_FAILURE);
+    }
+    memset(reader, 0, sizeof *reader);
+    reader->data_len = (size_t)file_info.st_size;
+    // An empty file cannot be mapped, it simply has no records;
+    if (reader->data_len > 0) {
+        data = mmap(NULL, reader->data_len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            fprintf(stderr, "Could not map the file. Proceeding to crash. Cleaning up...");
+            exit(EXIT_FAILURE);
+        }
+        madvise(data, reader->data_len, MADV_SEQUENTIAL);
+        reader->data = data;
+    }
+    close(fd);
+    reader->fields_cap = RSP_INITIAL_FIELDS;
+    reader->fields = safe_malloc(reader->fields_cap * sizeof *reader->fields);
+    reader->arena_cap = RSP_INITIAL_ARENA;
+    reader->arena = safe_malloc(reader->arena_cap);
+}
+
+void rsp_close(rsp_reader* reader) {
+    if (reader->data != NULL) {
+        munmap((void*)reader->data, reader->data_len);
+    }
+    free(reader->fields);
+    free(reader->arena);
+    memset(reader, 0, sizeof *reader);
+}
+
+static void rsp_add_field(rsp_reader* reader, rsp_slice text) {
+    const char* equals = memchr(text.data, '=', text.len);
+    rsp_field* field = NULL;
+    if (reader->nr_fields == reader->fields_cap) {
+        reader->fields_cap *= 2;
+        reader->fields = realloc(reader->fields, reader->fields_cap * sizeof *reader->fields);
+        if (reader->fields == NULL) {
+            fprintf(stderr, "Could not allocate memory. Proceeding to crash. Cleaning up...");
+            exit(EXIT_FAILURE);
+        }
+    }
+    field = &reader->fields[reader->nr_fields++];
+    // A line without '=' is a key with an empty value;
+    if (equals == NULL) {
+        field->key = text;
+        field->value = (rsp_slice){ text.data + text.len, 0 };
+    } else {
+        field->key = rsp_trim(text.data, (size_t)(equals - text.data));
+        field->value = rsp_trim(equals + 1, text.len - (size_t)(equals - text.data) - 1);
+    }
+}
+
+// Gives every field of the record its own room in the arena, so decoded values never move;
+static void rsp_reserve_arena(rsp_reader* reader) {
+    size_t arena_len = 0;
+    for (size_t i = 0; i < reader->nr_fields; i++) {
+        reader->fields[i].arena_offset = arena_len;
+        arena_len += (reader->fields[i].value.len + 1) / 2;
+    }
+    if (arena_len > reader->arena_cap) {
+        free(reader->arena);
+        reader->arena = safe_malloc(arena_len);
+        reader->arena_cap = arena_len;
+    }
+}
+
+int rsp_next(rsp_reader* reader) {
+    const char* line = NULL;
+    const char* line_end = NULL;
+    size_t line_len = 0;
+    rsp_slice text;
+    reader->nr_fields = 0;
+    while (reader->offset < reader->data_len) {
+        line = reader->data + reader->offset;
+        line_end = memchr(line, '\n', reader->data_len - reader->offset);
+        line_len = (line_end == NULL) ? reader->data_len - reader->offset : (size_t)(line_end - line);
+        text = rsp_trim(line, line_len);
+        // A section starts a new record => leave the line for the next call;
+        if ((text.len > 0) && (text.data[0] == '[') && (reader->nr_fields > 0)) {
+            break;
+        }
+        reader->offset += line_len + (line_end != NULL);
+        reader->line++;
+        if (text.len == 0) {
+            if (reader->nr_fields > 0) {
+                break;
+            }
+        } else if (text.data[0] == '#') {
+            continue;
+        } else if (text.data[0] == '[') {
+            text = rsp_trim(text.data + 1, text.len - 1);
+            if ((text.len > 0) && (text.data[text.len - 1] == ']')) {
+                text.len--;
+            }
+            reader->section = rsp_trim(text.data, text.len);
+        } else {
+            if (reader->nr_fields == 0) {
+                reader->record_line = reader->line;
+            }
+            rsp_add_field(reader, text);
+        }
+    }
+    if (reader->nr_fields == 0) {
+        return 0;
+    }
+    rsp_reserve_arena(reader);
+    return 1;
+}
+
+const rsp_field* rsp_find(const rsp_reader* reader, const char* key) {
+    size_t key_len = strlen(key);
+    for (size_t i = 0; i < reader->nr_fields; i++) {
+        if ((reader->fields[i].key.len == key_len) && (memcmp(reader->fields[i].key.data, key, key_len) == 0)) {
+            return &reader->fields[i];
+        }
+    }
+    return NULL;
+}
+
+const uint8_t* rsp_hex(rsp_reader* reader, const char* key, size_t* len) {
+    const rsp_field* field = rsp_find(reader, key);
+    uint8_t* bytes = NULL;
+    if (field == NULL) {
+        return NULL;
+    }
+    bytes = reader->arena + field->arena_offset;
+    if (hex_decode(field->value.data, field->value.len, bytes) != 0) {
+        return NULL;
+    }
+    if (len != NULL) {
+        *len = (field->value.len + 1) / 2;
+    }
+    return bytes;
+}
+
+int rsp_size(const rsp_reader* reader, const char* key, size_t* value) {
+    const rsp_field* field = rsp_find(reader, key);
+    size_t result = 0;
+    size_t digit = 0;
+    if ((field == NULL) || (field->value.len == 0)) {
+        return -1;
+    }
+    for (size_t i = 0; i < field->value.len; i++) {
+        if ((field->value.data[i] < '0') || (field->value.data[i] > '9')) {
+            return -1;
+        }
+        digit = (size_t)(field->value.data[i] - '0');
+        if (result > (SIZE_MAX - digit) / 10) {
+            return -1;
+        }
+        result = result * 10 + digit;
+    }
+    *value = result;
+    return 0;
+}
\ No newline at end of file
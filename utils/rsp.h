@@ -0,0 +1,100 @@
+#ifndef RSP_H
+#define RSP_H
+
+/** ----------------------------------------------------------------------------------
+ * @brief   The functions defined in this file read NIST CAVP/ACVP response (.rsp) files.
+ * @details The file is mapped into memory and walked one record at a time, a record being
+ *          a run of "KEY = value" lines ended by a blank line, a [section] line or the end
+ *          of the file. Keys and values are slices of the mapping, so nothing is copied and
+ *          lines can be of any length. Hex values are decoded into an arena owned by the
+ *          reader, which is reused by every record and only grows to fit the largest one.
+ * @author  Murea Cosmin Alexandru
+ * @date    01.03.2024
+ * ----------------------------------------------------------------------------------- **/
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// A run of characters inside the mapped file, not NUL-terminated;
+typedef struct {
+    const char* data;
+    size_t len;
+} rsp_slice;
+
+typedef struct {
+    rsp_slice key;
+    rsp_slice value;
+    // Where the value is decoded to inside the arena;
+    size_t arena_offset;
+} rsp_field;
+
+typedef struct {
+    const char* data;
+    size_t data_len;
+    // The offset of the first line not read yet;
+    size_t offset;
+    size_t line;
+    // The contents of the last [section] line, without the brackets;
+    rsp_slice section;
+    // The fields of the current record, in file order;
+    rsp_field* fields;
+    size_t nr_fields;
+    size_t fields_cap;
+    // The line on which the current record starts;
+    size_t record_line;
+    // Holds the hex values decoded from the current record, every field has its own room;
+    uint8_t* arena;
+    size_t arena_cap;
+} rsp_reader;
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Maps a response file into memory and prepares to read its records.
+ * @param   reader      A pointer to the reader to initialise.
+ * @param   file_path   The path of the file to read.
+ * ----------------------------------------------------------------------------------- **/
+void rsp_open(rsp_reader* reader, const char* file_path);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Unmaps the file and frees the memory held by a reader.
+ * @details Every slice and decoded value handed out by the reader becomes invalid.
+ * @param   reader      A pointer to the reader.
+ * ----------------------------------------------------------------------------------- **/
+void rsp_close(rsp_reader* reader);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Advances to the next record of the file.
+ * @details Comment lines (#) are skipped and [section] lines update reader->section. The
+ *          values decoded from the previous record are released.
+ * @param   reader      A pointer to the reader.
+ * @returns 1 if a record was read, 0 at the end of the file.
+ * ----------------------------------------------------------------------------------- **/
+int rsp_next(rsp_reader* reader);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Looks up a field of the current record.
+ * @param   reader      A pointer to the reader.
+ * @param   key         The NUL-terminated key of the field.
+ * @returns A pointer to the field, or NULL if the record does not have it.
+ * ----------------------------------------------------------------------------------- **/
+const rsp_field* rsp_find(const rsp_reader* reader, const char* key);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Decodes a hex field of the current record into the arena.
+ * @details The bytes stay valid until the next call to rsp_next().
+ * @param   reader      A pointer to the reader.
+ * @param   key         The NUL-terminated key of the field.
+ * @param   len         A pointer to hold the number of decoded bytes (can be NULL).
+ * @returns A pointer to the bytes, or NULL if the field is missing or not valid hex.
+ * ----------------------------------------------------------------------------------- **/
+const uint8_t* rsp_hex(rsp_reader* reader, const char* key, size_t* len);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Parses a decimal field of the current record.
+ * @param   reader      A pointer to the reader.
+ * @param   key         The NUL-terminated key of the field.
+ * @param   value       A pointer to hold the value.
+ * @returns 0 on success, -1 if the field is missing or not a decimal number.
+ * ----------------------------------------------------------------------------------- **/
+int rsp_size(const rsp_reader* reader, const char* key, size_t* value);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+// For opening /dev/urandom when getrandom() is not available;
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#if defined(__linux__)
+#include <sys/random.h>
+#define SEED_HAVE_GETRANDOM 1
+#endif
+
+#include "seed.h"
+#include "general.h"
+#include "endian.h"
+#include "../sha256/sha256.h"
+
+static uint8_t seed_pool[SEED_POOL_SIZE];
+// The offset of the first unused byte (SEED_POOL_SIZE means the pool must be refilled);
+static size_t seed_offset = SEED_POOL_SIZE;
+static uint64_t seed_counter = 0;
+static pthread_mutex_t seed_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t seed_once = PTHREAD_ONCE_INIT;
+
+static void seed_fork_prepare(void) {
+    pthread_mutex_lock(&seed_mutex);
+}
+
+static void seed_fork_parent(void) {
+    pthread_mutex_unlock(&seed_mutex);
+}
+
+static void seed_fork_child(void) {
+    // The child must never hand out the same bytes as its parent;
+    memset(seed_pool, 0, SEED_POOL_SIZE);
+    seed_offset = SEED_POOL_SIZE;
+    pthread_mutex_unlock(&seed_mutex);
+}
+
+static void seed_register_fork(void) {
+    pthread_atfork(seed_fork_prepare, seed_fork_parent, seed_fork_child);
+}
+
+static void seed_urandom(uint8_t* buffer, size_t buffer_len) {
+    size_t total = 0;
+    ssize_t bytes_read = 0;
+    int32_t urandom_fd = open("/dev/urandom", O_RDONLY);
+    if (urandom_fd == -1) {
+        fprintf(stderr, "Could not open /dev/urandom. Proceeding to crash. Cleaning up...");
+        exit(EXIT_FAILURE);
+    }
+    while (total < buffer_len) {
+        bytes_read = read(urandom_fd, buffer + total, buffer_len - total);
+        if (bytes_read <= 0) {
+            if ((bytes_read < 0) && (errno == EINTR)) {
+                continue;
+            }
+            fprintf(stderr, "Could not read from /dev/urandom. Proceeding to crash. Cleaning up...");
+            exit(EXIT_FAILURE);
+        }
+        total += (size_t)bytes_read;
+    }
+    close(urandom_fd);
+}
+
+static void seed_refill(void) {
+    size_t total = 0;
+#ifdef SEED_HAVE_GETRANDOM
+    ssize_t bytes_read = 0;
+    // Requests of up to 256 bytes never return short, larger ones can be interrupted;
+    while (total < SEED_POOL_SIZE) {
+        bytes_read = getrandom(seed_pool + total, SEED_POOL_SIZE - total, 0);
+        if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Old kernels without the system call fall back to /dev/urandom;
+            break;
+        }
+        total += (size_t)bytes_read;
+    }
+#endif
+    if (total < SEED_POOL_SIZE) {
+        seed_urandom(seed_pool + total, SEED_POOL_SIZE - total);
+    }
+    seed_offset = 0;
+}
+
+void seed_bytes(const char* domain, uint8_t* seed, size_t seed_len) {
+    size_t domain_len = strlen(domain);
+    uint8_t slice[SEED_SLICE_LEN];
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    uint64_t counter = 0;
+    // The counter is hashed big-endian, like the one of the DRBG, so every host derives seeds alike;
+    uint8_t counter_bytes[sizeof counter];
+    size_t chunk_len = 0;
+    sha256_ctx domain_ctx, ctx;
+    pthread_once(&seed_once, seed_register_fork);
+    // The input is domain || 0x00 || counter || slice => hash the domain once and reuse the midstate;
+    sha256_init(&domain_ctx);
+    sha256_update(&domain_ctx, (const uint8_t*)domain, domain_len + 1);
+    for (size_t i = 0; i < seed_len; i += chunk_len) {
+        chunk_len = (seed_len - i < SHA256_DIGEST_SIZE) ? seed_len - i : SHA256_DIGEST_SIZE;
+        pthread_mutex_lock(&seed_mutex);
+        if (seed_offset + SEED_SLICE_LEN > SEED_POOL_SIZE) {
+            seed_refill();
+        }
+        counter = seed_counter++;
+        memcpy(slice, seed_pool + seed_offset, SEED_SLICE_LEN);
+        // Wipe the slice so it can never be handed out or recovered again;
+        memset(seed_pool + seed_offset, 0, SEED_SLICE_LEN);
+        seed_offset += SEED_SLICE_LEN;
+        pthread_mutex_unlock(&seed_mutex);
+        ctx = domain_ctx;
+        endian_store_be64(counter_bytes, counter);
+        sha256_update(&ctx, counter_bytes, sizeof counter_bytes);
+        sha256_update(&ctx, slice, SEED_SLICE_LEN);
+        sha256_final(&ctx, digest);
+        memcpy(seed + i, digest, chunk_len);
+    }
+    secure_zero(slice, SEED_SLICE_LEN);
+    secure_zero(digest, SHA256_DIGEST_SIZE);
+    secure_zero(&ctx, sizeof ctx);
+}
\ No newline at end of file
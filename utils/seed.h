@@ -0,0 +1,30 @@
+#ifndef SEED_H
+#define SEED_H
+
+/** ----------------------------------------------------------------------------------
+ * @brief   The functions defined in this file hand out seeds from a shared entropy pool.
+ * @details The pool is filled from getrandom() (or /dev/urandom where it is missing) with
+ *          one system call per SEED_POOL_SIZE bytes. Every seed is the SHA2-256 hash of a
+ *          domain label, a counter and an unused slice of the pool, which is then wiped.
+ *          The pool is thread-safe and discarded in the child after fork().
+ * @author  Murea Cosmin Alexandru
+ * @date    01.03.2024
+ * ----------------------------------------------------------------------------------- **/
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define SEED_POOL_SIZE 4096
+// The number of pool bytes consumed for every 32 bytes of seed;
+#define SEED_SLICE_LEN 32
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Derives a seed for the given domain from the entropy pool.
+ * @details Different domains never share pool bytes, so their seeds are independent.
+ * @param   domain      A NUL-terminated label naming the consumer of the seed.
+ * @param   seed        An array to hold the seed.
+ * @param   seed_len    The length of the seed in bytes.
+ * ----------------------------------------------------------------------------------- **/
+void seed_bytes(const char* domain, uint8_t* seed, size_t seed_len);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define STATS_HAVE_TSC 1
+#endif
+
+#include "stats.h"
+#include "general.h"
+
+static const char* const stats_primitive_names[STATS_NR_PRIMITIVES] = {
+    "aes", "sha256", "chaos", "rsa"
+};
+
+static const char* const stats_counter_names[STATS_NR_COUNTERS] = {
+    "calls", "bytes_in", "bytes_out", "blocks", "key_schedules", "allocations", "ns"
+};
+
+#ifdef NIGHTHAWK_STATS
+
+// The counters of one thread, written by that thread only;
+typedef struct stats_block {
+    uint64_t counters[STATS_NR_PRIMITIVES][STATS_NR_COUNTERS];
+    // The xorshift state that picks the sampled calls;
+    uint64_t sample_state;
+    // Cleared when the thread exits, so the next new thread takes the block over;
+    int in_use;
+    struct stats_block* next;
+} __attribute__((aligned(64))) stats_block;
+
+static stats_block* stats_blocks = NULL;
+// Initial-exec keeps the lookup a single load in the -fPIC builds instead of a __tls_get_addr() call;
+static __thread stats_block* stats_self __attribute__((tls_model("initial-exec"))) = NULL;
+static pthread_key_t stats_key;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+// The clock and the time stamp counter read at the first count, to convert ticks into ns;
+static uint64_t stats_origin_ns = 0;
+static uint64_t stats_origin_ticks = 0;
+
+static uint64_t stats_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// The time stamp counter costs a few cycles where clock_gettime() costs tens of ns;
+static inline uint64_t stats_ticks(void) {
+#ifdef STATS_HAVE_TSC
+    return __rdtsc();
+#else
+    return stats_now_ns();
+#endif
+}
+
+static void stats_release(void* block) {
+    stats_self = NULL;
+    __atomic_store_n(&((stats_block*)block)->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void stats_setup(void) {
+    if (pthread_key_create(&stats_key, stats_release) != 0) {
+        fprintf(stderr, "Could not create the statistics key. Proceeding to crash. Cleaning up...");
+        exit(EXIT_FAILURE);
+    }
+    stats_origin_ns = stats_now_ns();
+    stats_origin_ticks = stats_ticks();
+}
+
+// Takes the block of an exited thread over or pushes a new one, without locking;
+static stats_block* stats_claim(void) {
+    stats_block* block = NULL;
+    int free_block = 0;
+    pthread_once(&stats_once, stats_setup);
+    for (block = __atomic_load_n(&stats_blocks, __ATOMIC_ACQUIRE); block != NULL; block = block->next) {
+        free_block = 0;
+        if (__atomic_compare_exchange_n(&block->in_use, &free_block, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    if (block == NULL) {
+        // Not safe_malloc(), the block is bookkeeping and not an allocation of the primitives;
+        if (posix_memalign((void**)&block, 64, sizeof *block) != 0) {
+            fprintf(stderr, "Could not allocate memory. Proceeding to crash. Cleaning up...");
+            exit(EXIT_FAILURE);
+        }
+        memset(block, 0, sizeof *block);
+        block->sample_state = (uint64_t)(uintptr_t)block | 1;
+        block->in_use = 1;
+        block->next = __atomic_load_n(&stats_blocks, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&stats_blocks, &block->next, block, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+    }
+    pthread_setspecific(stats_key, block);
+    stats_self = block;
+    return block;
+}
+
+static inline stats_block* stats_local(void) {
+    return (stats_self != NULL) ? stats_self : stats_claim();
+}
+
+// Only the owning thread writes, a relaxed load and store is enough for readers to see whole values;
+static inline void stats_bump(uint64_t* counter, uint64_t value) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+// Random rather than every n-th call, which would alias with callers that alternate (update, final, ...);
+static inline int stats_sampled(stats_block* block) {
+    uint64_t x = block->sample_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    block->sample_state = x;
+    return (x & (STATS_SAMPLE_RATE - 1)) == 0;
+}
+
+void stats_begin(stats_scope* scope, uint64_t bytes) {
+    stats_block* block = stats_local();
+    scope->start_allocations = safe_malloc_count();
+    scope->start_ticks = 0;
+    scope->weight = 1;
+    if (bytes < STATS_EXACT_BYTES) {
+        if (!stats_sampled(block)) {
+            return;
+        }
+        scope->weight = STATS_SAMPLE_RATE;
+    }
+    scope->start_ticks = stats_ticks();
+}
+
+void stats_end(const stats_scope* scope, stats_primitive primitive, uint64_t bytes_in, uint64_t bytes_out, uint64_t blocks) {
+    uint64_t ticks = (scope->start_ticks != 0) ? (stats_ticks() - scope->start_ticks) * scope->weight : 0;
+    stats_block* block = stats_local();
+    uint64_t* counters = block->counters[primitive];
+    stats_bump(&counters[STATS_CALLS], 1);
+    stats_bump(&counters[STATS_BYTES_IN], bytes_in);
+    stats_bump(&counters[STATS_BYTES_OUT], bytes_out);
+    stats_bump(&counters[STATS_BLOCKS], blocks);
+    stats_bump(&counters[STATS_ALLOCATIONS], safe_malloc_count() - scope->start_allocations);
+    stats_bump(&counters[STATS_NS], ticks);
+}
+
+void stats_add(stats_primitive primitive, stats_counter counter, uint64_t value) {
+    stats_bump(&stats_local()->counters[primitive][counter], value);
+}
+
+int stats_enabled(void) {
+    return 1;
+}
+
+void stats_snapshot(stats_totals* totals) {
+    double ns_per_tick = 1.0;
+    uint64_t elapsed_ticks = 0;
+    memset(totals, 0, sizeof *totals);
+    pthread_once(&stats_once, stats_setup);
+    for (stats_block* block = __atomic_load_n(&stats_blocks, __ATOMIC_ACQUIRE); block != NULL; block = block->next) {
+        for (size_t i = 0; i < STATS_NR_PRIMITIVES; i++) {
+            for (size_t j = 0; j < STATS_NR_COUNTERS; j++) {
+                totals->counters[i][j] += __atomic_load_n(&block->counters[i][j], __ATOMIC_RELAXED);
+            }
+        }
+        totals->nr_threads++;
+    }
+#ifdef STATS_HAVE_TSC
+    // The rate of the counter is measured over the whole run, so it gets more precise with time;
+    elapsed_ticks = stats_ticks() - stats_origin_ticks;
+    if (elapsed_ticks > 0) {
+        ns_per_tick = (double)(stats_now_ns() - stats_origin_ns) / (double)elapsed_ticks;
+    }
+#endif
+    for (size_t i = 0; i < STATS_NR_PRIMITIVES; i++) {
+        totals->counters[i][STATS_NS] = (uint64_t)((double)totals->counters[i][STATS_NS] * ns_per_tick);
+    }
+}
+
+#else
+
+int stats_enabled(void) {
+    return 0;
+}
+
+void stats_snapshot(stats_totals* totals) {
+    memset(totals, 0, sizeof *totals);
+}
+
+#endif
+
+const char* stats_primitive_name(stats_primitive primitive) {
+    return (primitive < STATS_NR_PRIMITIVES) ? stats_primitive_names[primitive] : "unknown";
+}
+
+const char* stats_counter_name(stats_counter counter) {
+    return (counter < STATS_NR_COUNTERS) ? stats_counter_names[counter] : "unknown";
+}
+
+void stats_print(FILE* stream, const stats_totals* totals) {
+    fprintf(stream, "%-8s", "");
+    for (size_t j = 0; j < STATS_NR_COUNTERS; j++) {
+        fprintf(stream, " %14s", stats_counter_names[j]);
+    }
+    fprintf(stream, "\n");
+    for (size_t i = 0; i < STATS_NR_PRIMITIVES; i++) {
+        if ((totals->counters[i][STATS_CALLS] == 0) && (totals->counters[i][STATS_KEY_SCHEDULES] == 0)) {
+            continue;
+        }
+        fprintf(stream, "%-8s", stats_primitive_names[i]);
+        for (size_t j = 0; j < STATS_NR_COUNTERS; j++) {
+            fprintf(stream, " %14llu", (unsigned long long)totals->counters[i][j]);
+        }
+        fprintf(stream, "\n");
+    }
+}
\ No newline at end of file
@@ -0,0 +1,131 @@
+#ifndef STATS_H
+#define STATS_H
+
+/** ----------------------------------------------------------------------------------
+ * @brief   The functions defined in this file count the work done by the primitives.
+ * @details The counters only exist when the library is built with -DNIGHTHAWK_STATS
+ *          (make STATS=1), otherwise the macros below expand to nothing and cost nothing.
+ *          Every thread counts into a block of its own with plain relaxed stores, so the
+ *          hot paths take no lock and share no cache line. stats_snapshot() adds the blocks
+ *          up on read, the blocks of threads that exited are kept and reused.
+ *          Reading the clock costs about as much as hashing a few bytes, so calls smaller
+ *          than STATS_EXACT_BYTES are timed at random, one in STATS_SAMPLE_RATE, and their
+ *          time is scaled up. The other counters are always exact.
+ *
+ *          Built with -DNIGHTHAWK_USDT (make USDT=1) the main functions also carry USDT
+ *          probes in the nighthawk provider, e.g. perf probe sdt_nighthawk:aes_cbc_encrypt.
+ * @author  Murea Cosmin Alexandru
+ * @date    01.03.2024
+ * ----------------------------------------------------------------------------------- **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+typedef enum {
+    STATS_AES,
+    STATS_SHA256,
+    // The chaotic maps and the Lorenz system;
+    STATS_CHAOS,
+    STATS_RSA,
+    STATS_NR_PRIMITIVES
+} stats_primitive;
+
+typedef enum {
+    STATS_CALLS,
+    STATS_BYTES_IN,
+    STATS_BYTES_OUT,
+    // Cipher or compression blocks, sweep points, integration steps or RSA operations;
+    STATS_BLOCKS,
+    STATS_KEY_SCHEDULES,
+    // The safe_malloc() calls made while the entry points ran, read from safe_malloc_count() => pool workers
+    // count for the call they work on, as do other threads allocating meanwhile (nested primitives count in both);
+    STATS_ALLOCATIONS,
+    STATS_NS,
+    STATS_NR_COUNTERS
+} stats_counter;
+
+// Calls of at least this many bytes are always timed, pass it for calls that are slow anyway;
+#define STATS_EXACT_BYTES 1024
+#define STATS_SAMPLE_RATE 16
+
+typedef struct {
+    uint64_t counters[STATS_NR_PRIMITIVES][STATS_NR_COUNTERS];
+    // The number of per-thread blocks added up;
+    size_t nr_threads;
+} stats_totals;
+
+#ifdef NIGHTHAWK_STATS
+
+// The state of one counted call of an entry point;
+typedef struct {
+    // 0 when the call is not timed;
+    uint64_t start_ticks;
+    uint64_t weight;
+    uint64_t start_allocations;
+} stats_scope;
+
+// Called through the macros below, so the call sites disappear when the counters are compiled out;
+void stats_begin(stats_scope* scope, uint64_t bytes);
+void stats_end(const stats_scope* scope, stats_primitive primitive, uint64_t bytes_in, uint64_t bytes_out, uint64_t blocks);
+void stats_add(stats_primitive primitive, stats_counter counter, uint64_t value);
+
+#define STATS_BEGIN(scope, bytes) stats_scope scope; stats_begin(&scope, bytes)
+#define STATS_END(scope, primitive, bytes_in, bytes_out, blocks) stats_end(&scope, primitive, bytes_in, bytes_out, blocks)
+#define STATS_ADD(primitive, counter, value) stats_add(primitive, counter, value)
+
+#else
+
+#define STATS_BEGIN(scope, bytes) ((void)0)
+#define STATS_END(scope, primitive, bytes_in, bytes_out, blocks) ((void)0)
+#define STATS_ADD(primitive, counter, value) ((void)0)
+
+#endif
+
+#if defined(NIGHTHAWK_USDT) && !__has_include(<sys/sdt.h>)
+#error "NIGHTHAWK_USDT needs <sys/sdt.h> (systemtap-sdt-dev or systemtap-sdt-devel)"
+#elif defined(NIGHTHAWK_USDT)
+#include <sys/sdt.h>
+#define STATS_PROBE1(name, a) DTRACE_PROBE1(nighthawk, name, a)
+#define STATS_PROBE2(name, a, b) DTRACE_PROBE2(nighthawk, name, a, b)
+#else
+#define STATS_PROBE1(name, a) ((void)0)
+#define STATS_PROBE2(name, a, b) ((void)0)
+#endif
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Tells whether the library was built with the counters.
+ * @returns 1 if it was, 0 otherwise.
+ * ----------------------------------------------------------------------------------- **/
+int stats_enabled(void);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Adds up the counters of every thread.
+ * @details The counters only grow, subtract two snapshots to measure a section of the
+ *          program. Counts made while the snapshot is taken may or may not be included.
+ * @param   totals      The totals to fill (all zero if the counters are compiled out).
+ * ----------------------------------------------------------------------------------- **/
+void stats_snapshot(stats_totals* totals);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Names a primitive, e.g. for reports.
+ * @param   primitive   One of the STATS_* primitives.
+ * @returns A lower case name, e.g. "sha256", or "unknown".
+ * ----------------------------------------------------------------------------------- **/
+const char* stats_primitive_name(stats_primitive primitive);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Names a counter, e.g. for reports.
+ * @param   counter     One of the STATS_* counters.
+ * @returns A lower case name, e.g. "bytes_in", or "unknown".
+ * ----------------------------------------------------------------------------------- **/
+const char* stats_counter_name(stats_counter counter);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Writes the totals as a table, one line per primitive that was called.
+ * @param   stream      The stream to write to.
+ * @param   totals      A pointer to the totals to write.
+ * ----------------------------------------------------------------------------------- **/
+void stats_print(FILE* stream, const stats_totals* totals);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,371 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "threadpool.h"
+#include "general.h"
+
+// The NUMA nodes looked up under /sys, their numbers may have gaps;
+#define THREADPOOL_MAX_NODES 64
+
+typedef struct {
+    // The ranges of the loop not yet run to the end, the caller waits for it to reach 0;
+    size_t pending;
+} threadpool_group;
+
+typedef struct {
+    parallel_fn fn;
+    void* context;
+    size_t start;
+    size_t end;
+    size_t grain;
+    threadpool_group* group;
+} threadpool_task;
+
+// The owner pushes and pops at the bottom, thieves take the oldest (largest) range from the top;
+typedef struct {
+    pthread_mutex_t mutex;
+    size_t top;
+    size_t bottom;
+    threadpool_task tasks[THREADPOOL_DEQUE_SIZE];
+} __attribute__((aligned(THREADPOOL_CACHE_LINE))) threadpool_deque;
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    // 0 until the size is read from the environment or set by threadpool_configure();
+    size_t nr_threads;
+    threadpool_affinity affinity;
+    int configured;
+    int started;
+    // Bumped by every push, a thread only goes to sleep if it did not change while it searched;
+    uint64_t epoch;
+    size_t nr_sleeping;
+    // deques[0] is shared by the threads outside the pool, deques[i] belongs to worker i;
+    threadpool_deque* deques;
+    size_t nr_deques;
+} threadpool = { .mutex = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER };
+
+static __thread size_t threadpool_self __attribute__((tls_model("initial-exec"))) = 0;
+
+static size_t threadpool_default_size(void) {
+    const char* value = getenv(THREADPOOL_THREADS_ENV);
+    long nr_threads = (value != NULL) ? strtol(value, NULL, 10) : 0;
+    if (nr_threads < 1) {
+        nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (nr_threads < 1) {
+        return 1;
+    }
+    return ((size_t)nr_threads > THREADPOOL_MAX_THREADS) ? THREADPOOL_MAX_THREADS : (size_t)nr_threads;
+}
+
+static threadpool_affinity threadpool_default_affinity(void) {
+    const char* value = getenv(THREADPOOL_AFFINITY_ENV);
+    if ((value == NULL) || (strcmp(value, "none") == 0)) {
+        return THREADPOOL_AFFINITY_NONE;
+    }
+    if (strcmp(value, "cpu") == 0) {
+        return THREADPOOL_AFFINITY_CPU;
+    }
+    if (strcmp(value, "numa") == 0) {
+        return THREADPOOL_AFFINITY_NUMA;
+    }
+    fprintf(stderr, "%s: affinity %s is unknown, ignoring it\n", THREADPOOL_AFFINITY_ENV, value);
+    return THREADPOOL_AFFINITY_NONE;
+}
+
+int threadpool_configure(size_t nr_threads, threadpool_affinity affinity) {
+    pthread_mutex_lock(&threadpool.mutex);
+    if (threadpool.started) {
+        pthread_mutex_unlock(&threadpool.mutex);
+        return -1;
+    }
+    if (nr_threads == 0) {
+        nr_threads = threadpool_default_size();
+    }
+    nr_threads = (nr_threads > THREADPOOL_MAX_THREADS) ? THREADPOOL_MAX_THREADS : nr_threads;
+    __atomic_store_n(&threadpool.nr_threads, nr_threads, __ATOMIC_RELEASE);
+    threadpool.affinity = affinity;
+    threadpool.configured = 1;
+    pthread_mutex_unlock(&threadpool.mutex);
+    return 0;
+}
+
+size_t threadpool_size(void) {
+    size_t nr_threads = __atomic_load_n(&threadpool.nr_threads, __ATOMIC_ACQUIRE);
+    if (nr_threads != 0) {
+        return nr_threads;
+    }
+    pthread_mutex_lock(&threadpool.mutex);
+    if (threadpool.nr_threads == 0) {
+        __atomic_store_n(&threadpool.nr_threads, threadpool_default_size(), __ATOMIC_RELEASE);
+    }
+    nr_threads = threadpool.nr_threads;
+    pthread_mutex_unlock(&threadpool.mutex);
+    return nr_threads;
+}
+
+// Parses a cpulist such as "0-3,8-11" into a set, returns the number of CPUs in it;
+static size_t threadpool_parse_cpulist(const char* list, cpu_set_t* set) {
+    char* end = NULL;
+    unsigned long first = 0, last = 0;
+    CPU_ZERO(set);
+    while ((*list >= '0') && (*list <= '9')) {
+        first = strtoul(list, &end, 10);
+        last = (*end == '-') ? strtoul(end + 1, &end, 10) : first;
+        for (unsigned long cpu = first; (cpu <= last) && (cpu < CPU_SETSIZE); cpu++) {
+            CPU_SET(cpu, set);
+        }
+        list = (*end == ',') ? end + 1 : end;
+    }
+    return CPU_COUNT(set);
+}
+
+// Reads the CPUs of every node that has any, returns the number of such nodes;
+static size_t threadpool_read_nodes(cpu_set_t* nodes) {
+    char path[64];
+    char list[1024];
+    size_t nr_nodes = 0;
+    FILE* file = NULL;
+    for (size_t node = 0; node < THREADPOOL_MAX_NODES; node++) {
+        snprintf(path, sizeof path, "/sys/devices/system/node/node%zu/cpulist", node);
+        file = fopen(path, "r");
+        if (file == NULL) {
+            continue;
+        }
+        if ((fgets(list, sizeof list, file) != NULL) && (threadpool_parse_cpulist(list, &nodes[nr_nodes]) > 0)) {
+            nr_nodes++;
+        }
+        fclose(file);
+    }
+    return nr_nodes;
+}
+
+// Pins the workers round robin over the CPUs the process may use, or over the NUMA nodes;
+static void threadpool_pin(pthread_t* workers, size_t nr_workers, threadpool_affinity affinity) {
+    cpu_set_t allowed, set;
+    cpu_set_t nodes[THREADPOOL_MAX_NODES];
+    int cpus[CPU_SETSIZE];
+    size_t nr_cpus = 0, nr_nodes = 0;
+    if (affinity == THREADPOOL_AFFINITY_NUMA) {
+        nr_nodes = threadpool_read_nodes(nodes);
+        if (nr_nodes == 0) {
+            fprintf(stderr, "%s: no NUMA nodes found, leaving the workers unpinned\n", THREADPOOL_AFFINITY_ENV);
+            return;
+        }
+        // The calling thread is left where it is, the workers take the nodes in turn;
+        for (size_t i = 0; i < nr_workers; i++) {
+            pthread_setaffinity_np(workers[i], sizeof nodes[i % nr_nodes], &nodes[i % nr_nodes]);
+        }
+        return;
+    }
+    if (sched_getaffinity(0, sizeof allowed, &allowed) != 0) {
+        return;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            cpus[nr_cpus++] = cpu;
+        }
+    }
+    // The first CPU is left to the calling thread while there are enough;
+    for (size_t i = 0; (i < nr_workers) && (nr_cpus > 0); i++) {
+        CPU_ZERO(&set);
+        CPU_SET(cpus[(i + 1) % nr_cpus], &set);
+        // A CPU taken offline in the meantime only costs the pinning;
+        pthread_setaffinity_np(workers[i], sizeof set, &set);
+    }
+}
+
+static int threadpool_push(threadpool_deque* deque, const threadpool_task* task) {
+    int pushed = 0;
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->bottom - deque->top < THREADPOOL_DEQUE_SIZE) {
+        deque->tasks[deque->bottom % THREADPOOL_DEQUE_SIZE] = *task;
+        __atomic_store_n(&deque->bottom, deque->bottom + 1, __ATOMIC_RELEASE);
+        pushed = 1;
+    }
+    pthread_mutex_unlock(&deque->mutex);
+    return pushed;
+}
+
+static int threadpool_take(threadpool_deque* deque, threadpool_task* task, int steal) {
+    int taken = 0;
+    // Peek first, most deques a thief looks at are empty;
+    if (__atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE) == __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->bottom != deque->top) {
+        if (steal) {
+            *task = deque->tasks[deque->top % THREADPOOL_DEQUE_SIZE];
+            __atomic_store_n(&deque->top, deque->top + 1, __ATOMIC_RELEASE);
+        } else {
+            __atomic_store_n(&deque->bottom, deque->bottom - 1, __ATOMIC_RELEASE);
+            *task = deque->tasks[deque->bottom % THREADPOOL_DEQUE_SIZE];
+        }
+        taken = 1;
+    }
+    pthread_mutex_unlock(&deque->mutex);
+    return taken;
+}
+
+// Takes the newest range of the own deque, or steals the oldest one of another deque;
+static int threadpool_find(threadpool_task* task) {
+    size_t self = threadpool_self;
+    size_t nr_deques = threadpool.nr_deques;
+    if (threadpool_take(&threadpool.deques[self], task, 0)) {
+        return 1;
+    }
+    // Start after the own deque, so the thieves do not all go for the same victim;
+    for (size_t i = 1; i < nr_deques; i++) {
+        if (threadpool_take(&threadpool.deques[(self + i) % nr_deques], task, 1)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void threadpool_notify(void) {
+    __atomic_fetch_add(&threadpool.epoch, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&threadpool.nr_sleeping, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&threadpool.mutex);
+        pthread_cond_signal(&threadpool.wake);
+        pthread_mutex_unlock(&threadpool.mutex);
+    }
+}
+
+// Sleeps unless a range was pushed since epoch was read or the group is done;
+static void threadpool_sleep(uint64_t epoch, const threadpool_group* group) {
+    pthread_mutex_lock(&threadpool.mutex);
+    __atomic_fetch_add(&threadpool.nr_sleeping, 1, __ATOMIC_SEQ_CST);
+    while ((__atomic_load_n(&threadpool.epoch, __ATOMIC_SEQ_CST) == epoch) &&
+        ((group == NULL) || (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0))) {
+        pthread_cond_wait(&threadpool.wake, &threadpool.mutex);
+    }
+    __atomic_fetch_sub(&threadpool.nr_sleeping, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&threadpool.mutex);
+}
+
+static void threadpool_run(threadpool_task* task) {
+    threadpool_deque* own = &threadpool.deques[threadpool_self];
+    threadpool_group* group = task->group;
+    threadpool_task upper = *task;
+    size_t nr_grains = 0;
+    // Halve the range while it holds more than a grain, keep the lower half and offer the upper one;
+    while ((nr_grains = (task->end - task->start + task->grain - 1) / task->grain) > 1) {
+        upper.start = task->start + (nr_grains / 2) * task->grain;
+        upper.end = task->end;
+        __atomic_fetch_add(&group->pending, 1, __ATOMIC_RELAXED);
+        if (!threadpool_push(own, &upper)) {
+            // A full deque => the pool has plenty to do, run the rest here;
+            __atomic_fetch_sub(&group->pending, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        threadpool_notify();
+        task->end = upper.start;
+    }
+    task->fn(task->context, task->start, task->end);
+    // The waiter checks the count under the mutex => it cannot miss the broadcast;
+    if (__atomic_sub_fetch(&group->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&threadpool.mutex);
+        pthread_cond_broadcast(&threadpool.wake);
+        pthread_mutex_unlock(&threadpool.mutex);
+    }
+}
+
+static void* threadpool_worker(void* arg) {
+    threadpool_task task;
+    uint64_t epoch = 0;
+    threadpool_self = (size_t)(uintptr_t)arg;
+    for (;;) {
+        epoch = __atomic_load_n(&threadpool.epoch, __ATOMIC_SEQ_CST);
+        if (threadpool_find(&task)) {
+            threadpool_run(&task);
+        } else {
+            threadpool_sleep(epoch, NULL);
+        }
+    }
+    return NULL;
+}
+
+void threadpool_start(void) {
+    size_t nr_threads = threadpool_size();
+    pthread_t workers[THREADPOOL_MAX_THREADS];
+    pthread_mutex_lock(&threadpool.mutex);
+    if (threadpool.started) {
+        pthread_mutex_unlock(&threadpool.mutex);
+        return;
+    }
+    if (!threadpool.configured) {
+        threadpool.affinity = threadpool_default_affinity();
+    }
+    nr_threads = threadpool.nr_threads;
+    threadpool.deques = safe_aligned_malloc(THREADPOOL_CACHE_LINE, nr_threads * sizeof *threadpool.deques);
+    for (size_t i = 0; i < nr_threads; i++) {
+        pthread_mutex_init(&threadpool.deques[i].mutex, NULL);
+        threadpool.deques[i].top = 0;
+        threadpool.deques[i].bottom = 0;
+    }
+    threadpool.nr_deques = nr_threads;
+    // The workers live as long as the process, they sleep while there is nothing to run;
+    for (size_t i = 1; i < nr_threads; i++) {
+        if (pthread_create(&workers[i - 1], NULL, threadpool_worker, (void*)(uintptr_t)i) != 0) {
+            fprintf(stderr, "Could not create a pool thread. Proceeding to crash. Cleaning up...");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(workers[i - 1]);
+    }
+    if (threadpool.affinity != THREADPOOL_AFFINITY_NONE) {
+        threadpool_pin(workers, nr_threads - 1, threadpool.affinity);
+    }
+    __atomic_store_n(&threadpool.started, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&threadpool.mutex);
+}
+
+void parallel_for(size_t len, size_t grain, parallel_fn fn, void* context) {
+    threadpool_group group = { .pending = 1 };
+    threadpool_task task;
+    size_t nr_threads = threadpool_size();
+    size_t per_split = 0;
+    uint64_t epoch = 0;
+    grain = (grain > 0) ? grain : 1;
+    if (len == 0) {
+        return;
+    }
+    if ((len <= grain) || (nr_threads == 1)) {
+        fn(context, 0, len);
+        return;
+    }
+    // Cut no finer than the pool can use, in whole grains so every boundary stays a multiple of the grain;
+    per_split = len / (nr_threads * THREADPOOL_SPLITS_PER_THREAD);
+    if (per_split > grain) {
+        grain = ((per_split + grain - 1) / grain) * grain;
+    }
+    if (!__atomic_load_n(&threadpool.started, __ATOMIC_ACQUIRE)) {
+        threadpool_start();
+    }
+    task = (threadpool_task){ .fn = fn, .context = context, .start = 0, .end = len, .grain = grain, .group = &group };
+    threadpool_run(&task);
+    // Run pending ranges, of this loop or any other, until the last range of this loop is done;
+    while (__atomic_load_n(&group.pending, __ATOMIC_ACQUIRE) > 0) {
+        epoch = __atomic_load_n(&threadpool.epoch, __ATOMIC_SEQ_CST);
+        if (threadpool_find(&task)) {
+            threadpool_run(&task);
+        } else {
+            threadpool_sleep(epoch, &group);
+        }
+    }
+}
+
+void parallel_for_bytes(size_t len, size_t unit, parallel_fn fn, void* context) {
+    size_t grain = (unit > 0) ? unit : 1;
+    // The least common multiple of the unit and a cache line;
+    while (grain % THREADPOOL_CACHE_LINE != 0) {
+        grain += (unit > 0) ? unit : 1;
+    }
+    grain *= (THREADPOOL_MIN_BYTES + grain - 1) / grain;
+    parallel_for(len, grain, fn, context);
+}
\ No newline at end of file
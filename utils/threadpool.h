@@ -0,0 +1,89 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+/** ----------------------------------------------------------------------------------
+ * @brief   The functions defined in this file run loops on a shared work-stealing pool.
+ * @details The pool is started by the first loop large enough to be split, with one
+ *          thread less than its size since the calling thread always works as well.
+ *          Every worker owns a deque of ranges: it splits the range it runs in halves,
+ *          pushes the upper ones and keeps working on the lower one, while idle workers
+ *          steal the largest pending range from the other end of a busy worker's deque.
+ *          A thread that waits for a loop runs pending ranges meanwhile, so loops may be
+ *          nested. Loops no larger than one grain, or on a pool of size one, run inline.
+ *
+ *          THREADPOOL_THREADS_ENV sets the size (one per online CPU by default) and
+ *          THREADPOOL_AFFINITY_ENV pins the workers: "cpu" to one CPU each, "numa" to
+ *          the CPUs of one node each, round robin, or "none" (the default).
+ * @author  Murea Cosmin Alexandru
+ * @date    01.03.2024
+ * ----------------------------------------------------------------------------------- **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#define THREADPOOL_THREADS_ENV "NIGHTHAWK_THREADS"
+#define THREADPOOL_AFFINITY_ENV "NIGHTHAWK_AFFINITY"
+#define THREADPOOL_MAX_THREADS 64
+// The ranges a deque holds, a worker with a full deque runs the rest of its range itself;
+#define THREADPOOL_DEQUE_SIZE 256
+// A loop is cut into about this many grains per thread, fewer ranges cost less to schedule;
+#define THREADPOOL_SPLITS_PER_THREAD 8
+#define THREADPOOL_CACHE_LINE 64
+// Byte loops are never split into pieces smaller than this;
+#define THREADPOOL_MIN_BYTES 16384
+
+typedef enum {
+    THREADPOOL_AFFINITY_NONE = 0,
+    THREADPOOL_AFFINITY_CPU,
+    THREADPOOL_AFFINITY_NUMA
+} threadpool_affinity;
+
+// Runs the iterations [start, end) of a loop;
+typedef void (*parallel_fn)(void* context, size_t start, size_t end);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Sets the size and pinning of the pool before it is started.
+ * @param   nr_threads  The number of threads including the caller (0 keeps the default).
+ * @param   affinity    How to pin the workers.
+ * @returns 0 on success, -1 if the pool is already running.
+ * ----------------------------------------------------------------------------------- **/
+int threadpool_configure(size_t nr_threads, threadpool_affinity affinity);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Reports the number of threads a loop can run on, the caller included.
+ * @returns The size of the pool, between 1 and THREADPOOL_MAX_THREADS.
+ * ----------------------------------------------------------------------------------- **/
+size_t threadpool_size(void);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Starts the workers now instead of on the first loop large enough to split.
+ * @details The workers inherit the CPU mask of the thread that starts them, so a caller
+ *          about to pin itself starts the pool first. Does nothing once it is running.
+ * ----------------------------------------------------------------------------------- **/
+void threadpool_start(void);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Runs fn over [0, len) on the pool and returns once every iteration is done.
+ * @details Every range fn receives starts at a multiple of grain and holds at least one
+ *          grain unless it is the last one.
+ * @param   len         The number of iterations.
+ * @param   grain       The smallest number of iterations worth a range of its own.
+ * @param   fn          The function to run.
+ * @param   context     The first argument of fn.
+ * ----------------------------------------------------------------------------------- **/
+void parallel_for(size_t len, size_t grain, parallel_fn fn, void* context);
+
+/** ----------------------------------------------------------------------------------
+ * @brief   Runs fn over the bytes [0, len), split at cache line boundaries.
+ * @details The ranges are multiples of both unit and THREADPOOL_CACHE_LINE, so no two
+ *          threads write into the same line of a line aligned output, and never hold
+ *          less than THREADPOOL_MIN_BYTES, so short inputs run inline.
+ * @param   len         The number of bytes.
+ * @param   unit        The number of bytes that must stay together, e.g. a cipher block.
+ * @param   fn          The function to run.
+ * @param   context     The first argument of fn.
+ * ----------------------------------------------------------------------------------- **/
+void parallel_for_bytes(size_t len, size_t unit, parallel_fn fn, void* context);
+
+#endif
\ No newline at end of file